@@ -0,0 +1,109 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+/*
+ * bench_streams: UDP datagrams per second with many parallel streams
+ * over loopback, the workload where the per-datagram stream state
+ * matters.  It runs a one-off server in a child process and a client
+ * against it, so builds can be compared by running it in each:
+ *
+ *     make bench_streams && ./bench_streams [streams [seconds [port]]]
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+
+static struct iperf_test *
+bench_test(int argc, char **argv)
+{
+    struct iperf_test *test;
+
+    if ((test = iperf_new_test()) == NULL)
+	exit(1);
+    iperf_defaults(test);
+    optind = 1;		/* the client is parsed again on every retry */
+    if (iperf_parse_arguments(test, argc, argv) < 0) {
+	fprintf(stderr, "bench_streams: %s\n", iperf_strerror(i_errno));
+	exit(1);
+    }
+    test->outfile = fopen("/dev/null", "w");
+    return test;
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *streams = argc > 1 ? argv[1] : "128";
+    const char *seconds = argc > 2 ? argv[2] : "5";
+    const char *port = argc > 3 ? argv[3] : "5299";
+    char *sargv[] = { "bench_streams", "-s", "-1", "-p", (char *) port, NULL };
+    char *cargv[] = { "bench_streams", "-c", "127.0.0.1", "-p", (char *) port, "-u",
+		      "-b", "0", "-l", "64", "-P", (char *) streams, "-t", (char *) seconds, NULL };
+    struct iperf_test *test;
+    struct iperf_stream *sp;
+    uint64_t sent = 0, received = 0;
+    pid_t server;
+    int tries, r;
+
+    if ((server = fork()) < 0)
+	return 1;
+    if (server == 0) {
+	test = bench_test(sizeof(sargv) / sizeof(sargv[0]) - 1, sargv);
+	r = iperf_run_server(test);
+	iperf_free_test(test);
+	_exit(r < 0);
+    }
+
+    /* Wait for the server to listen. */
+    for (tries = 0; tries < 50; ++tries) {
+	usleep(100000);
+	test = bench_test(sizeof(cargv) / sizeof(cargv[0]) - 1, cargv);
+	if ((r = iperf_run_client(test)) >= 0 || i_errno != IECONNECT)
+	    break;
+	iperf_free_test(test);
+    }
+    if (r < 0) {
+	fprintf(stderr, "bench_streams: %s\n", iperf_strerror(i_errno));
+	kill(server, SIGTERM);
+	return 1;
+    }
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	sent += sp->packet_count;
+	received += sp->peer_packet_count;
+    }
+    printf("%8s %16s %16s\n", "streams", "sent pps", "received pps");
+    printf("%8s %16.0f %16.0f\n", streams, sent / (double) test->duration, received / (double) test->duration);
+    iperf_free_test(test);
+    waitpid(server, NULL, 0);
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+/*
+ * bench_timer: compare the timer heap in timer.c with the sorted list
+ * it replaced, on the pacing workload: n periodic timers with the same
+ * period and staggered phases, run on a simulated clock.
+ *
+ *     make bench_timer && ./bench_timer [period-usecs]
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "timer.h"
+#include "iperf_time.h"
+
+/* The old implementation: a sorted doubly linked list. */
+struct list_timer {
+    struct iperf_time time;
+    int64_t usecs;
+    struct list_timer *prev, *next;
+};
+
+static struct list_timer *list_head;
+static uint64_t fires;
+
+static void
+list_add(struct list_timer *t)
+{
+    struct list_timer *t2, *t2prev;
+
+    if (list_head == NULL) {
+	list_head = t;
+	t->prev = t->next = NULL;
+    } else if (iperf_time_compare(&t->time, &list_head->time) < 0) {
+	t->prev = NULL;
+	t->next = list_head;
+	list_head->prev = t;
+	list_head = t;
+    } else {
+	for (t2prev = list_head, t2 = list_head->next; t2 != NULL; t2prev = t2, t2 = t2->next) {
+	    if (iperf_time_compare(&t->time, &t2->time) < 0) {
+		t2prev->next = t;
+		t->prev = t2prev;
+		t->next = t2;
+		t2->prev = t;
+		return;
+	    }
+	}
+	t2prev->next = t;
+	t->prev = t2prev;
+	t->next = NULL;
+    }
+}
+
+static void
+list_remove(struct list_timer *t)
+{
+    if (t->prev == NULL)
+	list_head = t->next;
+    else
+	t->prev->next = t->next;
+    if (t->next != NULL)
+	t->next->prev = t->prev;
+}
+
+static void
+list_run(struct iperf_time *now)
+{
+    struct list_timer *t, *next;
+
+    for (t = list_head; t != NULL; t = next) {
+	next = t->next;
+	if (iperf_time_compare(&t->time, now) > 0)
+	    break;
+	++fires;
+	iperf_time_add_usecs(&t->time, t->usecs);
+	list_remove(t);
+	list_add(t);
+    }
+}
+
+static void
+tick_proc(TimerClientData client_data, struct iperf_time *nowP)
+{
+    ++fires;
+}
+
+static double
+elapsed_ns(struct timespec *a, struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+/* Run n timers for 20 periods, advancing the clock 10 us at a time.
+ * Timer i first fires i/n of a period after the first period. */
+static double
+bench(int n, int64_t period, int use_list)
+{
+    struct list_timer *lt = NULL;
+    struct iperf_time start, now;
+    struct timespec t0, t1;
+    int64_t step, steps;
+    int i;
+
+    start.secs = 1000;
+    start.nsecs = 0;
+    fires = 0;
+    if (use_list) {
+	lt = calloc(n, sizeof(*lt));
+	if (lt == NULL)
+	    exit(1);
+	list_head = NULL;
+	for (i = 0; i < n; ++i) {
+	    lt[i].time = start;
+	    iperf_time_add_usecs(&lt[i].time, (int64_t) i * period / n + period);
+	    lt[i].usecs = period;
+	    list_add(&lt[i]);
+	}
+    } else {
+	for (i = 0; i < n; ++i) {
+	    now = start;
+	    iperf_time_add_usecs(&now, (int64_t) i * period / n);
+	    if (tmr_create(&now, tick_proc, JunkClientData, period, 1) == NULL)
+		exit(1);
+	}
+    }
+
+    steps = 20 * period / 10;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (step = 1; step <= steps; ++step) {
+	now = start;
+	iperf_time_add_usecs(&now, step * 10);
+	if (use_list)
+	    list_run(&now);
+	else
+	    tmr_run(&now);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (use_list)
+	free(lt);
+    else
+	tmr_destroy();
+    return fires ? elapsed_ns(&t0, &t1) / fires : 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    static const int counts[] = { 10, 100, 1000, 10000 };
+    int64_t period = argc > 1 ? atoi(argv[1]) : 1000;
+    unsigned i;
+
+    printf("%8s %16s %16s\n", "timers", "list ns/fire", "heap ns/fire");
+    for (i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+	printf("%8d %16.1f %16.1f\n", counts[i], bench(counts[i], period, 1), bench(counts[i], period, 0));
+    return 0;
+}
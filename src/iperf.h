@@ -62,6 +62,15 @@
 #include "queue.h"
 #include "cjson.h"
 #include "iperf_time.h"
+#include "iperf_event.h"
+#include "iperf_histogram.h"
+#include "iperf_seqwin.h"
+#include "iperf_pacer.h"
+#include "iperf_pacing.h"
+
+#if defined(HAVE_PTHREAD)
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
 
 #if defined(HAVE_SSL)
 #include <openssl/bio.h>
@@ -87,6 +96,10 @@ struct iperf_interval_results
     double    jitter;
     int       outoforder_packets;
     int       cnt_error;
+    struct iperf_latency_summary latency;	/* --latency-histogram, this interval */
+    struct iperf_latency_summary pacing_error;	/* paced senders, this interval */
+    struct iperf_latency_summary rr_rtt;	/* --rr transaction times, this interval */
+    struct iperf_latency_summary crr_connect;	/* --crr connect times, this interval */
 
     int omitted;
 #if (defined(linux) || defined(__FreeBSD__) || defined(__NetBSD__)) && \
@@ -99,7 +112,6 @@ struct iperf_interval_results
     int interval_retrans;
     int interval_sacks;
     int snd_cwnd;
-    TAILQ_ENTRY(iperf_interval_results) irlistentries;
     void     *custom_data;
     int rtt;
     int rttvar;
@@ -108,10 +120,16 @@ struct iperf_interval_results
 
 struct iperf_stream_result
 {
+    /*
+     * bytes_received and bytes_sent are only ever written by the thread
+     * running the stream; the reporting side takes differences against
+     * its own marks instead of resetting them.
+     */
     iperf_size_t bytes_received;
     iperf_size_t bytes_sent;
-    iperf_size_t bytes_received_this_interval;
-    iperf_size_t bytes_sent_this_interval;
+    iperf_size_t bytes_received_interval_mark;	/* totals at start of interval */
+    iperf_size_t bytes_sent_interval_mark;
+    iperf_size_t bytes_received_omit;
     iperf_size_t bytes_sent_omit;
     int stream_prev_total_retrans;
     int stream_retrans;
@@ -127,7 +145,13 @@ struct iperf_stream_result
     struct iperf_time start_time_fixed;
     double sender_time;
     double receiver_time;
-    TAILQ_HEAD(irlisthead, iperf_interval_results) interval_results;
+    /*
+     * The last interval_results_size intervals, oldest overwritten
+     * first; totals are kept above, so the history stays bounded.
+     */
+    struct iperf_interval_results *interval_results;
+    int interval_results_size;
+    uint64_t interval_results_count;	/* intervals recorded so far */
     void     *data;
 };
 
@@ -144,6 +168,9 @@ struct iperf_settings
     uint64_t  fqrate;               /* target data rate for FQ pacing*/
     int	      pacing_timer;	    /* pacing timer in microseconds */
     int       burst;                /* packets per burst */
+    iperf_size_t bucket_depth;      /* pacing token bucket depth, in bytes */
+    int       pacing_driver;        /* IPERF_PACING_* */
+    int       bucket_depth_packets; /* ... or in blocks */
     int       mss;                  /* for TCP MSS */
     int       ttl;                  /* IP TTL option */
     int       tos;                  /* type of service bit */
@@ -159,54 +186,133 @@ struct iperf_settings
     EVP_PKEY  *client_rsa_pubkey;
 #endif // HAVE_SSL
     int	      connect_timeout;	    /* socket connection timeout, in ms */
+    int       udp_batch;            /* datagrams per sendmmsg/recvmmsg */
+    int       udp_gso;              /* datagrams per UDP_SEGMENT send */
+    int       udp_gro;              /* receive coalesced (UDP_GRO) reads */
+    int       rx_timestamps;        /* take UDP arrival times from SO_TIMESTAMPNS */
+    int       latency_histogram;    /* keep per-datagram one-way latency histograms */
+    int       reorder_window;       /* UDP receive window, in datagrams (0 = default) */
+    int       txtime;               /* give each UDP datagram an SO_TXTIME departure time (NET_TXTIME_*) */
+    int       busy_poll;            /* spin this many usecs after an event (0 = block) */
+    int       rr_request;           /* --rr request size, in bytes (0 = bulk transfer) */
+    int       rr_response;          /* --rr response size, in bytes */
+    int       crr;                  /* --crr: a new connection per transaction */
+    int       msg_zerocopy;         /* send from a ring of buffers with MSG_ZEROCOPY */
+    int       rx_zerocopy;          /* map received TCP pages with TCP_ZEROCOPY_RECEIVE */
+    int       splice;               /* drain received TCP data with splice() */
+    int       hugepages;            /* back stream buffers with 2 MB huge pages */
 };
 
 struct iperf_test;
 
+/* Streams are allocated on a boundary of this many bytes, see below. */
+#define IPERF_CACHELINE 64
+
 struct iperf_stream
 {
-    struct iperf_test* test;
-
-    /* configurable members */
-    int       local_port;
-    int       remote_port;
+    /*
+     * Hot: what every send or receive touches.  iperf_new_stream()
+     * aligns streams to IPERF_CACHELINE, so this block (which must stay
+     * 64 bytes on LP64) is the stream's first cache line, and the byte
+     * counters that open result_data are its second.
+     */
     int       socket;
-    int       id;
     int       sender;
+    int       green_light;
+    int       id;
+    int       (*snd) (struct iperf_stream * stream);
+    int       (*rcv) (struct iperf_stream * stream);
+    char      *buffer;		/* data to send, mmapped */
+    struct iperf_stream_result *result;	/* points at result_data */
 	/* XXX: is settings just a pointer to the same struct in iperf_test? if not, 
 		should it be? */
     struct iperf_settings *settings;	/* pointer to structure settings */
+    struct iperf_test* test;
 
-    /* non configurable members */
-    struct iperf_stream_result *result;	/* structure pointer to result */
-    Timer     *send_timer;
-    int       green_light;
-    int       buffer_fd;	/* data to send, file descriptor */
-    char      *buffer;		/* data to send, mmapped */
-    int       diskfile_fd;	/* file to send, file descriptor */
-    int	      diskfile_left;	/* remaining file data on disk */
+    struct iperf_stream_result result_data;
 
     /*
      * for udp measurements - This can be a structure outside stream, and
-     * stream can have a pointer to this
+     * stream can have a pointer to this.  Its own cache line, like the
+     * hot block.
      */
-    int       packet_count;
+    int       packet_count __attribute__ ((aligned (IPERF_CACHELINE)));
     int	      peer_packet_count;
-    int       omitted_packet_count;
+    int       outoforder_packets;
+    int       cnt_error;
+    int       duplicate_packets;
+    int       late_packets;		/* behind the receive window */
     double    jitter;
     double    prev_transit;
-    int       outoforder_packets;
+    struct iperf_seqwin *seqwin;	/* receive window, receiving side */
+    uint64_t  target;
+    struct iperf_event_loop *event_loop; /* loop the socket is registered with */
+
+    /* Touched on paced, batched or zerocopy sends and receives */
+    struct iperf_pacer pacer;		/* -b token bucket */
+    struct iperf_time last_send;
+    struct iperf_time pace_due;		/* when an empty bucket is back in credit */
+    int       pace_index;		/* place in its loop's pacing heap, or -1 */
+    uint64_t  txtime_next;		/* --txtime: next departure, iperf_time_now() ns */
+    int       txtime_burst;		/* datagrams of the current burst given txtime_next */
+    int       splice_fd;	/* --splice: /dev/null, or the -F file */
+    int       splice_pipe[2];	/* --splice: pipe from the socket to splice_fd */
+    char      *batch_buffer;	/* --udp-batch / --udp-gso datagrams, blksize apart */
+    struct iperf_zc *zc;	/* --msg-zerocopy send buffers, or NULL */
+    void      *rx_zc_map;	/* --rx-zerocopy: blksize of the socket mapped, or NULL */
+    uint64_t  rx_zc_mapped;	/* --rx-zerocopy: bytes received by mapping pages */
+    uint64_t  rx_zc_copied;	/* --rx-zerocopy: bytes that had to be read */
+    int       rr_writing;		/* --rr: writing a message rather than reading one */
+    int       rr_done;			/* --rr: bytes of the current message moved so far */
+    struct iperf_time rr_start;		/* --rr: when the current request started */
+    struct iperf_histogram *rr_rtt;	/* --rr transaction, --crr flow completion times, in ns (client) */
+    struct iperf_histogram *send_gaps;	/* gaps between paced sends, in ns */
+    struct iperf_histogram *pacing_error;	/* how late sends were after pace_due, in ns */
+    int       crr_fd;			/* --crr: the current connection, or -1 */
+    int       crr_state;		/* --crr: CRR_CONNECTING, CRR_HELLO, CRR_WRITING or CRR_READING */
+    struct iperf_histogram *crr_connect;	/* --crr connect times, in ns */
+
+    /*
+     * --latency-histogram: latency is recorded into by the receiving
+     * thread; the reporting side takes interval differences against
+     * latency_mark and adds them up, outside the omit period, in
+     * latency_total.  On the sending side latency_total holds the
+     * peer's results.
+     */
+    struct iperf_histogram *latency;
+    struct iperf_histogram *latency_mark;
+    struct iperf_histogram *latency_total;
+
+    /* Cold: set up once, or only looked at when reporting */
+    int       local_port;
+    int       remote_port;
+    Timer     *send_timer;
+    struct iperf_histogram *send_gaps_omit;	/* send_gaps at the end of the omit period */
+    struct iperf_histogram *pacing_error_mark;
+    struct iperf_histogram *rr_rtt_mark;
+    struct iperf_histogram *rr_rtt_total;	/* rr_rtt since the end of the omit period */
+    struct iperf_histogram *crr_connect_mark;
+    struct iperf_histogram *crr_connect_total;	/* crr_connect since the end of the omit period */
+    struct sockaddr_storage crr_peer;	/* --crr: where to connect, from the stream socket */
+    socklen_t crr_peer_len;		/* 0 until crr_peer is filled in */
+    struct sockaddr_storage crr_local;	/* --crr: address to bind to, with -B */
+    socklen_t crr_local_len;		/* 0 if not binding */
+    int       buffer_fd;	/* data to send, file descriptor */
+    int       buffer_kind;	/* IPERF_BUFFER_* (iperf_payload.h): whose buffer */
+    int       buffer_pages;	/* IPERF_PAGES_* of a private buffer */
+    int       diskfile_fd;	/* file to send, file descriptor */
+    int	      diskfile_left;	/* remaining file data on disk */
+
+    int       omitted_packet_count;
     int       omitted_outoforder_packets;
-    int       cnt_error;
     int       omitted_cnt_error;
-    uint64_t  target;
+    int       omitted_duplicate_packets;
+    int       omitted_late_packets;
+    uint64_t  reorder_distance[IPERF_SEQWIN_DIST_BUCKETS];
 
     struct sockaddr_storage local_addr;
     struct sockaddr_storage remote_addr;
 
-    int       (*rcv) (struct iperf_stream * stream);
-    int       (*snd) (struct iperf_stream * stream);
-
     /* chained send/receive routines for -F mode */
     int       (*rcv2) (struct iperf_stream * stream);
     int       (*snd2) (struct iperf_stream * stream);
@@ -217,6 +323,41 @@ struct iperf_stream
     void     *data;
 };
 
+/*
+ * A worker thread for --threads.  It owns a subset of the streams, runs
+ * its own event loop over them and calls their snd/rcv routines.  The
+ * counters below are written only by the worker; the main thread reads
+ * them when it needs totals.
+ */
+struct iperf_worker
+{
+    int       id;
+    struct iperf_test *test;
+    struct iperf_event_loop *event_loop;
+    struct iperf_stream **streams;
+    int       num_streams;
+    int       streams_size;
+    int       wakeup[2];			/* pipe, written to stop the worker */
+#if defined(HAVE_PTHREAD)
+    pthread_t thread;
+#endif /* HAVE_PTHREAD */
+    int       running;
+    volatile int error;			/* i_errno of a failed worker, else 0 */
+    int       cpu;			/* CPU to pin to, or -1 */
+    char     *payload;			/* worker-local copy of the pool's payload, or NULL */
+    char     *scratch;			/* receive scratch block for the worker's streams */
+    char    **buffers;			/* per stream: private buffer for the worker to fill, or NULL */
+
+    iperf_size_t bytes_sent;
+    iperf_size_t blocks_sent;
+    iperf_size_t bytes_received;
+    iperf_size_t blocks_received;
+
+    /* Main thread only: counts as of the end of the omit period */
+    iperf_size_t bytes_sent_omit;
+    iperf_size_t blocks_sent_omit;
+};
+
 struct protocol {
     int       id;
     char      *name;
@@ -265,6 +406,18 @@ struct iperf_test
     int       duration;                         /* total duration of test (-t flag) */
     char     *diskfile_name;			/* -F option */
     int       affinity, server_affinity;	/* -A option */
+    int       num_threads;			/* --threads option */
+    int       interval_history;			/* --interval-history option */
+    struct iperf_worker *workers;		/* num_threads of them, or NULL */
+    struct iperf_crr_server *crr_server;	/* --crr connections being served, or NULL */
+    struct iperf_payload_pool *payload_pool;	/* buffers shared by the streams, or NULL */
+    int       buffer_pages[3];			/* buffers mapped per IPERF_PAGES_* */
+    int       streams_set_up;			/* streams created, and the time it took */
+    uint64_t  stream_setup_usecs;
+    struct iperf_histogram *latency_interval;	/* all streams' latency, last interval */
+    struct iperf_pacing pacing;			/* precise pacing for the main event loop */
+    char     *pin_spec;				/* --pin option */
+    int       pin_node;				/* NUMA node picked by --pin auto, or -1 */
 #if defined(HAVE_CPUSET_SETAFFINITY)
     cpuset_t cpumask;
 #endif /* HAVE_CPUSET_SETAFFINITY */
@@ -302,6 +455,7 @@ struct iperf_test
     int       debug;				/* -d option - enable debug */
     int	      get_server_output;		/* --get-server-output */
     int	      udp_counters_64bit;		/* --use-64-bit-udp-counters */
+    int	      udp_ns_header;			/* --udp-ns-header */
     int       forceflush; /* --forceflush - flushing output at every interval */
     int	      multisend;
     int	      repeating_payload;                /* --repeating-payload */
@@ -309,10 +463,9 @@ struct iperf_test
     char     *timestamp_format;
 
     char     *json_output_string; /* rendered JSON output if json_output is set */
-    /* Select related parameters */
-    int       max_fd;
-    fd_set    read_set;                         /* set of read sockets */
-    fd_set    write_set;                        /* set of write sockets */
+    /* Event loop related parameters */
+    char     *event_backend;                    /* --event-backend */
+    struct iperf_event_loop *event_loop;        /* registered sockets */
 
     /* Interval related members */ 
     int       omitting;
@@ -328,6 +481,7 @@ struct iperf_test
 
     double cpu_util[3];                            /* cpu utilization of the test - total, user, system */
     double remote_cpu_util[3];                     /* cpu utilization for the remote host/client - total, user, system */
+    uint64_t remote_busy_polls[2];                 /* --busy-poll polls and empty polls on the remote host */
 
     int       num_streams;                      /* total streams in the test (-P) */
 
@@ -345,6 +499,19 @@ struct iperf_test
     char      cookie[COOKIE_SIZE];
 //    struct iperf_stream *streams;               /* pointer to list of struct stream */
     SLIST_HEAD(slisthead, iperf_stream) streams;
+    /*
+     * The same streams in arrays, in the order they were added, for the
+     * loops that visit every stream (or every sender or receiver) each
+     * tick or interval.  Kept by iperf_add_stream().
+     */
+    struct iperf_stream *streams_tail;
+    struct iperf_stream **stream_table;
+    struct iperf_stream **senders;
+    struct iperf_stream **receivers;
+    int       stream_table_len;
+    int       stream_table_size;		/* entries allocated in each array */
+    int       num_senders;
+    int       num_receivers;
     struct iperf_settings *settings;
 
     SLIST_HEAD(plisthead, protocol) protocols;
@@ -396,8 +563,24 @@ struct iperf_test
 #define MAX_INTERVAL 60.0
 #define MAX_TIME 86400
 #define MAX_BURST 1000
+#define MAX_BUSY_POLL 1000000
+#define MAX_BUCKET_DEPTH ((double) (1ULL << 40))
+#define DEFAULT_INTERVAL_HISTORY 16
+#define MAX_INTERVAL_HISTORY MAX_TIME
+#define RX_ZEROCOPY_TCP_OPTIONS 12	/* TCP timestamp option, for the --rx-zerocopy MSS */
+#define MAX_RR_SIZE (16 * 1024 * 1024)
 #define MAX_MSS (9 * 1024)
+/*
+ * select() can't watch descriptors at or past FD_SETSIZE, epoll has no
+ * such limit.  Beyond this we run into RLIMIT_NOFILE anyway.
+ */
+#if defined(HAVE_EPOLL)
+#define MAX_STREAMS 65536
+#else
 #define MAX_STREAMS 1000
+#endif /* HAVE_EPOLL */
+#define MAX_THREADS 256
+#define MAX_PIN_CPUS 1024
 
 #define TIMESTAMP_FORMAT "%c "
 
@@ -78,6 +78,11 @@
 #include "iperf_udp.h"
 #include "iperf_tcp.h"
 #include "iperf_rutp.h"
+#include "iperf_worker.h"
+#include "iperf_rr.h"
+#include "iperf_crr.h"
+#include "iperf_zerocopy.h"
+#include "iperf_payload.h"
 #if defined(HAVE_SCTP_H)
 #include "iperf_sctp.h"
 #endif /* HAVE_SCTP_H */
@@ -103,6 +108,16 @@ static int diskfile_send(struct iperf_stream *sp);
 static int diskfile_recv(struct iperf_stream *sp);
 static int JSON_write(int fd, cJSON *json);
 static void print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *json_interval_streams);
+static void print_latency(struct iperf_test *test, int id, const char *mbuf, double st, double et, const struct iperf_latency_summary *ls, cJSON *j);
+static void print_send_gaps(struct iperf_test *test, struct iperf_stream *sp, const char *mbuf, double st, double et, cJSON *j);
+static void print_pacing_error(struct iperf_test *test, int id, const char *mbuf, double st, double et, const struct iperf_latency_summary *ps, cJSON *j);
+static void print_busy_poll(struct iperf_test *test);
+static void print_rr(struct iperf_test *test, int id, const char *mbuf, double st, double et, const struct iperf_latency_summary *rs, const struct iperf_latency_summary *cs, cJSON *j);
+static void print_rr_summary(struct iperf_test *test);
+static void print_msg_zerocopy(struct iperf_test *test);
+static void print_rx_zerocopy(struct iperf_test *test);
+static void print_stream_setup(struct iperf_test *test);
+static void print_reordering(struct iperf_test *test, struct iperf_stream *sp, const char *mbuf, double st, double et, cJSON *j);
 static cJSON *JSON_read(int fd);
 
 
@@ -118,7 +133,7 @@ usage()
 void
 usage_long(FILE *f)
 {
-    fprintf(f, usage_longstr, UDP_RATE / (1024*1024), DURATION, DEFAULT_TCP_BLKSIZE / 1024, DEFAULT_UDP_BLKSIZE);
+    fprintf(f, usage_longstr, DEFAULT_INTERVAL_HISTORY, UDP_RATE / (1024*1024), DURATION, DEFAULT_TCP_BLKSIZE / 1024, DEFAULT_UDP_BLKSIZE);
 }
 
 
@@ -346,6 +361,12 @@ iperf_get_test_udp_counters_64bit(struct iperf_test *ipt)
     return ipt->udp_counters_64bit;
 }
 
+int
+iperf_get_test_udp_ns_header(struct iperf_test *ipt)
+{
+    return ipt->udp_ns_header;
+}
+
 int
 iperf_get_test_one_off(struct iperf_test *ipt)
 {
@@ -383,6 +404,12 @@ iperf_get_test_connect_timeout(struct iperf_test *ipt)
     return ipt->settings->connect_timeout;
 }
 
+int
+iperf_get_test_num_threads(struct iperf_test *ipt)
+{
+    return ipt->num_threads;
+}
+
 /************** Setter routines for some fields inside iperf_test *************/
 
 void
@@ -668,6 +695,12 @@ iperf_set_test_udp_counters_64bit(struct iperf_test *ipt, int udp_counters_64bit
     ipt->udp_counters_64bit = udp_counters_64bit;
 }
 
+void
+iperf_set_test_udp_ns_header(struct iperf_test *ipt, int udp_ns_header)
+{
+    ipt->udp_ns_header = udp_ns_header;
+}
+
 void
 iperf_set_test_one_off(struct iperf_test *ipt, int one_off)
 {
@@ -708,6 +741,12 @@ iperf_set_test_connect_timeout(struct iperf_test* ipt, int ct)
     ipt->settings->connect_timeout = ct;
 }
 
+void
+iperf_set_test_num_threads(struct iperf_test *ipt, int num_threads)
+{
+    ipt->num_threads = num_threads;
+}
+
 
 /********************** Get/set test protocol structure ***********************/
 
@@ -753,11 +792,53 @@ iperf_on_new_stream(struct iperf_stream *sp)
     connect_msg(sp);
 }
 
+/* Are UDP datagrams being sent and received in batches? */
+static int
+iperf_udp_batching(struct iperf_test *test)
+{
+    return (test->protocol->id == Pudp || test->protocol->id == Prutp) &&
+	test->settings->udp_batch > 1;
+}
+
 void
 iperf_on_test_start(struct iperf_test *test)
 {
     if (test->json_output) {
-	cJSON_AddItemToObject(test->json_start, "test_start", iperf_json_printf("protocol: %s  num_streams: %d  blksize: %d  omit: %d  duration: %d  bytes: %d  blocks: %d  reverse: %d  tos: %d", test->protocol->name, (int64_t) test->num_streams, (int64_t) test->settings->blksize, (int64_t) test->omit, (int64_t) test->duration, (int64_t) test->settings->bytes, (int64_t) test->settings->blocks, test->reverse?(int64_t)1:(int64_t)0, (int64_t) test->settings->tos));
+	cJSON *j_test_start;
+
+	j_test_start = iperf_json_printf("protocol: %s  num_streams: %d  blksize: %d  omit: %d  duration: %d  bytes: %d  blocks: %d  reverse: %d  tos: %d", test->protocol->name, (int64_t) test->num_streams, (int64_t) test->settings->blksize, (int64_t) test->omit, (int64_t) test->duration, (int64_t) test->settings->bytes, (int64_t) test->settings->blocks, test->reverse?(int64_t)1:(int64_t)0, (int64_t) test->settings->tos);
+	if (j_test_start != NULL && iperf_udp_batching(test))
+	    cJSON_AddNumberToObject(j_test_start, "udp_batch", test->settings->udp_batch);
+	if (j_test_start != NULL && test->protocol->id == Pudp && test->settings->udp_gso > 1)
+	    cJSON_AddNumberToObject(j_test_start, "udp_gso", test->settings->udp_gso);
+	if (j_test_start != NULL && test->protocol->id == Pudp && test->settings->udp_gro)
+	    cJSON_AddTrueToObject(j_test_start, "udp_gro");
+	if (j_test_start != NULL && test->protocol->id == Pudp)
+	    cJSON_AddStringToObject(j_test_start, "rx_clock", test->settings->rx_timestamps ? "kernel" : "user");
+	if (j_test_start != NULL && test->settings->latency_histogram)
+	    cJSON_AddTrueToObject(j_test_start, "latency_histogram");
+	if (j_test_start != NULL && test->protocol->id == Pudp && test->settings->txtime) {
+	    cJSON_AddTrueToObject(j_test_start, "txtime");
+	    cJSON_AddStringToObject(j_test_start, "txtime_clock", test->settings->txtime == NET_TXTIME_ETF ? "tai" : "monotonic");
+	}
+	if (j_test_start != NULL && test->settings->msg_zerocopy)
+	    cJSON_AddTrueToObject(j_test_start, "msg_zerocopy");
+	if (j_test_start != NULL && test->settings->splice)
+	    cJSON_AddTrueToObject(j_test_start, "splice");
+	if (j_test_start != NULL && test->settings->hugepages)
+	    cJSON_AddItemToObject(j_test_start, "hugepages", iperf_json_printf("page_size: %d  hugetlb_buffers: %d  thp_buffers: %d  plain_buffers: %d", (int64_t) IPERF_HUGE_PAGE_SIZE, (int64_t) test->buffer_pages[IPERF_PAGES_HUGETLB], (int64_t) test->buffer_pages[IPERF_PAGES_THP], (int64_t) test->buffer_pages[IPERF_PAGES_PLAIN]));
+	if (j_test_start != NULL && test->settings->rx_zerocopy)
+	    cJSON_AddItemToObject(j_test_start, "rx_zerocopy", iperf_json_printf("page_size: %d  mss: %d", (int64_t) sysconf(_SC_PAGESIZE), (int64_t) test->settings->mss));
+	cJSON_AddItemToObject(test->json_start, "test_start", j_test_start);
+	if (test->workers && test->pin_spec) {
+	    cJSON *j_cpus = cJSON_CreateArray();
+	    int i;
+	    for (i = 0; i < test->num_threads; ++i)
+		cJSON_AddItemToArray(j_cpus, cJSON_CreateNumber(test->workers[i].cpu));
+	    cJSON_AddItemToObject(test->json_start, "worker_cpus", j_cpus);
+	    if (test->pin_node >= 0)
+		cJSON_AddNumberToObject(test->json_start, "numa_node", test->pin_node);
+	}
     } else {
 	if (test->verbose) {
 	    if (test->settings->bytes)
@@ -766,6 +847,18 @@ iperf_on_test_start(struct iperf_test *test)
 		iperf_printf(test, test_start_blocks, test->protocol->name, test->num_streams, test->settings->blksize, test->omit, test->settings->blocks, test->settings->tos);
 	    else
 		iperf_printf(test, test_start_time, test->protocol->name, test->num_streams, test->settings->blksize, test->omit, test->duration, test->settings->tos);
+	    if (iperf_udp_batching(test))
+		iperf_printf(test, "      Sending and receiving %d datagrams per system call\n", test->settings->udp_batch);
+	    if (test->protocol->id == Pudp && test->settings->udp_gso > 1)
+		iperf_printf(test, "      Sending up to %d datagrams per UDP GSO send\n", test->settings->udp_gso);
+	    if (test->protocol->id == Pudp && test->settings->udp_gro)
+		iperf_printf(test, "      Receiving coalesced UDP GRO reads\n");
+	    if (test->protocol->id == Pudp && test->settings->rx_timestamps)
+		iperf_printf(test, "      Using kernel receive timestamps for jitter\n");
+	    if (test->protocol->id == Pudp && test->settings->txtime)
+		iperf_printf(test, "      Giving each datagram an SO_TXTIME departure time on %s\n", test->settings->txtime == NET_TXTIME_ETF ? "CLOCK_TAI" : "CLOCK_MONOTONIC");
+	    if (test->settings->hugepages)
+		iperf_printf(test, "      Buffers on huge pages: %d reserved, %d transparent, %d on regular pages\n", test->buffer_pages[IPERF_PAGES_HUGETLB], test->buffer_pages[IPERF_PAGES_THP], test->buffer_pages[IPERF_PAGES_PLAIN]);
 	}
     }
 }
@@ -845,6 +938,8 @@ iperf_on_connect(struct iperf_test *test)
         if (test->settings->rate)
             cJSON_AddNumberToObject(test->json_start, "target_bitrate", test->settings->rate);
         }
+	if (test->num_threads)
+	    cJSON_AddNumberToObject(test->json_start, "threads", test->num_threads);
     } else if (test->verbose) {
         iperf_printf(test, report_cookie, test->cookie);
         if (test->protocol->id == SOCK_STREAM) {
@@ -856,6 +951,8 @@ iperf_on_connect(struct iperf_test *test)
         }
         if (test->settings->rate)
             iperf_printf(test, "      Target Bitrate: %"PRIu64"\n", test->settings->rate);
+        if (test->num_threads)
+            iperf_printf(test, "      Worker threads: %d\n", test->num_threads);
     }
 }
 
@@ -930,6 +1027,24 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 	{"forceflush", no_argument, NULL, OPT_FORCEFLUSH},
 	{"get-server-output", no_argument, NULL, OPT_GET_SERVER_OUTPUT},
 	{"udp-counters-64bit", no_argument, NULL, OPT_UDP_COUNTERS_64BIT},
+	{"udp-ns-header", no_argument, NULL, OPT_UDP_NS_HEADER},
+	{"udp-batch", required_argument, NULL, OPT_UDP_BATCH},
+	{"udp-gso", required_argument, NULL, OPT_UDP_GSO},
+	{"udp-gro", no_argument, NULL, OPT_UDP_GRO},
+	{"rx-timestamps", no_argument, NULL, OPT_RX_TIMESTAMPS},
+	{"txtime", optional_argument, NULL, OPT_TXTIME},
+	{"busy-poll", required_argument, NULL, OPT_BUSY_POLL},
+	{"rr", required_argument, NULL, OPT_RR},
+	{"crr", required_argument, NULL, OPT_CRR},
+	{"msg-zerocopy", no_argument, NULL, OPT_MSG_ZEROCOPY},
+	{"rx-zerocopy", no_argument, NULL, OPT_RX_ZEROCOPY},
+	{"splice", no_argument, NULL, OPT_SPLICE},
+	{"hugepages", no_argument, NULL, OPT_HUGEPAGES},
+	{"interval-history", required_argument, NULL, OPT_INTERVAL_HISTORY},
+	{"latency-histogram", no_argument, NULL, OPT_LATENCY_HISTOGRAM},
+	{"reorder-window", required_argument, NULL, OPT_REORDER_WINDOW},
+	{"bucket-depth", required_argument, NULL, OPT_BUCKET_DEPTH},
+	{"pacing-driver", required_argument, NULL, OPT_PACING_DRIVER},
  	{"no-fq-socket-pacing", no_argument, NULL, OPT_NO_FQ_SOCKET_PACING},
 #if defined(HAVE_SSL)
     {"username", required_argument, NULL, OPT_CLIENT_USERNAME},
@@ -941,6 +1056,9 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 	{"fq-rate", required_argument, NULL, OPT_FQ_RATE},
 	{"pacing-timer", required_argument, NULL, OPT_PACING_TIMER},
 	{"connect-timeout", required_argument, NULL, OPT_CONNECT_TIMEOUT},
+	{"event-backend", required_argument, NULL, OPT_EVENT_BACKEND},
+	{"threads", required_argument, NULL, OPT_THREADS},
+	{"pin", required_argument, NULL, OPT_PIN},
         {"debug", no_argument, NULL, 'd'},
         {"help", no_argument, NULL, 'h'},
         {NULL, 0, NULL, 0}
@@ -1369,6 +1487,144 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 	    case OPT_UDP_COUNTERS_64BIT:
 		test->udp_counters_64bit = 1;
 		break;
+	    case OPT_UDP_NS_HEADER:
+		test->udp_ns_header = 1;
+		client_flag = 1;
+		break;
+	    case OPT_UDP_BATCH:
+		if (!has_mmsg()) {
+		    i_errno = IEUNIMP;
+		    return -1;
+		}
+		test->settings->udp_batch = atoi(optarg);
+		if (test->settings->udp_batch < 1 || test->settings->udp_batch > NET_MAX_BATCH) {
+		    i_errno = IEUDPBATCH;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_UDP_GSO:
+		if (!has_udp_gso()) {
+		    i_errno = IEUNIMP;
+		    return -1;
+		}
+		test->settings->udp_gso = atoi(optarg);
+		if (test->settings->udp_gso < 1 || test->settings->udp_gso > NET_MAX_GSO_SEGMENTS) {
+		    i_errno = IEUDPGSO;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_UDP_GRO:
+		if (!has_udp_gro()) {
+		    i_errno = IEUNIMP;
+		    return -1;
+		}
+		test->settings->udp_gro = 1;
+		client_flag = 1;
+		break;
+	    case OPT_RX_TIMESTAMPS:
+		if (!has_rx_timestamps()) {
+		    i_errno = IEUNIMP;
+		    return -1;
+		}
+		test->settings->rx_timestamps = 1;
+		client_flag = 1;
+		break;
+	    case OPT_TXTIME:
+		if (!has_txtime()) {
+		    i_errno = IEUNIMP;
+		    return -1;
+		}
+		if (optarg == NULL || strcmp(optarg, "fq") == 0)
+		    test->settings->txtime = NET_TXTIME_FQ;
+		else if (strcmp(optarg, "etf") == 0)
+		    test->settings->txtime = NET_TXTIME_ETF;
+		else {
+		    i_errno = IETXTIME;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_MSG_ZEROCOPY:
+		if (!has_msg_zerocopy()) {
+		    i_errno = IEUNIMP;
+		    return -1;
+		}
+		test->settings->msg_zerocopy = 1;
+		client_flag = 1;
+		break;
+	    case OPT_RX_ZEROCOPY:
+		if (!has_rx_zerocopy()) {
+		    i_errno = IEUNIMP;
+		    return -1;
+		}
+		test->settings->rx_zerocopy = 1;
+		client_flag = 1;
+		break;
+	    case OPT_SPLICE:
+		if (!has_splice()) {
+		    i_errno = IEUNIMP;
+		    return -1;
+		}
+		test->settings->splice = 1;
+		client_flag = 1;
+		break;
+	    case OPT_HUGEPAGES:
+		if (!has_hugepages()) {
+		    i_errno = IEUNIMP;
+		    return -1;
+		}
+		test->settings->hugepages = 1;
+		client_flag = 1;
+		break;
+	    case OPT_INTERVAL_HISTORY:
+		test->interval_history = atoi(optarg);
+		if (test->interval_history < 1 || test->interval_history > MAX_INTERVAL_HISTORY) {
+		    i_errno = IEINTERVALHISTORY;
+		    return -1;
+		}
+		break;
+	    case OPT_CRR:
+		test->settings->crr = 1;
+		/* FALLTHROUGH */
+	    case OPT_RR:
+		slash = strchr(optarg, '/');
+		if (slash) {
+		    *slash = '\0';
+		    ++slash;
+		}
+		test->settings->rr_request = unit_atoi(optarg);
+		test->settings->rr_response = slash ? unit_atoi(slash) : test->settings->rr_request;
+		if (test->settings->rr_request < 1 || test->settings->rr_request > MAX_RR_SIZE ||
+		    test->settings->rr_response < 1 || test->settings->rr_response > MAX_RR_SIZE) {
+		    i_errno = IERRSIZE;
+		    return -1;
+		}
+		/* Each message should leave as soon as it's written. */
+		test->no_delay = 1;
+		client_flag = 1;
+		break;
+	    case OPT_BUSY_POLL:
+		test->settings->busy_poll = unit_atoi(optarg);
+		if (test->settings->busy_poll < 1 || test->settings->busy_poll > MAX_BUSY_POLL) {
+		    i_errno = IEBUSYPOLL;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_LATENCY_HISTOGRAM:
+		test->settings->latency_histogram = 1;
+		client_flag = 1;
+		break;
+	    case OPT_REORDER_WINDOW:
+		test->settings->reorder_window = unit_atoi(optarg);
+		if (test->settings->reorder_window < IPERF_SEQWIN_MIN || test->settings->reorder_window > IPERF_SEQWIN_MAX) {
+		    i_errno = IEREORDERWINDOW;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
 	    case OPT_NO_FQ_SOCKET_PACING:
 #if defined(HAVE_SO_MAX_PACING_RATE)
 		printf("Warning:  --no-fq-socket-pacing is deprecated\n");
@@ -1413,10 +1669,84 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 		test->settings->pacing_timer = unit_atoi(optarg);
 		client_flag = 1;
 		break;
+	    case OPT_PACING_DRIVER:
+		test->settings->pacing_driver = iperf_pacing_driver_parse(optarg);
+		if (test->settings->pacing_driver < 0) {
+		    i_errno = IEPACINGDRIVER;
+		    return -1;
+		}
+		if (!iperf_pacing_driver_supported(test->settings->pacing_driver)) {
+		    i_errno = IEUNIMP;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_BUCKET_DEPTH: {
+		size_t len = strlen(optarg);
+
+		test->settings->bucket_depth = 0;
+		test->settings->bucket_depth_packets = 0;
+		if (len > 0 && (optarg[len - 1] == 'p' || optarg[len - 1] == 'P')) {
+		    optarg[len - 1] = '\0';
+		    test->settings->bucket_depth_packets = atoi(optarg);
+		    if (test->settings->bucket_depth_packets <= 0) {
+			i_errno = IEBUCKETDEPTH;
+			return -1;
+		    }
+		} else {
+		    double depth = unit_atof(optarg);
+
+		    if (depth < 1 || depth > MAX_BUCKET_DEPTH) {
+			i_errno = IEBUCKETDEPTH;
+			return -1;
+		    }
+		    test->settings->bucket_depth = (iperf_size_t) depth;
+		}
+		client_flag = 1;
+		break;
+	    }
 	    case OPT_CONNECT_TIMEOUT:
 		test->settings->connect_timeout = unit_atoi(optarg);
 		client_flag = 1;
 		break;
+	    case OPT_EVENT_BACKEND:
+		if (!iperf_event_backend_available(optarg)) {
+		    i_errno = IEEVENTBACKEND;
+		    return -1;
+		}
+		if (test->event_backend)
+		    free(test->event_backend);
+		test->event_backend = strdup(optarg);
+		break;
+	    case OPT_THREADS:
+#if defined(HAVE_PTHREAD)
+		test->num_threads = atoi(optarg);
+		if (test->num_threads < 1 || test->num_threads > MAX_THREADS) {
+		    i_errno = IENUMTHREADS;
+		    return -1;
+		}
+#else /* HAVE_PTHREAD */
+		i_errno = IEUNIMP;
+		return -1;
+#endif /* HAVE_PTHREAD */
+		break;
+	    case OPT_PIN:
+#if defined(HAVE_PTHREAD) && (defined(HAVE_SCHED_SETAFFINITY) || defined(HAVE_CPUSET_SETAFFINITY))
+		if (strcmp(optarg, "auto") != 0) {
+		    int cpus[MAX_PIN_CPUS];
+		    if (parse_cpu_list(optarg, cpus, MAX_PIN_CPUS) < 0) {
+			i_errno = IEPIN;
+			return -1;
+		    }
+		}
+		if (test->pin_spec)
+		    free(test->pin_spec);
+		test->pin_spec = strdup(optarg);
+#else /* HAVE_PTHREAD && (HAVE_SCHED_SETAFFINITY || HAVE_CPUSET_SETAFFINITY) */
+		i_errno = IEUNIMP;
+		return -1;
+#endif /* HAVE_PTHREAD && (HAVE_SCHED_SETAFFINITY || HAVE_CPUSET_SETAFFINITY) */
+		break;
 	    case 'h':
 		usage_long(stdout);
 		exit(0);
@@ -1435,6 +1765,10 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
         i_errno = IECLIENTONLY;
         return -1;
     }
+    if (test->pin_spec && test->num_threads == 0) {
+	i_errno = IEPINTHREADS;
+	return -1;
+    }
 
 #if defined(HAVE_SSL)
 
@@ -1520,6 +1854,42 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
     if (!rate_flag)
 	test->settings->rate = test->protocol->id == Pudp ? UDP_RATE : 0;
 
+    if (test->settings->rr_request &&
+	(test->protocol->id != Ptcp || test->reverse || test->bidirectional ||
+	 test->settings->rate != 0 || test->diskfile_name != NULL)) {
+	i_errno = IERRMODE;
+	return -1;
+    }
+
+    if (test->settings->msg_zerocopy &&
+	((test->protocol->id != Ptcp && test->protocol->id != Pudp) ||
+	 test->zerocopy || test->diskfile_name != NULL || test->settings->rr_request ||
+	 test->settings->udp_batch > 1 || test->settings->udp_gso > 1 || test->settings->txtime)) {
+	i_errno = IEMSGZEROCOPY;
+	return -1;
+    }
+
+    if (test->settings->rx_zerocopy) {
+	if (test->protocol->id != Ptcp || blksize % sysconf(_SC_PAGESIZE) != 0 ||
+	    test->diskfile_name != NULL || test->settings->rr_request) {
+	    i_errno = IERXZEROCOPY;
+	    return -1;
+	}
+	/*
+	 * Pages can only be mapped from segments that carry whole pages,
+	 * so unless told otherwise ask for a page of payload per segment
+	 * (plus the timestamp option).
+	 */
+	if (test->settings->mss == 0)
+	    test->settings->mss = sysconf(_SC_PAGESIZE) + RX_ZEROCOPY_TCP_OPTIONS;
+    }
+
+    if (test->settings->splice &&
+	(test->protocol->id != Ptcp || test->settings->rr_request || test->settings->rx_zerocopy)) {
+	i_errno = IESPLICE;
+	return -1;
+    }
+
     if ((test->settings->bytes != 0 || test->settings->blocks != 0) && ! duration_flag)
         test->duration = 0;
 
@@ -1594,27 +1964,63 @@ iperf_set_send_state(struct iperf_test *test, signed char state)
     return 0;
 }
 
+/*
+ * Let a rate-limited stream send while its token bucket is in credit.
+ */
 void
 iperf_check_throttle(struct iperf_stream *sp, struct iperf_time *nowP)
 {
-    struct iperf_time temp_time;
-    double seconds;
-    uint64_t bits_per_second;
-
     if (sp->test->done || sp->test->settings->rate == 0)
         return;
-    iperf_time_diff(&sp->result->start_time_fixed, nowP, &temp_time);
-    seconds = iperf_time_in_secs(&temp_time);
-    bits_per_second = sp->result->bytes_sent * 8 / seconds;
-    if (bits_per_second < sp->test->settings->rate) {
+    if (iperf_pacer_ready(&sp->pacer, nowP)) {
+	if (!sp->green_light && sp->pace_index >= 0)
+	    iperf_pacing_cancel(sp->event_loop->pacing, sp);
         sp->green_light = 1;
-        FD_SET(sp->socket, &sp->test->write_set);
+        iperf_event_add(sp->event_loop, sp->socket, IPERF_EV_WRITE, sp);
     } else {
+        if (sp->green_light) {
+	    sp->pace_due = *nowP;
+	    iperf_time_add_nsecs(&sp->pace_due, iperf_pacer_wait(&sp->pacer));
+	    /* A precise pacing driver wakes the stream when that comes */
+	    if (sp->event_loop->pacing != NULL && iperf_pacing_defer(sp->event_loop->pacing, sp) < 0)
+		return;		/* no room to wait; it'll be checked after its next send */
+	}
         sp->green_light = 0;
-        FD_CLR(sp->socket, &sp->test->write_set);
+        iperf_event_del(sp->event_loop, sp->socket, IPERF_EV_WRITE);
     }
 }
 
+/*
+ * A --msg-zerocopy sender whose ring is full: stop waiting for the
+ * socket to be writable, which it still is, and wait for completions
+ * on its error queue instead.  Returns 0, as for a send that would
+ * have blocked, so the other streams are still served.
+ */
+int
+iperf_zc_wait(struct iperf_stream *sp)
+{
+    if (iperf_event_add(sp->event_loop, sp->socket, IPERF_EV_ERROR, sp) < 0 ||
+	iperf_event_del(sp->event_loop, sp->socket, IPERF_EV_WRITE) < 0)
+	return NET_HARDERROR;
+    return 0;
+}
+
+/*
+ * Reap the completions of a stream left waiting by iperf_zc_wait(),
+ * and once a slot is free, go back to sending when writable.
+ */
+static int
+iperf_zc_resume(struct iperf_stream *sp)
+{
+    if (iperf_zc_reap(sp->zc, sp->socket) < 0)
+	return -1;
+    if (iperf_zc_full(sp->zc))
+	return 0;
+    if (sp->green_light && iperf_event_add(sp->event_loop, sp->socket, IPERF_EV_WRITE, sp) < 0)
+	return -1;
+    return iperf_event_del(sp->event_loop, sp->socket, IPERF_EV_ERROR);
+}
+
 /* Verify that average traffic is not greater than the specifid limit */
 void
 iperf_check_total_rate(struct iperf_test *test, iperf_size_t last_interval_bytes_transferred)
@@ -1654,13 +2060,49 @@ iperf_check_total_rate(struct iperf_test *test, iperf_size_t last_interval_bytes
     }
 }
 
+/*
+ * Record the gap since the stream's previous paced send, for the
+ * send gap report, and if the stream had to wait for its bucket, how
+ * long after it was back in credit this send went.
+ */
+static void
+iperf_record_send_gap(struct iperf_stream *sp, struct iperf_time *nowP)
+{
+    struct iperf_time gap;
+
+    if (sp->pacing_error != NULL && (sp->pace_due.secs != 0 || sp->pace_due.nsecs != 0)) {
+	if (iperf_time_diff(nowP, &sp->pace_due, &gap) == 0)
+	    iperf_histogram_record(sp->pacing_error, iperf_time_in_nsecs(&gap));
+	else
+	    iperf_histogram_record(sp->pacing_error, 0);
+	sp->pace_due.secs = sp->pace_due.nsecs = 0;
+    }
+    if (sp->send_gaps == NULL)
+	return;
+    if (sp->last_send.secs != 0 || sp->last_send.nsecs != 0) {
+	iperf_time_diff(nowP, &sp->last_send, &gap);
+	iperf_histogram_record(sp->send_gaps, iperf_time_in_nsecs(&gap));
+    }
+    sp->last_send = *nowP;
+}
+
+/*
+ * iperf_send_ready -- send on every sender stream that the last event
+ * loop pass reported as writable.  Only the ready-list is walked, so
+ * the cost of a pass doesn't grow with the number of idle streams.
+ * Bytes and blocks are added to the given counters, which lets each
+ * worker thread keep its own.
+ */
 int
-iperf_send(struct iperf_test *test, fd_set *write_setP)
+iperf_send_ready(struct iperf_test *test, struct iperf_event_loop *loop,
+		 iperf_size_t *bytes_sent, iperf_size_t *blocks_sent)
 {
     register int multisend, r, streams_active;
     register struct iperf_stream *sp;
+    struct iperf_event *ev;
     struct iperf_time now;
     int no_throttle_check;
+    int i;
 
     /* Can we do multisend mode? */
     if (test->settings->burst != 0)
@@ -1673,68 +2115,132 @@ iperf_send(struct iperf_test *test, fd_set *write_setP)
     /* Should bitrate throttle be checked for every send */
     no_throttle_check = test->settings->rate != 0 && test->settings->burst == 0;
 
+    for (i = 0; i < loop->nready; ++i) {
+	ev = &loop->ready[i];
+	sp = ev->data;
+	if (sp == NULL || sp->zc == NULL || !iperf_event_is_ready(loop, ev->fd, IPERF_EV_ERROR))
+	    continue;
+	iperf_event_clear_ready(loop, ev->fd, IPERF_EV_ERROR);
+	if (iperf_zc_resume(sp) < 0) {
+	    i_errno = IESTREAMWRITE;
+	    return NET_HARDERROR;
+	}
+    }
+
     for (; multisend > 0; --multisend) {
-	if (no_throttle_check)
-	    iperf_time_now(&now);
 	streams_active = 0;
-	SLIST_FOREACH(sp, &test->streams, streams) {
-	    if ((sp->green_light && sp->sender &&
-		 (write_setP == NULL || FD_ISSET(sp->socket, write_setP)))) {
+	for (i = 0; i < loop->nready; ++i) {
+	    ev = &loop->ready[i];
+	    sp = ev->data;
+	    if (sp == NULL || !iperf_event_is_ready(loop, ev->fd, IPERF_EV_WRITE))
+		continue;
+	    if (sp->green_light && (sp->sender || test->settings->rr_request)) {
+		if (test->settings->rate != 0)
+		    iperf_time_now(&now);
 		if ((r = sp->snd(sp)) < 0) {
 		    if (r == NET_SOFTERROR)
 			break;
 		    i_errno = IESTREAMWRITE;
 		    return r;
 		}
+		if (r == 0)
+		    continue;	/* nothing went: --rr awaiting a response, or a full -Z ring */
 		streams_active = 1;
-		test->bytes_sent += r;
-		++test->blocks_sent;
+		*bytes_sent += r;
+		/* A batched UDP send covers several blocks */
+		*blocks_sent += r > test->settings->blksize ? (r + test->settings->blksize - 1) / test->settings->blksize : 1;
+		if (test->settings->rate != 0) {
+		    iperf_pacer_consume(&sp->pacer, r);
+		    iperf_record_send_gap(sp, &now);
+		}
                 if (no_throttle_check)
 		    iperf_check_throttle(sp, &now);
-		if (multisend > 1 && test->settings->bytes != 0 && test->bytes_sent >= test->settings->bytes)
+		if (multisend > 1 && test->settings->bytes != 0 && *bytes_sent >= test->settings->bytes)
 		    break;
-		if (multisend > 1 && test->settings->blocks != 0 && test->blocks_sent >= test->settings->blocks)
+		if (multisend > 1 && test->settings->blocks != 0 && *blocks_sent >= test->settings->blocks)
 		    break;
 	    }
 	}
 	if (!streams_active)
 	    break;
     }
-    if (!no_throttle_check) {   /* Throttle check if was not checked for each send */
+    /* Throttle check if was not checked for each send */
+    if (!no_throttle_check && test->settings->rate != 0)
 	iperf_time_now(&now);
-	SLIST_FOREACH(sp, &test->streams, streams)
-	    if (sp->sender)
-	        iperf_check_throttle(sp, &now);
+    for (i = 0; i < loop->nready; ++i) {
+	ev = &loop->ready[i];
+	sp = ev->data;
+	if (sp == NULL || !iperf_event_is_ready(loop, ev->fd, IPERF_EV_WRITE))
+	    continue;
+	if (!no_throttle_check && sp->sender)
+	    iperf_check_throttle(sp, &now);
+	iperf_event_clear_ready(loop, ev->fd, IPERF_EV_WRITE);
     }
-    if (write_setP != NULL)
-	SLIST_FOREACH(sp, &test->streams, streams)
-	    if (FD_ISSET(sp->socket, write_setP))
-		FD_CLR(sp->socket, write_setP);
 
     return 0;
 }
 
 int
-iperf_recv(struct iperf_test *test, fd_set *read_setP)
+iperf_send(struct iperf_test *test, struct iperf_event_loop *loop)
 {
-    int r;
-    struct iperf_stream *sp;
+    return iperf_send_ready(test, loop, &test->bytes_sent, &test->blocks_sent);
+}
 
-    SLIST_FOREACH(sp, &test->streams, streams) {
-	if (FD_ISSET(sp->socket, read_setP) && !sp->sender) {
+int
+iperf_recv_ready(struct iperf_test *test, struct iperf_event_loop *loop,
+		 iperf_size_t *bytes_received, iperf_size_t *blocks_received)
+{
+    int r, i;
+    struct iperf_stream *sp;
+    struct iperf_event *ev;
+
+    for (i = 0; i < loop->nready; ++i) {
+	ev = &loop->ready[i];
+	sp = ev->data;
+	if (sp == NULL || !iperf_event_is_ready(loop, ev->fd, IPERF_EV_READ))
+	    continue;
+	if (!sp->sender || test->settings->rr_request) {
 	    if ((r = sp->rcv(sp)) < 0) {
 		i_errno = IESTREAMREAD;
 		return r;
 	    }
-	    test->bytes_received += r;
-	    ++test->blocks_received;
-	    FD_CLR(sp->socket, read_setP);
+	    *bytes_received += r;
+	    *blocks_received += r > test->settings->blksize ? (r + test->settings->blksize - 1) / test->settings->blksize : 1;
+	    iperf_event_clear_ready(loop, ev->fd, IPERF_EV_READ);
 	}
     }
 
     return 0;
 }
 
+int
+iperf_recv(struct iperf_test *test, struct iperf_event_loop *loop)
+{
+    return iperf_recv_ready(test, loop, &test->bytes_received, &test->blocks_received);
+}
+
+/*
+ * iperf_init_event_loop -- create the test's event loop on first use,
+ * otherwise drop every registration from the previous test.
+ */
+int
+iperf_init_event_loop(struct iperf_test *test)
+{
+    if (test->event_loop == NULL) {
+	test->event_loop = iperf_event_loop_new(test->event_backend);
+	if (test->event_loop == NULL) {
+	    i_errno = IEEVENTLOOP;
+	    return -1;
+	}
+	if (test->debug)
+	    printf("Using %s event backend\n", iperf_event_backend_name(test->event_loop));
+    } else if (iperf_event_loop_reset(test->event_loop) < 0) {
+	i_errno = IEEVENTLOOP;
+	return -1;
+    }
+    return 0;
+}
+
 int
 iperf_init_test(struct iperf_test *test)
 {
@@ -1755,6 +2261,10 @@ iperf_init_test(struct iperf_test *test)
 	sp->result->start_time = sp->result->start_time_fixed = now;
     }
 
+    /* Before on_test_start, which reports what pages buffers are on */
+    if (iperf_map_worker_buffers(test) < 0)
+	return -1;
+
     if (test->on_test_start)
         test->on_test_start(test);
 
@@ -1773,20 +2283,73 @@ send_timer_proc(TimerClientData client_data, struct iperf_time *nowP)
     iperf_check_throttle(sp, nowP);
 }
 
+/*
+ * Token bucket depth for -b pacing, in bytes: as given, else one burst
+ * with -b rate/burst, else two pacing timer ticks' worth so that a
+ * late tick doesn't cost any rate (but never less than one block).
+ * With the timer driver a stream only refills once a tick, so a depth
+ * given below one tick's worth would cap the rate; it's raised to that.
+ */
+static uint64_t
+iperf_bucket_depth(struct iperf_test *test)
+{
+    uint64_t depth, tick;
+    char msg[128];
+
+    tick = test->settings->rate / 8 * test->settings->pacing_timer / 1000000;
+    if (test->settings->bucket_depth_packets > 0 || test->settings->bucket_depth > 0) {
+	if (test->settings->bucket_depth_packets > 0)
+	    depth = (uint64_t) test->settings->bucket_depth_packets * test->settings->blksize;
+	else
+	    depth = test->settings->bucket_depth;
+	if (test->settings->pacing_driver == IPERF_PACING_TIMER && depth < tick) {
+	    snprintf(msg, sizeof(msg), "bucket depth of %" PRIu64 " bytes is below one pacing timer tick at this rate, using %" PRIu64, depth, tick);
+	    warning(msg);
+	    depth = tick;
+	}
+	return depth;
+    }
+    if (test->settings->burst > 0)
+	return (uint64_t) test->settings->burst * test->settings->blksize;
+    depth = 2 * tick;
+    if (depth < (uint64_t) test->settings->blksize)
+	depth = test->settings->blksize;
+    return depth;
+}
+
 int
 iperf_create_send_timers(struct iperf_test * test)
 {
     struct iperf_time now;
     struct iperf_stream *sp;
     TimerClientData cd;
+    uint64_t depth = 0;
 
     if (iperf_time_now(&now) < 0) {
 	i_errno = IEINITTEST;
 	return -1;
     }
+    if (test->settings->rate != 0)
+	depth = iperf_bucket_depth(test);
     SLIST_FOREACH(sp, &test->streams, streams) {
         sp->green_light = 1;
 	if (test->settings->rate != 0 && sp->sender) {
+	    iperf_pacer_init(&sp->pacer, test->settings->rate, depth, &now);
+	    if (sp->send_gaps == NULL) {
+		sp->send_gaps = iperf_histogram_new();
+		sp->send_gaps_omit = iperf_histogram_new();
+		sp->pacing_error = iperf_histogram_new();
+		sp->pacing_error_mark = iperf_histogram_new();
+		if (sp->send_gaps == NULL || sp->send_gaps_omit == NULL ||
+		    sp->pacing_error == NULL || sp->pacing_error_mark == NULL) {
+		    i_errno = IEINITTEST;
+		    return -1;
+		}
+	    }
+	}
+	/* Worker threads pace their own streams; the timers aren't thread-safe. */
+	if (test->settings->rate != 0 && sp->sender && test->num_threads == 0 &&
+	    test->settings->pacing_driver == IPERF_PACING_TIMER) {
 	    cd.p = sp;
 	    sp->send_timer = tmr_create(NULL, send_timer_proc, cd, test->settings->pacing_timer, 1);
 	    if (sp->send_timer == NULL) {
@@ -1795,6 +2358,13 @@ iperf_create_send_timers(struct iperf_test * test)
 	    }
 	}
     }
+    /* A precise pacing driver replaces the timers (worker threads set up their own). */
+    if (test->settings->rate != 0 && test->num_threads == 0 &&
+	test->settings->pacing_driver != IPERF_PACING_TIMER &&
+	test->pacing.driver == IPERF_PACING_TIMER) {
+	if (iperf_pacing_init(&test->pacing, test->settings->pacing_driver, test->event_loop) < 0)
+	    return -1;
+    }
     return 0;
 }
 
@@ -1883,8 +2453,10 @@ iperf_exchange_parameters(struct iperf_test *test)
             return -1;
         }
 
-        FD_SET(s, &test->read_set);
-        test->max_fd = (s > test->max_fd) ? s : test->max_fd;
+        if (iperf_event_add(test->event_loop, s, IPERF_EV_READ, NULL) < 0) {
+            i_errno = IEEVENTLOOP;
+            return -1;
+        }
         test->prot_listener = s;
 
         // Send the control message to create streams and start the test
@@ -1969,6 +2541,12 @@ send_parameters(struct iperf_test *test)
 	    cJSON_AddNumberToObject(j, "pacing_timer", test->settings->pacing_timer);
 	if (test->settings->burst)
 	    cJSON_AddNumberToObject(j, "burst", test->settings->burst);
+	if (test->settings->bucket_depth)
+	    cJSON_AddNumberToObject(j, "bucket_depth", test->settings->bucket_depth);
+	if (test->settings->bucket_depth_packets)
+	    cJSON_AddNumberToObject(j, "bucket_depth_packets", test->settings->bucket_depth_packets);
+	if (test->settings->pacing_driver != IPERF_PACING_TIMER)
+	    cJSON_AddStringToObject(j, "pacing_driver", iperf_pacing_driver_name(test->settings->pacing_driver));
 	if (test->settings->tos)
 	    cJSON_AddNumberToObject(j, "TOS", test->settings->tos);
 	if (test->settings->flowlabel)
@@ -1985,8 +2563,42 @@ send_parameters(struct iperf_test *test)
 	    cJSON_AddNumberToObject(j, "get_server_output", iperf_get_test_get_server_output(test));
 	if (test->udp_counters_64bit)
 	    cJSON_AddNumberToObject(j, "udp_counters_64bit", iperf_get_test_udp_counters_64bit(test));
+	if (test->udp_ns_header)
+	    cJSON_AddNumberToObject(j, "udp_ns_header", iperf_get_test_udp_ns_header(test));
 	if (test->repeating_payload)
 	    cJSON_AddNumberToObject(j, "repeating_payload", test->repeating_payload);
+	if (test->settings->udp_batch > 1)
+	    cJSON_AddNumberToObject(j, "udp_batch", test->settings->udp_batch);
+	if (test->settings->udp_gso > 1)
+	    cJSON_AddNumberToObject(j, "udp_gso", test->settings->udp_gso);
+	if (test->settings->udp_gro)
+	    cJSON_AddTrueToObject(j, "udp_gro");
+	if (test->settings->rx_timestamps)
+	    cJSON_AddTrueToObject(j, "rx_timestamps");
+	if (test->settings->txtime)
+	    cJSON_AddTrueToObject(j, "txtime");
+	if (test->settings->txtime == NET_TXTIME_ETF)
+	    cJSON_AddStringToObject(j, "txtime_clock", "tai");
+	if (test->settings->msg_zerocopy)
+	    cJSON_AddTrueToObject(j, "msg_zerocopy");
+	if (test->settings->rx_zerocopy)
+	    cJSON_AddTrueToObject(j, "rx_zerocopy");
+	if (test->settings->splice)
+	    cJSON_AddTrueToObject(j, "splice");
+	if (test->settings->hugepages)
+	    cJSON_AddTrueToObject(j, "hugepages");
+	if (test->settings->busy_poll)
+	    cJSON_AddNumberToObject(j, "busy_poll", test->settings->busy_poll);
+	if (test->settings->rr_request) {
+	    cJSON_AddNumberToObject(j, "rr_request", test->settings->rr_request);
+	    cJSON_AddNumberToObject(j, "rr_response", test->settings->rr_response);
+	    if (test->settings->crr)
+		cJSON_AddTrueToObject(j, "crr");
+	}
+	if (test->settings->latency_histogram)
+	    cJSON_AddTrueToObject(j, "latency_histogram");
+	if (test->settings->reorder_window)
+	    cJSON_AddNumberToObject(j, "reorder_window", test->settings->reorder_window);
 #if defined(HAVE_SSL)
 	/* Send authentication parameters */
 	if (test->settings->client_username && test->settings->client_password && test->settings->client_rsa_pubkey){
@@ -2079,6 +2691,24 @@ get_parameters(struct iperf_test *test)
 	    test->settings->pacing_timer = j_p->valueint;
 	if ((j_p = cJSON_GetObjectItem(j, "burst")) != NULL)
 	    test->settings->burst = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "bucket_depth")) != NULL) {
+	    if (j_p->valuedouble < 1 || j_p->valuedouble > MAX_BUCKET_DEPTH) {
+		i_errno = IEBUCKETDEPTH;
+		return -1;
+	    }
+	    test->settings->bucket_depth = j_p->valuedouble;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "bucket_depth_packets")) != NULL)
+	    test->settings->bucket_depth_packets = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "pacing_driver")) != NULL) {
+	    int driver = iperf_pacing_driver_parse(j_p->valuestring);
+
+	    if (driver < 0 || !iperf_pacing_driver_supported(driver)) {
+		i_errno = IEPACINGDRIVER;
+		return -1;
+	    }
+	    test->settings->pacing_driver = driver;
+	}
 	if ((j_p = cJSON_GetObjectItem(j, "TOS")) != NULL)
 	    test->settings->tos = j_p->valueint;
 	if ((j_p = cJSON_GetObjectItem(j, "flowlabel")) != NULL)
@@ -2095,38 +2725,144 @@ get_parameters(struct iperf_test *test)
 	    iperf_set_test_get_server_output(test, 1);
 	if ((j_p = cJSON_GetObjectItem(j, "udp_counters_64bit")) != NULL)
 	    iperf_set_test_udp_counters_64bit(test, 1);
+	if ((j_p = cJSON_GetObjectItem(j, "udp_ns_header")) != NULL)
+	    iperf_set_test_udp_ns_header(test, 1);
 	if ((j_p = cJSON_GetObjectItem(j, "repeating_payload")) != NULL)
 	    test->repeating_payload = 1;
-#if defined(HAVE_SSL)
-	if ((j_p = cJSON_GetObjectItem(j, "authtoken")) != NULL)
-        test->settings->authtoken = strdup(j_p->valuestring);
-#endif //HAVE_SSL
-	if (test->mode && test->protocol->id == Ptcp && has_tcpinfo_retransmits())
-	    test->sender_has_retransmits = 1;
-	if (test->settings->rate)
-	    cJSON_AddNumberToObject(test->json_start, "target_bitrate", test->settings->rate);
-	cJSON_Delete(j);
-    }
-    return r;
-}
-
-/*************************************************************/
-
-static int
-send_results(struct iperf_test *test)
-{
-    int r = 0;
-    cJSON *j;
-    cJSON *j_streams;
-    struct iperf_stream *sp;
-    cJSON *j_stream;
-    int sender_has_retransmits;
-    iperf_size_t bytes_transferred;
-    int retransmits;
-    struct iperf_time temp_time;
-    double start_time, end_time;
-
-    j = cJSON_CreateObject();
+	if ((j_p = cJSON_GetObjectItem(j, "udp_batch")) != NULL) {
+	    if (!has_mmsg() || j_p->valueint < 1 || j_p->valueint > NET_MAX_BATCH) {
+		i_errno = IEUDPBATCH;
+		return -1;
+	    }
+	    test->settings->udp_batch = j_p->valueint;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "udp_gso")) != NULL) {
+	    if (!has_udp_gso() || j_p->valueint < 1 || j_p->valueint > NET_MAX_GSO_SEGMENTS) {
+		i_errno = IEUDPGSO;
+		return -1;
+	    }
+	    test->settings->udp_gso = j_p->valueint;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "udp_gro")) != NULL) {
+	    if (!has_udp_gro()) {
+		i_errno = IEUNIMP;
+		return -1;
+	    }
+	    test->settings->udp_gro = 1;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "rx_timestamps")) != NULL) {
+	    if (!has_rx_timestamps()) {
+		i_errno = IEUNIMP;
+		return -1;
+	    }
+	    test->settings->rx_timestamps = 1;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "txtime")) != NULL) {
+	    if (!has_txtime()) {
+		i_errno = IEUNIMP;
+		return -1;
+	    }
+	    test->settings->txtime = NET_TXTIME_FQ;
+	    if ((j_p = cJSON_GetObjectItem(j, "txtime_clock")) != NULL &&
+		cJSON_IsString(j_p) && strcmp(j_p->valuestring, "tai") == 0)
+		test->settings->txtime = NET_TXTIME_ETF;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "msg_zerocopy")) != NULL) {
+	    if (!has_msg_zerocopy()) {
+		i_errno = IEUNIMP;
+		return -1;
+	    }
+	    test->settings->msg_zerocopy = 1;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "rx_zerocopy")) != NULL) {
+	    if (!has_rx_zerocopy()) {
+		i_errno = IEUNIMP;
+		return -1;
+	    }
+	    if (test->protocol->id != Ptcp || test->settings->blksize % sysconf(_SC_PAGESIZE) != 0) {
+		i_errno = IERXZEROCOPY;
+		return -1;
+	    }
+	    test->settings->rx_zerocopy = 1;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "splice")) != NULL) {
+	    if (!has_splice()) {
+		i_errno = IEUNIMP;
+		return -1;
+	    }
+	    test->settings->splice = 1;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "hugepages")) != NULL) {
+	    if (!has_hugepages()) {
+		i_errno = IEUNIMP;
+		return -1;
+	    }
+	    test->settings->hugepages = 1;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "busy_poll")) != NULL) {
+	    if (j_p->valueint < 1 || j_p->valueint > MAX_BUSY_POLL) {
+		i_errno = IEBUSYPOLL;
+		return -1;
+	    }
+	    test->settings->busy_poll = j_p->valueint;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "rr_request")) != NULL) {
+	    cJSON *j_response = cJSON_GetObjectItem(j, "rr_response");
+
+	    if (j_response == NULL ||
+		j_p->valueint < 1 || j_p->valueint > MAX_RR_SIZE ||
+		j_response->valueint < 1 || j_response->valueint > MAX_RR_SIZE) {
+		i_errno = IERRSIZE;
+		return -1;
+	    }
+	    if (test->protocol->id != Ptcp || test->mode != RECEIVER) {
+		i_errno = IERRMODE;
+		return -1;
+	    }
+	    test->settings->rr_request = j_p->valueint;
+	    test->settings->rr_response = j_response->valueint;
+	    if ((j_p = cJSON_GetObjectItem(j, "crr")) != NULL)
+		test->settings->crr = 1;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "latency_histogram")) != NULL)
+	    test->settings->latency_histogram = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "reorder_window")) != NULL) {
+	    if (j_p->valueint < IPERF_SEQWIN_MIN || j_p->valueint > IPERF_SEQWIN_MAX) {
+		i_errno = IEREORDERWINDOW;
+		return -1;
+	    }
+	    test->settings->reorder_window = j_p->valueint;
+	}
+#if defined(HAVE_SSL)
+	if ((j_p = cJSON_GetObjectItem(j, "authtoken")) != NULL)
+        test->settings->authtoken = strdup(j_p->valuestring);
+#endif //HAVE_SSL
+	if (test->mode && test->protocol->id == Ptcp && has_tcpinfo_retransmits())
+	    test->sender_has_retransmits = 1;
+	if (test->settings->rate)
+	    cJSON_AddNumberToObject(test->json_start, "target_bitrate", test->settings->rate);
+	cJSON_Delete(j);
+    }
+    return r;
+}
+
+/*************************************************************/
+
+static int
+send_results(struct iperf_test *test)
+{
+    int r = 0;
+    cJSON *j;
+    cJSON *j_streams;
+    struct iperf_stream *sp;
+    cJSON *j_stream;
+    int sender_has_retransmits;
+    iperf_size_t bytes_transferred;
+    int retransmits;
+    struct iperf_time temp_time;
+    double start_time, end_time;
+
+    j = cJSON_CreateObject();
     if (j == NULL) {
 	i_errno = IEPACKAGERESULTS;
 	r = -1;
@@ -2134,6 +2870,13 @@ send_results(struct iperf_test *test)
 	cJSON_AddNumberToObject(j, "cpu_util_total", test->cpu_util[0]);
 	cJSON_AddNumberToObject(j, "cpu_util_user", test->cpu_util[1]);
 	cJSON_AddNumberToObject(j, "cpu_util_system", test->cpu_util[2]);
+	if (test->settings->busy_poll) {
+	    uint64_t polls, empty_polls;
+
+	    iperf_busy_poll_counts(test, &polls, &empty_polls);
+	    cJSON_AddNumberToObject(j, "busy_polls", polls);
+	    cJSON_AddNumberToObject(j, "busy_empty_polls", empty_polls);
+	}
 	if ( test->mode == RECEIVER )
 	    sender_has_retransmits = -1;
 	else
@@ -2184,7 +2927,7 @@ send_results(struct iperf_test *test)
 		    r = -1;
 		} else {
 		    cJSON_AddItemToArray(j_streams, j_stream);
-		    bytes_transferred = sp->sender ? (sp->result->bytes_sent - sp->result->bytes_sent_omit) : sp->result->bytes_received;
+		    bytes_transferred = sp->sender ? (sp->result->bytes_sent - sp->result->bytes_sent_omit) : (sp->result->bytes_received - sp->result->bytes_received_omit);
 		    retransmits = (sp->sender && test->sender_has_retransmits) ? sp->result->stream_retrans : -1;
 		    cJSON_AddNumberToObject(j_stream, "id", sp->id);
 		    cJSON_AddNumberToObject(j_stream, "bytes", bytes_transferred);
@@ -2192,6 +2935,40 @@ send_results(struct iperf_test *test)
 		    cJSON_AddNumberToObject(j_stream, "jitter", sp->jitter);
 		    cJSON_AddNumberToObject(j_stream, "errors", sp->cnt_error);
 		    cJSON_AddNumberToObject(j_stream, "packets", sp->packet_count);
+		    if (sp->latency_total != NULL) {
+			/* Non-empty buckets, as [index, count] pairs */
+			cJSON *j_latency = cJSON_CreateArray();
+			cJSON *j_bucket;
+			int b;
+
+			if (j_latency != NULL) {
+			    for (b = 0; b < IPERF_HIST_BUCKETS; ++b) {
+				if (sp->latency_total->counts[b] == 0)
+				    continue;
+				j_bucket = cJSON_CreateArray();
+				if (j_bucket == NULL)
+				    break;
+				cJSON_AddItemToArray(j_bucket, cJSON_CreateNumber(b));
+				cJSON_AddItemToArray(j_bucket, cJSON_CreateNumber(sp->latency_total->counts[b]));
+				cJSON_AddItemToArray(j_latency, j_bucket);
+			    }
+			    cJSON_AddItemToObject(j_stream, "latency_histogram", j_latency);
+			}
+			cJSON_AddNumberToObject(j_stream, "latency_negative", sp->latency_total->negative);
+		    }
+		    if (sp->seqwin != NULL) {
+			cJSON *j_distance = cJSON_CreateArray();
+			int b;
+
+			cJSON_AddNumberToObject(j_stream, "outoforder", sp->outoforder_packets - sp->omitted_outoforder_packets);
+			cJSON_AddNumberToObject(j_stream, "duplicates", sp->duplicate_packets - sp->omitted_duplicate_packets);
+			cJSON_AddNumberToObject(j_stream, "late", sp->late_packets - sp->omitted_late_packets);
+			if (j_distance != NULL) {
+			    for (b = 0; b < IPERF_SEQWIN_DIST_BUCKETS; ++b)
+				cJSON_AddItemToArray(j_distance, cJSON_CreateNumber(sp->reorder_distance[b]));
+			    cJSON_AddItemToObject(j_stream, "reorder_distance", j_distance);
+			}
+		    }
 
 		    iperf_time_diff(&sp->result->start_time, &sp->result->start_time, &temp_time);
 		    start_time = iperf_time_in_secs(&temp_time);
@@ -2219,6 +2996,62 @@ send_results(struct iperf_test *test)
 
 /*************************************************************/
 
+/*
+ * Load the peer's --latency-histogram buckets for a stream we sent,
+ * so the summary can report the receiver's latency.
+ */
+static void
+get_latency_results(struct iperf_stream *sp, cJSON *j_stream)
+{
+    cJSON *j_latency, *j_bucket, *j_index, *j_count;
+    int n, i, b;
+
+    if ((j_latency = cJSON_GetObjectItem(j_stream, "latency_histogram")) == NULL)
+	return;
+    if (sp->latency_total == NULL && (sp->latency_total = iperf_histogram_new()) == NULL)
+	return;
+    iperf_histogram_reset(sp->latency_total);
+    n = cJSON_GetArraySize(j_latency);
+    for (i = 0; i < n; ++i) {
+	j_bucket = cJSON_GetArrayItem(j_latency, i);
+	j_index = cJSON_GetArrayItem(j_bucket, 0);
+	j_count = cJSON_GetArrayItem(j_bucket, 1);
+	if (j_index == NULL || j_count == NULL)
+	    continue;
+	/* Counts can pass INT_MAX, so don't go through valueint */
+	b = j_index->valueint;
+	if (b >= 0 && b < IPERF_HIST_BUCKETS && j_count->valuedouble > 0)
+	    sp->latency_total->counts[b] = (uint64_t) j_count->valuedouble;
+    }
+    if ((j_count = cJSON_GetObjectItem(j_stream, "latency_negative")) != NULL && j_count->valuedouble > 0)
+	sp->latency_total->negative = (uint64_t) j_count->valuedouble;
+}
+
+/*
+ * Load the peer's reordering, duplicate and late counts for a stream
+ * we sent.  The peer has already taken out the omitted period.
+ */
+static void
+get_seqwin_results(struct iperf_stream *sp, cJSON *j_stream)
+{
+    cJSON *j_p;
+    int n, i;
+
+    if ((j_p = cJSON_GetObjectItem(j_stream, "outoforder")) != NULL)
+	sp->outoforder_packets = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j_stream, "duplicates")) != NULL)
+	sp->duplicate_packets = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j_stream, "late")) != NULL)
+	sp->late_packets = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j_stream, "reorder_distance")) != NULL) {
+	n = cJSON_GetArraySize(j_p);
+	if (n > IPERF_SEQWIN_DIST_BUCKETS)
+	    n = IPERF_SEQWIN_DIST_BUCKETS;
+	for (i = 0; i < n; ++i)
+	    sp->reorder_distance[i] = (uint64_t) cJSON_GetArrayItem(j_p, i)->valuedouble;
+    }
+}
+
 static int
 get_results(struct iperf_test *test)
 {
@@ -2229,6 +3062,7 @@ get_results(struct iperf_test *test)
     cJSON *j_cpu_util_system;
     cJSON *j_remote_congestion_used;
     cJSON *j_sender_has_retransmits;
+    cJSON *j_p;
     int result_has_retransmits;
     cJSON *j_streams;
     int n, i;
@@ -2269,6 +3103,11 @@ get_results(struct iperf_test *test)
 	    test->remote_cpu_util[0] = j_cpu_util_total->valuedouble;
 	    test->remote_cpu_util[1] = j_cpu_util_user->valuedouble;
 	    test->remote_cpu_util[2] = j_cpu_util_system->valuedouble;
+	    test->remote_busy_polls[0] = test->remote_busy_polls[1] = 0;
+	    if ((j_p = cJSON_GetObjectItem(j, "busy_polls")) != NULL)
+		test->remote_busy_polls[0] = j_p->valuedouble;
+	    if ((j_p = cJSON_GetObjectItem(j, "busy_empty_polls")) != NULL)
+		test->remote_busy_polls[1] = j_p->valuedouble;
 	    result_has_retransmits = j_sender_has_retransmits->valueint;
 	    if ( test->mode == RECEIVER ) {
 	        test->sender_has_retransmits = result_has_retransmits;
@@ -2316,8 +3155,11 @@ get_results(struct iperf_test *test)
 				if (sp->sender) {
 				    sp->jitter = jitter;
 				    sp->cnt_error = cerror;
+				    get_latency_results(sp, j_stream);
+				    get_seqwin_results(sp, j_stream);
 				    sp->peer_packet_count = pcount;
 				    sp->result->bytes_received = bytes_transferred;
+				    sp->result->bytes_received_omit = 0;
 				    /*
 				     * We have to handle the possibilty that
 				     * start_time and end_time might not be
@@ -2456,9 +3298,17 @@ add_to_interval_list(struct iperf_stream_result * rp, struct iperf_interval_resu
 {
     struct iperf_interval_results *irp;
 
-    irp = (struct iperf_interval_results *) malloc(sizeof(struct iperf_interval_results));
+    irp = &rp->interval_results[rp->interval_results_count % rp->interval_results_size];
     memcpy(irp, new, sizeof(struct iperf_interval_results));
-    TAILQ_INSERT_TAIL(&rp->interval_results, irp, irlistentries);
+    ++rp->interval_results_count;
+}
+
+struct iperf_interval_results *
+iperf_last_interval(struct iperf_stream_result *rp)
+{
+    if (rp->interval_results_count == 0)
+	return NULL;
+    return &rp->interval_results[(rp->interval_results_count - 1) % rp->interval_results_size];
 }
 
 
@@ -2569,8 +3419,10 @@ iperf_defaults(struct iperf_test *testp)
 
     testp->omit = OMIT;
     testp->duration = DURATION;
+    testp->interval_history = DEFAULT_INTERVAL_HISTORY;
     testp->diskfile_name = (char*) 0;
     testp->affinity = -1;
+    testp->pin_node = -1;
     testp->server_affinity = -1;
     TAILQ_INIT(&testp->xbind_addrs);
 #if defined(HAVE_CPUSET_SETAFFINITY)
@@ -2703,12 +3555,21 @@ iperf_free_test(struct iperf_test *test)
     struct protocol *prot;
     struct iperf_stream *sp;
 
+    /* Stop the workers before their streams go away */
+    iperf_free_workers(test);
+
     /* Free streams */
     while (!SLIST_EMPTY(&test->streams)) {
         sp = SLIST_FIRST(&test->streams);
         SLIST_REMOVE_HEAD(&test->streams, streams);
         iperf_free_stream(sp);
     }
+    free(test->stream_table);
+    free(test->senders);
+    free(test->receivers);
+    iperf_payload_pool_free(test->payload_pool);
+    iperf_histogram_free(test->latency_interval);
+    iperf_pacing_free(&test->pacing, test->event_loop);
     if (test->server_hostname)
 	free(test->server_hostname);
     if (test->tmp_template)
@@ -2761,6 +3622,11 @@ iperf_free_test(struct iperf_test *test)
 	free(test->remote_congestion_used);
     if (test->timestamp_format)
 	free(test->timestamp_format);
+    if (test->event_backend)
+	free(test->event_backend);
+    if (test->pin_spec)
+	free(test->pin_spec);
+    iperf_event_loop_free(test->event_loop);
     if (test->omit_timer != NULL)
 	tmr_cancel(test->omit_timer);
     if (test->timer != NULL)
@@ -2835,12 +3701,21 @@ iperf_reset_test(struct iperf_test *test)
     struct iperf_stream *sp;
     int i;
 
+    /* Stop the workers before their streams go away */
+    iperf_free_workers(test);
+
     /* Free streams */
     while (!SLIST_EMPTY(&test->streams)) {
         sp = SLIST_FIRST(&test->streams);
         SLIST_REMOVE_HEAD(&test->streams, streams);
         iperf_free_stream(sp);
     }
+    iperf_clear_stream_table(test);
+    iperf_payload_pool_free(test->payload_pool);
+    test->payload_pool = NULL;
+    memset(test->buffer_pages, 0, sizeof(test->buffer_pages));
+    test->streams_set_up = 0;
+    test->stream_setup_usecs = 0;
     if (test->omit_timer != NULL) {
 	tmr_cancel(test->omit_timer);
 	test->omit_timer = NULL;
@@ -2898,16 +3773,37 @@ iperf_reset_test(struct iperf_test *test)
     test->bidirectional = 0;
     test->no_delay = 0;
 
-    FD_ZERO(&test->read_set);
-    FD_ZERO(&test->write_set);
+    if (test->event_loop)
+	iperf_event_loop_reset(test->event_loop);
     
     test->num_streams = 1;
     test->settings->socket_bufsize = 0;
     test->settings->blksize = DEFAULT_TCP_BLKSIZE;
     test->settings->rate = 0;
     test->settings->burst = 0;
+    test->settings->bucket_depth = 0;
+    test->settings->bucket_depth_packets = 0;
+    test->settings->pacing_driver = IPERF_PACING_TIMER;
+    iperf_pacing_free(&test->pacing, test->event_loop);
     test->settings->mss = 0;
     test->settings->tos = 0;
+    test->settings->udp_batch = 0;
+    test->settings->udp_gso = 0;
+    test->settings->udp_gro = 0;
+    test->settings->rx_timestamps = 0;
+    test->settings->txtime = 0;
+    test->settings->busy_poll = 0;
+    test->settings->rr_request = 0;
+    test->settings->rr_response = 0;
+    test->settings->crr = 0;
+    test->settings->msg_zerocopy = 0;
+    test->settings->rx_zerocopy = 0;
+    test->settings->splice = 0;
+    test->settings->hugepages = 0;
+    test->settings->latency_histogram = 0;
+    test->settings->reorder_window = 0;
+    iperf_histogram_free(test->latency_interval);
+    test->latency_interval = NULL;
 
 #if defined(HAVE_SSL)
     if (test->settings->authtoken) {
@@ -2931,6 +3827,7 @@ iperf_reset_test(struct iperf_test *test)
     memset(test->cookie, 0, COOKIE_SIZE);
     test->multisend = 10;	/* arbitrary */
     test->udp_counters_64bit = 0;
+    test->udp_ns_header = 0;
     if (test->title) {
 	free(test->title);
 	test->title = NULL;
@@ -2963,16 +3860,42 @@ iperf_reset_stats(struct iperf_test *test)
 
     test->bytes_sent = 0;
     test->blocks_sent = 0;
+    iperf_reset_worker_stats(test);
     iperf_time_now(&now);
     SLIST_FOREACH(sp, &test->streams, streams) {
 	sp->omitted_packet_count = sp->packet_count;
         sp->omitted_cnt_error = sp->cnt_error;
         sp->omitted_outoforder_packets = sp->outoforder_packets;
+	sp->omitted_duplicate_packets = sp->duplicate_packets;
+	sp->omitted_late_packets = sp->late_packets;
+	memset(sp->reorder_distance, 0, sizeof(sp->reorder_distance));
 	sp->jitter = 0;
 	rp = sp->result;
-        rp->bytes_sent_omit = rp->bytes_sent;
-        rp->bytes_received = 0;
-        rp->bytes_sent_this_interval = rp->bytes_received_this_interval = 0;
+        rp->bytes_sent_omit = rp->bytes_sent_interval_mark = rp->bytes_sent;
+        rp->bytes_received_omit = rp->bytes_received_interval_mark = rp->bytes_received;
+	if (sp->latency != NULL) {
+	    struct iperf_histogram omitted;
+
+	    iperf_histogram_interval(sp->latency, sp->latency_mark, &omitted);
+	    iperf_histogram_reset(sp->latency_total);
+	}
+	if (sp->rr_rtt != NULL) {
+	    struct iperf_histogram omitted;
+
+	    iperf_histogram_interval(sp->rr_rtt, sp->rr_rtt_mark, &omitted);
+	    iperf_histogram_reset(sp->rr_rtt_total);
+	}
+	if (sp->crr_connect != NULL) {
+	    struct iperf_histogram omitted;
+
+	    iperf_histogram_interval(sp->crr_connect, sp->crr_connect_mark, &omitted);
+	    iperf_histogram_reset(sp->crr_connect_total);
+	}
+	if (sp->send_gaps != NULL) {
+	    struct iperf_histogram omitted;
+
+	    iperf_histogram_interval(sp->send_gaps, sp->send_gaps_omit, &omitted);
+	}
 	if (test->sender_has_retransmits == 1) {
 	    struct iperf_interval_results ir; /* temporary results structure */
 	    save_tcpinfo(sp, &ir);
@@ -2998,16 +3921,27 @@ iperf_stats_callback(struct iperf_test *test)
     struct iperf_interval_results *irp, temp;
     struct iperf_time temp_time;
     iperf_size_t total_interval_bytes_transferred = 0;
+    iperf_size_t bytes_sent, bytes_received;
+    struct iperf_histogram latency;
+    int i;
 
     temp.omitted = test->omitting;
-    SLIST_FOREACH(sp, &test->streams, streams) {
+    if (test->latency_interval != NULL)
+	iperf_histogram_reset(test->latency_interval);
+    for (i = 0; i < test->stream_table_len; ++i) {
+	sp = test->stream_table[i];
         rp = sp->result;
-	temp.bytes_transferred = sp->sender ? rp->bytes_sent_this_interval : rp->bytes_received_this_interval;
+	/* The counters may be moving under us (--threads), read them once. */
+	bytes_sent = rp->bytes_sent - rp->bytes_sent_interval_mark;
+	bytes_received = rp->bytes_received - rp->bytes_received_interval_mark;
+	rp->bytes_sent_interval_mark += bytes_sent;
+	rp->bytes_received_interval_mark += bytes_received;
+	temp.bytes_transferred = sp->sender ? bytes_sent : bytes_received;
 
         // Total bytes transferred this interval
-	total_interval_bytes_transferred += rp->bytes_sent_this_interval + rp->bytes_received_this_interval;
+	total_interval_bytes_transferred += bytes_sent + bytes_received;
     
-	irp = TAILQ_LAST(&rp->interval_results, irlisthead);
+	irp = iperf_last_interval(rp);
         /* result->end_time contains timestamp of previous interval */
         if ( irp != NULL ) /* not the 1st interval */
             memcpy(&temp.interval_start_time, &rp->end_time, sizeof(struct iperf_time));
@@ -3061,9 +3995,35 @@ iperf_stats_callback(struct iperf_test *test)
 	    temp.jitter = sp->jitter;
 	    temp.outoforder_packets = sp->outoforder_packets;
 	    temp.cnt_error = sp->cnt_error;
+	    memset(&temp.latency, 0, sizeof(temp.latency));
+	    if (sp->latency != NULL) {
+		iperf_histogram_interval(sp->latency, sp->latency_mark, &latency);
+		iperf_histogram_add(sp->latency_total, &latency);
+		iperf_histogram_summarize(&latency, &temp.latency);
+		if (test->latency_interval == NULL)
+		    test->latency_interval = iperf_histogram_new();
+		if (test->latency_interval != NULL)
+		    iperf_histogram_add(test->latency_interval, &latency);
+	    }
+	}
+	memset(&temp.pacing_error, 0, sizeof(temp.pacing_error));
+	if (sp->pacing_error != NULL) {
+	    iperf_histogram_interval(sp->pacing_error, sp->pacing_error_mark, &latency);
+	    iperf_histogram_summarize(&latency, &temp.pacing_error);
+	}
+	memset(&temp.rr_rtt, 0, sizeof(temp.rr_rtt));
+	if (sp->rr_rtt != NULL) {
+	    iperf_histogram_interval(sp->rr_rtt, sp->rr_rtt_mark, &latency);
+	    iperf_histogram_add(sp->rr_rtt_total, &latency);
+	    iperf_histogram_summarize(&latency, &temp.rr_rtt);
+	}
+	memset(&temp.crr_connect, 0, sizeof(temp.crr_connect));
+	if (sp->crr_connect != NULL) {
+	    iperf_histogram_interval(sp->crr_connect, sp->crr_connect_mark, &latency);
+	    iperf_histogram_add(sp->crr_connect_total, &latency);
+	    iperf_histogram_summarize(&latency, &temp.crr_connect);
 	}
         add_to_interval_list(rp, &temp);
-        rp->bytes_sent_this_interval = rp->bytes_received_this_interval = 0;
     }
 
     /* Verify that total server's throughput is not above specified limit */
@@ -3105,7 +4065,7 @@ iperf_print_intermediate(struct iperf_test *test)
      */
     int interval_ok = 0;
     SLIST_FOREACH(sp, &test->streams, streams) {
-	irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
+	irp = iperf_last_interval(sp->result);
 	if (irp) {
 	    iperf_time_diff(&irp->interval_start_time, &irp->interval_end_time, &temp_time);
 	    double interval_len = iperf_time_in_secs(&temp_time);
@@ -3184,6 +4144,7 @@ iperf_print_intermediate(struct iperf_test *test)
 
         int total_packets = 0, lost_packets = 0;
         double avg_jitter = 0.0, lost_percent;
+        struct iperf_latency_summary latency;
         int stream_must_be_sender = current_mode * current_mode;
 
         /*  Print stream role just for bidirectional mode. */
@@ -3199,7 +4160,7 @@ iperf_print_intermediate(struct iperf_test *test)
             if (sp->sender == stream_must_be_sender) {
                 print_interval_results(test, sp, json_interval_streams);
                 /* sum up all streams */
-                irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
+                irp = iperf_last_interval(sp->result);
                 if (irp == NULL) {
                     iperf_err(test,
                             "iperf_print_intermediate error: interval_results is NULL");
@@ -3223,7 +4184,7 @@ iperf_print_intermediate(struct iperf_test *test)
             sp = SLIST_FIRST(&test->streams); /* reset back to 1st stream */
             /* Only do this of course if there was a first stream */
             if (sp) {
-	    irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);    /* use 1st stream for timing info */
+	    irp = iperf_last_interval(sp->result);    /* use 1st stream for timing info */
 
 	    unit_snprintf(ubuf, UNIT_LEN, (double) bytes, 'A');
 	    bandwidth = (double) bytes / (double) irp->interval_duration;
@@ -3262,10 +4223,19 @@ iperf_print_intermediate(struct iperf_test *test)
                         else {
                             lost_percent = 0.0;
                         }
-                        if (test->json_output)
-                            cJSON_AddItemToObject(json_interval, "sum", iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  omitted: %b sender: %b", (double) start_time, (double) end_time, (double) irp->interval_duration, (int64_t) bytes, bandwidth * 8, (double) avg_jitter * 1000.0, (int64_t) lost_packets, (int64_t) total_packets, (double) lost_percent, test->omitting, stream_must_be_sender));
-                        else
+                        if (test->latency_interval != NULL)
+                            iperf_histogram_summarize(test->latency_interval, &latency);
+                        if (test->json_output) {
+                            cJSON *j_sum = iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  omitted: %b sender: %b", (double) start_time, (double) end_time, (double) irp->interval_duration, (int64_t) bytes, bandwidth * 8, (double) avg_jitter * 1000.0, (int64_t) lost_packets, (int64_t) total_packets, (double) lost_percent, test->omitting, stream_must_be_sender);
+                            if (j_sum != NULL && test->latency_interval != NULL)
+                                print_latency(test, -1, mbuf, start_time, end_time, &latency, j_sum);
+                            cJSON_AddItemToObject(json_interval, "sum", j_sum);
+                        }
+                        else {
                             iperf_printf(test, report_sum_bw_udp_format, mbuf, start_time, end_time, ubuf, nbuf, avg_jitter * 1000.0, lost_packets, total_packets, lost_percent, test->omitting?report_omitted:"");
+                            if (test->latency_interval != NULL)
+                                print_latency(test, -1, mbuf, start_time, end_time, &latency, NULL);
+                        }
                     }
                 }
             }
@@ -3348,6 +4318,7 @@ iperf_print_results(struct iperf_test *test)
         int total_packets = 0, lost_packets = 0;
         int sender_packet_count = 0, receiver_packet_count = 0; /* for this stream, this interval */
         int sender_total_packets = 0, receiver_total_packets = 0; /* running total */
+        int duplicate_packets = 0, late_packets = 0;
         char ubuf[UNIT_LEN];
         char nbuf[UNIT_LEN];
         struct stat sb;
@@ -3356,6 +4327,9 @@ iperf_print_results(struct iperf_test *test)
         iperf_size_t bytes_sent, total_sent = 0;
         iperf_size_t bytes_received, total_received = 0;
         double start_time, end_time = 0.0, avg_jitter = 0.0, lost_percent = 0.0;
+        double sender_pps, receiver_pps;
+        struct iperf_histogram *latency_sum = NULL;
+        struct iperf_latency_summary latency;
         double sender_time = 0.0, receiver_time = 0.0;
     struct iperf_time temp_time;
         double bandwidth;
@@ -3421,7 +4395,7 @@ iperf_print_results(struct iperf_test *test)
                 }
 
                 bytes_sent = sp->result->bytes_sent - sp->result->bytes_sent_omit;
-                bytes_received = sp->result->bytes_received;
+                bytes_received = sp->result->bytes_received - sp->result->bytes_received_omit;
                 total_sent += bytes_sent;
                 total_received += bytes_received;
 
@@ -3448,7 +4422,15 @@ iperf_print_results(struct iperf_test *test)
                     sender_total_packets += (sender_packet_count - sp->omitted_packet_count);
                     receiver_total_packets += (receiver_packet_count - sp->omitted_packet_count);
                     lost_packets += (sp->cnt_error - sp->omitted_cnt_error);
+                    duplicate_packets += (sp->duplicate_packets - sp->omitted_duplicate_packets);
+                    late_packets += (sp->late_packets - sp->omitted_late_packets);
                     avg_jitter += sp->jitter;
+                    if (sp->latency_total != NULL) {
+                        if (latency_sum == NULL)
+                            latency_sum = iperf_histogram_new();
+                        if (latency_sum != NULL)
+                            iperf_histogram_add(latency_sum, sp->latency_total);
+                    }
                 }
 
                 unit_snprintf(ubuf, UNIT_LEN, (double) bytes_sent, 'A');
@@ -3511,7 +4493,13 @@ iperf_print_results(struct iperf_test *test)
                          * instead.
                          */
                         int packet_count = sender_packet_count ? sender_packet_count : receiver_packet_count;
-                        cJSON_AddItemToObject(json_summary_stream, "udp", iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  out_of_order: %d sender: %b", (int64_t) sp->socket, (double) start_time, (double) sender_time, (double) sender_time, (int64_t) bytes_sent, bandwidth * 8, (double) sp->jitter * 1000.0, (int64_t) (sp->cnt_error - sp->omitted_cnt_error), (int64_t) (packet_count - sp->omitted_packet_count), (double) lost_percent, (int64_t) (sp->outoforder_packets - sp->omitted_outoforder_packets), stream_must_be_sender));
+                        cJSON *j_udp = iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  out_of_order: %d sender: %b", (int64_t) sp->socket, (double) start_time, (double) sender_time, (double) sender_time, (int64_t) bytes_sent, bandwidth * 8, (double) sp->jitter * 1000.0, (int64_t) (sp->cnt_error - sp->omitted_cnt_error), (int64_t) (packet_count - sp->omitted_packet_count), (double) lost_percent, (int64_t) (sp->outoforder_packets - sp->omitted_outoforder_packets), stream_must_be_sender);
+                        if (j_udp != NULL && sp->latency_total != NULL) {
+                            iperf_histogram_summarize(sp->latency_total, &latency);
+                            print_latency(test, sp->socket, mbuf, start_time, receiver_time, &latency, j_udp);
+                        }
+                        print_reordering(test, sp, mbuf, start_time, sender_time, j_udp);
+                        cJSON_AddItemToObject(json_summary_stream, "udp", j_udp);
                     }
                     else {
                         /*
@@ -3530,9 +4518,12 @@ iperf_print_results(struct iperf_test *test)
                         }
                         if ((sp->outoforder_packets - sp->omitted_outoforder_packets) > 0)
                           iperf_printf(test, report_sum_outoforder, mbuf, start_time, sender_time, (sp->outoforder_packets - sp->omitted_outoforder_packets));
+                        print_reordering(test, sp, mbuf, start_time, sender_time, NULL);
                     }
                 }
 
+                print_send_gaps(test, sp, mbuf, start_time, sender_time, json_summary_stream);
+
                 if (sp->diskfile_fd >= 0) {
                     if (fstat(sp->diskfile_fd, &sb) == 0) {
                         /* In the odd case that it's a zero-sized file, say it was all transferred. */
@@ -3596,6 +4587,10 @@ iperf_print_results(struct iperf_test *test)
                         }
                         else {
                             iperf_printf(test, report_bw_udp_format, sp->socket, mbuf, start_time, receiver_time, ubuf, nbuf, sp->jitter * 1000.0, (sp->cnt_error - sp->omitted_cnt_error), (receiver_packet_count - sp->omitted_packet_count), lost_percent, report_receiver);
+                            if (sp->latency_total != NULL) {
+                                iperf_histogram_summarize(sp->latency_total, &latency);
+                                print_latency(test, sp->socket, mbuf, start_time, receiver_time, &latency, NULL);
+                            }
                         }
                     }
                 }
@@ -3603,6 +4598,10 @@ iperf_print_results(struct iperf_test *test)
         }
         }
 
+        /* Datagrams actually handed to / taken from the network per second */
+        sender_pps = sender_time > 0.0 ? sender_total_packets / sender_time : 0.0;
+        receiver_pps = receiver_time > 0.0 ? (receiver_total_packets - lost_packets) / receiver_time : 0.0;
+
         if (test->num_streams > 1 || test->json_output) {
             unit_snprintf(ubuf, UNIT_LEN, (double) total_sent, 'A');
             /* If no tests were run, arbitrarily set bandwidth to 0. */
@@ -3668,8 +4667,20 @@ iperf_print_results(struct iperf_test *test)
                 else {
                     lost_percent = 0.0;
                 }
-                if (test->json_output)
-                    cJSON_AddItemToObject(test->json_end, "sum", iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f sender: %b", (double) start_time, (double) receiver_time, (double) receiver_time, (int64_t) total_sent, bandwidth * 8, (double) avg_jitter * 1000.0, (int64_t) lost_packets, (int64_t) total_packets, (double) lost_percent, stream_must_be_sender));
+                if (test->json_output) {
+                    cJSON *j_sum = iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f sender: %b", (double) start_time, (double) receiver_time, (double) receiver_time, (int64_t) total_sent, bandwidth * 8, (double) avg_jitter * 1000.0, (int64_t) lost_packets, (int64_t) total_packets, (double) lost_percent, stream_must_be_sender);
+                    if (j_sum != NULL) {
+                        cJSON_AddNumberToObject(j_sum, "sender_packets_per_second", sender_pps);
+                        cJSON_AddNumberToObject(j_sum, "receiver_packets_per_second", receiver_pps);
+                        cJSON_AddNumberToObject(j_sum, "duplicates", duplicate_packets);
+                        cJSON_AddNumberToObject(j_sum, "late", late_packets);
+                        if (latency_sum != NULL) {
+                            iperf_histogram_summarize(latency_sum, &latency);
+                            print_latency(test, -1, mbuf, start_time, receiver_time, &latency, j_sum);
+                        }
+                    }
+                    cJSON_AddItemToObject(test->json_end, "sum", j_sum);
+                }
                 else {
                     /*
                      * On the client we have both sender and receiver overall summary
@@ -3692,11 +4703,17 @@ iperf_print_results(struct iperf_test *test)
                         }
                         unit_snprintf(nbuf, UNIT_LEN, bandwidth, test->settings->unit_format);
                         iperf_printf(test, report_sum_bw_udp_format, mbuf, start_time, receiver_time, ubuf, nbuf, avg_jitter * 1000.0, lost_packets, receiver_total_packets, lost_percent, "receiver");
+                        if (latency_sum != NULL) {
+                            iperf_histogram_summarize(latency_sum, &latency);
+                            print_latency(test, -1, mbuf, start_time, receiver_time, &latency, NULL);
+                        }
                     }
                 }
             }
         }
 
+        iperf_histogram_free(latency_sum);
+
         if (test->json_output && current_mode == upper_mode) {
             cJSON_AddItemToObject(test->json_end, "cpu_utilization_percent", iperf_json_printf("host_total: %f  host_user: %f  host_system: %f  remote_total: %f  remote_user: %f  remote_system: %f", (double) test->cpu_util[0], (double) test->cpu_util[1], (double) test->cpu_util[2], (double) test->remote_cpu_util[0], (double) test->remote_cpu_util[1], (double) test->remote_cpu_util[2]));
             if (test->protocol->id == Ptcp) {
@@ -3719,6 +4736,8 @@ iperf_print_results(struct iperf_test *test)
         }
         else {
             if (test->verbose) {
+                if (test->protocol->id == Pudp)
+                    iperf_printf(test, report_sum_pps, sender_pps, receiver_pps);
                 if (stream_must_be_sender) {
                     if (test->bidirectional) {
                         iperf_printf(test, report_cpu, report_local, stream_must_be_sender?report_sender:report_receiver, test->cpu_util[0], test->cpu_util[1], test->cpu_util[2], report_remote, stream_must_be_sender?report_receiver:report_sender, test->remote_cpu_util[0], test->remote_cpu_util[1], test->remote_cpu_util[2]);
@@ -3762,6 +4781,16 @@ iperf_print_results(struct iperf_test *test)
         }
     }
 
+    if (test->settings->rr_request)
+        print_rr_summary(test);
+    if (test->settings->msg_zerocopy)
+        print_msg_zerocopy(test);
+    if (test->settings->rx_zerocopy)
+        print_rx_zerocopy(test);
+    if (test->settings->busy_poll)
+        print_busy_poll(test);
+    print_stream_setup(test);
+
     /* Set real sender_has_retransmits for current side */
     if (test->mode == BIDIRECTIONAL)
         test->sender_has_retransmits = tmp_sender_has_retransmits;
@@ -3793,6 +4822,418 @@ iperf_reporter_callback(struct iperf_test *test)
 
 }
 
+/*
+ * Report what --busy-poll cost: how many non-blocking polls each side
+ * made, how many found nothing, and the CPU time each side spent per
+ * block transferred.  JSON output gets a "busy_poll" member of end,
+ * text output a line with -V.
+ */
+static void
+print_busy_poll(struct iperf_test *test)
+{
+    struct iperf_stream *sp = SLIST_FIRST(&test->streams);
+    struct iperf_time temp_time;
+    uint64_t polls, empty_polls;
+    double seconds = 0.0, blocks, cost[2], empty[2];
+
+    if (sp != NULL) {
+	iperf_time_diff(&sp->result->start_time, &sp->result->end_time, &temp_time);
+	seconds = iperf_time_in_secs(&temp_time);
+    }
+    iperf_busy_poll_counts(test, &polls, &empty_polls);
+    blocks = (double) (test->blocks_sent + test->blocks_received);
+    cost[0] = blocks > 0 ? test->cpu_util[0] / 100.0 * seconds * 1e6 / blocks : 0.0;
+    cost[1] = blocks > 0 ? test->remote_cpu_util[0] / 100.0 * seconds * 1e6 / blocks : 0.0;
+    empty[0] = polls > 0 ? 100.0 * empty_polls / polls : 0.0;
+    empty[1] = test->remote_busy_polls[0] > 0 ? 100.0 * test->remote_busy_polls[1] / test->remote_busy_polls[0] : 0.0;
+
+    if (test->json_output)
+	cJSON_AddItemToObject(test->json_end, "busy_poll", iperf_json_printf("usecs: %d  host_polls: %d  host_empty_polls: %d  host_cpu_us_per_block: %f  remote_polls: %d  remote_empty_polls: %d  remote_cpu_us_per_block: %f", (int64_t) test->settings->busy_poll, (int64_t) polls, (int64_t) empty_polls, cost[0], (int64_t) test->remote_busy_polls[0], (int64_t) test->remote_busy_polls[1], cost[1]));
+    else if (test->verbose)
+	iperf_printf(test, report_busy_poll_format, test->settings->busy_poll, report_local, (double) polls, empty[0], cost[0], report_remote, (double) test->remote_busy_polls[0], empty[1], cost[1]);
+}
+
+/*
+ * Report one --msg-zerocopy ring's whole-test counts (or the sum over
+ * streams if id < 0): as an object added to j for JSON output, else as
+ * a text line.
+ */
+static void
+print_msg_zerocopy_one(struct iperf_test *test, int id, const struct iperf_zc *zc, struct iperf_histogram *latency, cJSON *j)
+{
+    struct iperf_latency_summary ls;
+    char zbuf[UNIT_LEN], cbuf[UNIT_LEN];
+    cJSON *j_zc;
+
+    iperf_histogram_summarize(latency, &ls);
+    if (test->json_output) {
+	if (j == NULL)
+	    return;
+	j_zc = iperf_json_printf("sends: %d  bytes: %d  zerocopy_bytes: %d  copied_bytes: %d  completions: %d  ring_full: %d", (int64_t) zc->sends, (int64_t) zc->bytes, (int64_t) zc->zerocopy_bytes, (int64_t) zc->copied_bytes, (int64_t) zc->completions, (int64_t) zc->ring_full);
+	if (j_zc == NULL)
+	    return;
+	if (id >= 0)
+	    cJSON_AddNumberToObject(j_zc, "socket", id);
+	cJSON_AddItemToObject(j_zc, "completion_us", iperf_json_printf("p50: %f  p90: %f  p99: %f  p99_9: %f  max: %f", ls.p50 / 1e3, ls.p90 / 1e3, ls.p99 / 1e3, ls.p999 / 1e3, ls.max / 1e3));
+	if (id >= 0)
+	    cJSON_AddItemToArray(j, j_zc);
+	else
+	    cJSON_AddItemToObject(j, "sum", j_zc);
+	return;
+    }
+    unit_snprintf(zbuf, UNIT_LEN, (double) zc->zerocopy_bytes, 'A');
+    unit_snprintf(cbuf, UNIT_LEN, (double) zc->copied_bytes, 'A');
+    if (id < 0)
+	iperf_printf(test, report_sum_msg_zerocopy_format, (double) zc->sends, zbuf, cbuf, ls.p50 / 1e3, ls.p99 / 1e3, ls.max / 1e3, (double) zc->ring_full);
+    else
+	iperf_printf(test, report_msg_zerocopy_format, id, (double) zc->sends, zbuf, cbuf, ls.p50 / 1e3, ls.p99 / 1e3, ls.max / 1e3, (double) zc->ring_full);
+}
+
+/*
+ * Report what --msg-zerocopy saved: the bytes the kernel sent without
+ * copying them and those it copied after all (always the case over
+ * loopback), and how long sends took to complete.  Sends still in
+ * flight at the end of the test count as neither.
+ */
+static void
+print_msg_zerocopy(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_zc sum;
+    cJSON *j_zc = NULL, *j_streams = NULL;
+    int n = 0;
+
+    memset(&sum, 0, sizeof(sum));
+    if ((sum.latency = iperf_histogram_new()) == NULL)
+	return;
+    if (test->json_output) {
+	j_zc = cJSON_CreateObject();
+	j_streams = cJSON_CreateArray();
+	if (j_zc == NULL || j_streams == NULL) {
+	    cJSON_Delete(j_zc);
+	    cJSON_Delete(j_streams);
+	    iperf_histogram_free(sum.latency);
+	    return;
+	}
+	cJSON_AddItemToObject(j_zc, "streams", j_streams);
+	cJSON_AddItemToObject(test->json_end, "msg_zerocopy", j_zc);
+    }
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->zc == NULL)
+	    continue;
+	print_msg_zerocopy_one(test, sp->socket, sp->zc, sp->zc->latency, j_streams);
+	sum.sends += sp->zc->sends;
+	sum.bytes += sp->zc->bytes;
+	sum.zerocopy_bytes += sp->zc->zerocopy_bytes;
+	sum.copied_bytes += sp->zc->copied_bytes;
+	sum.completions += sp->zc->completions;
+	sum.ring_full += sp->zc->ring_full;
+	iperf_histogram_add(sum.latency, sp->zc->latency);
+	++n;
+    }
+    if (n > 1 || (n > 0 && test->json_output))
+	print_msg_zerocopy_one(test, -1, &sum, sum.latency, j_zc);
+    iperf_histogram_free(sum.latency);
+}
+
+/*
+ * Report how long creating the streams took and the most memory the
+ * process has had resident, in the JSON output or, with -V, as text.
+ */
+static void
+print_stream_setup(struct iperf_test *test)
+{
+    struct rusage ru;
+    int64_t max_rss = 0;
+    char ubuf[UNIT_LEN];
+
+    if (!test->json_output && !test->verbose)
+	return;
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+#if defined(__APPLE__) && defined(__MACH__)
+	max_rss = ru.ru_maxrss;		/* bytes */
+#else
+	max_rss = (int64_t) ru.ru_maxrss * 1024;	/* kilobytes */
+#endif
+    }
+    if (test->json_output)
+	cJSON_AddItemToObject(test->json_end, "stream_setup", iperf_json_printf("streams: %d  setup_us: %d  max_rss_bytes: %d", (int64_t) test->streams_set_up, (int64_t) test->stream_setup_usecs, max_rss));
+    else {
+	unit_snprintf(ubuf, UNIT_LEN, (double) max_rss, 'A');
+	iperf_printf(test, report_stream_setup_format, test->streams_set_up, test->stream_setup_usecs / 1000.0, ubuf);
+    }
+}
+
+/*
+ * Report how much of what --rx-zerocopy streams received was mapped
+ * rather than copied, per stream and summed; only the receiving side
+ * has these counts.
+ */
+static void
+print_rx_zerocopy(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    uint64_t mapped = 0, copied = 0;
+    cJSON *j_zc = NULL, *j_streams = NULL;
+    char mbuf[UNIT_LEN], cbuf[UNIT_LEN];
+    int n = 0;
+
+    if (test->json_output) {
+	j_zc = cJSON_CreateObject();
+	j_streams = cJSON_CreateArray();
+	if (j_zc == NULL || j_streams == NULL) {
+	    cJSON_Delete(j_zc);
+	    cJSON_Delete(j_streams);
+	    return;
+	}
+    }
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->rx_zc_map == NULL)
+	    continue;
+	mapped += sp->rx_zc_mapped;
+	copied += sp->rx_zc_copied;
+	++n;
+	if (test->json_output)
+	    cJSON_AddItemToArray(j_streams, iperf_json_printf("socket: %d  mapped_bytes: %d  copied_bytes: %d", (int64_t) sp->socket, (int64_t) sp->rx_zc_mapped, (int64_t) sp->rx_zc_copied));
+	else {
+	    unit_snprintf(mbuf, UNIT_LEN, (double) sp->rx_zc_mapped, 'A');
+	    unit_snprintf(cbuf, UNIT_LEN, (double) sp->rx_zc_copied, 'A');
+	    iperf_printf(test, report_rx_zerocopy_format, sp->socket, mbuf, cbuf,
+			 sp->rx_zc_mapped + sp->rx_zc_copied > 0 ? 100.0 * sp->rx_zc_mapped / (sp->rx_zc_mapped + sp->rx_zc_copied) : 0.0);
+	}
+    }
+    if (test->json_output) {
+	if (n == 0) {
+	    cJSON_Delete(j_zc);
+	    cJSON_Delete(j_streams);
+	    return;
+	}
+	cJSON_AddItemToObject(j_zc, "streams", j_streams);
+	cJSON_AddItemToObject(j_zc, "sum", iperf_json_printf("mapped_bytes: %d  copied_bytes: %d", (int64_t) mapped, (int64_t) copied));
+	cJSON_AddItemToObject(test->json_end, "rx_zerocopy", j_zc);
+    } else if (n > 1) {
+	unit_snprintf(mbuf, UNIT_LEN, (double) mapped, 'A');
+	unit_snprintf(cbuf, UNIT_LEN, (double) copied, 'A');
+	iperf_printf(test, report_sum_rx_zerocopy_format, mbuf, cbuf, mapped + copied > 0 ? 100.0 * mapped / (mapped + copied) : 0.0);
+    }
+}
+
+/*
+ * Report --rr transactions between st and et and their times, in
+ * microseconds: as members of j for JSON output, else as a text line
+ * for stream id (or the sum of all streams if id < 0).  With --crr,
+ * rs holds flow completion times and cs connect times.
+ */
+static void
+print_rr(struct iperf_test *test, int id, const char *mbuf, double st, double et, const struct iperf_latency_summary *rs, const struct iperf_latency_summary *cs, cJSON *j)
+{
+    double tps = et > st ? rs->count / (et - st) : 0.0;
+
+    if (test->settings->crr) {
+	if (test->json_output) {
+	    if (j != NULL) {
+		cJSON_AddNumberToObject(j, "connections", rs->count);
+		cJSON_AddNumberToObject(j, "connections_per_second", tps);
+		cJSON_AddItemToObject(j, "connect_us", iperf_json_printf("p50: %f  p90: %f  p99: %f  p99_9: %f  max: %f", cs->p50 / 1e3, cs->p90 / 1e3, cs->p99 / 1e3, cs->p999 / 1e3, cs->max / 1e3));
+		cJSON_AddItemToObject(j, "fct_us", iperf_json_printf("p50: %f  p90: %f  p99: %f  p99_9: %f  max: %f", rs->p50 / 1e3, rs->p90 / 1e3, rs->p99 / 1e3, rs->p999 / 1e3, rs->max / 1e3));
+	    }
+	}
+	else if (id < 0)
+	    iperf_printf(test, report_sum_crr_format, mbuf, st, et, tps, cs->p50 / 1e3, cs->p99 / 1e3, cs->max / 1e3, rs->p50 / 1e3, rs->p90 / 1e3, rs->p99 / 1e3, rs->max / 1e3);
+	else
+	    iperf_printf(test, report_crr_format, id, mbuf, st, et, tps, cs->p50 / 1e3, cs->p99 / 1e3, cs->max / 1e3, rs->p50 / 1e3, rs->p90 / 1e3, rs->p99 / 1e3, rs->max / 1e3);
+	return;
+    }
+
+    if (test->json_output) {
+	if (j != NULL) {
+	    cJSON_AddNumberToObject(j, "transactions", rs->count);
+	    cJSON_AddNumberToObject(j, "transactions_per_second", tps);
+	    cJSON_AddItemToObject(j, "rtt_us", iperf_json_printf("p50: %f  p90: %f  p99: %f  p99_9: %f  max: %f", rs->p50 / 1e3, rs->p90 / 1e3, rs->p99 / 1e3, rs->p999 / 1e3, rs->max / 1e3));
+	}
+    }
+    else if (id < 0)
+	iperf_printf(test, report_sum_rr_format, mbuf, st, et, tps, rs->p50 / 1e3, rs->p90 / 1e3, rs->p99 / 1e3, rs->p999 / 1e3, rs->max / 1e3);
+    else
+	iperf_printf(test, report_rr_format, id, mbuf, st, et, tps, rs->p50 / 1e3, rs->p90 / 1e3, rs->p99 / 1e3, rs->p999 / 1e3, rs->max / 1e3);
+}
+
+/*
+ * Whole-test --rr results, leaving out the omit period, per stream
+ * and summed over streams.  Only the client times transactions.
+ */
+static void
+print_rr_summary(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_histogram *sum, *connect_sum;
+    struct iperf_latency_summary rs, cs;
+    struct iperf_time temp_time;
+    cJSON *j_rr = NULL, *j_streams = NULL, *j;
+    double st = 0.0, et = 0.0;
+
+    sp = SLIST_FIRST(&test->streams);
+    if (sp == NULL || sp->rr_rtt_total == NULL)
+	return;
+    sum = iperf_histogram_new();
+    connect_sum = iperf_histogram_new();
+    if (sum == NULL || connect_sum == NULL)
+	goto done;
+    memset(&cs, 0, sizeof(cs));
+    if (test->json_output) {
+	j_rr = cJSON_CreateObject();
+	j_streams = cJSON_CreateArray();
+	if (j_rr == NULL || j_streams == NULL) {
+	    cJSON_Delete(j_rr);
+	    cJSON_Delete(j_streams);
+	    goto done;
+	}
+	cJSON_AddItemToObject(j_rr, "streams", j_streams);
+	cJSON_AddItemToObject(test->json_end, test->settings->crr ? "crr" : "rr", j_rr);
+    }
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->rr_rtt_total == NULL)
+	    continue;
+	st = test->omit;
+	iperf_time_diff(&sp->result->start_time, &sp->result->end_time, &temp_time);
+	et = iperf_time_in_secs(&temp_time);
+	iperf_histogram_add(sum, sp->rr_rtt_total);
+	iperf_histogram_summarize(sp->rr_rtt_total, &rs);
+	if (sp->crr_connect_total != NULL) {
+	    iperf_histogram_add(connect_sum, sp->crr_connect_total);
+	    iperf_histogram_summarize(sp->crr_connect_total, &cs);
+	}
+	j = NULL;
+	if (j_streams != NULL && (j = iperf_json_printf("socket: %d  start: %f  end: %f", (int64_t) sp->socket, st, et)) != NULL)
+	    cJSON_AddItemToArray(j_streams, j);
+	print_rr(test, sp->socket, "", st, et, &rs, &cs, j);
+    }
+    iperf_histogram_summarize(sum, &rs);
+    iperf_histogram_summarize(connect_sum, &cs);
+    j = NULL;
+    if (j_rr != NULL && (j = iperf_json_printf("start: %f  end: %f", st, et)) != NULL)
+	cJSON_AddItemToObject(j_rr, "sum", j);
+    if (test->num_streams > 1 || test->json_output)
+	print_rr(test, -1, "", st, et, &rs, &cs, j);
+done:
+    iperf_histogram_free(sum);
+    iperf_histogram_free(connect_sum);
+}
+
+/*
+ * Report --latency-histogram percentiles, in ms: as a "latency_ms"
+ * member of j for JSON output, else as a text line for stream id (or
+ * the sum of all streams if id < 0).
+ */
+static void
+print_latency(struct iperf_test *test, int id, const char *mbuf, double st, double et, const struct iperf_latency_summary *ls, cJSON *j)
+{
+    if (test->json_output) {
+	if (j != NULL)
+	    cJSON_AddItemToObject(j, "latency_ms", iperf_json_printf("packets: %d  p50: %f  p90: %f  p99: %f  p99_9: %f  max: %f  negative: %d", (int64_t) ls->count, ls->p50 / 1e6, ls->p90 / 1e6, ls->p99 / 1e6, ls->p999 / 1e6, ls->max / 1e6, (int64_t) ls->negative));
+	return;
+    }
+    if (id < 0)
+	iperf_printf(test, report_sum_latency_format, mbuf, st, et, ls->p50 / 1e6, ls->p90 / 1e6, ls->p99 / 1e6, ls->p999 / 1e6, ls->max / 1e6);
+    else
+	iperf_printf(test, report_latency_format, id, mbuf, st, et, ls->p50 / 1e6, ls->p90 / 1e6, ls->p99 / 1e6, ls->p999 / 1e6, ls->max / 1e6);
+    /* Datagrams "received before they were sent" mean the clocks disagree. */
+    if (ls->negative > 0) {
+	if (id < 0)
+	    iperf_printf(test, report_sum_latency_negative_format, mbuf, st, et, (unsigned long long) ls->negative);
+	else
+	    iperf_printf(test, report_latency_negative_format, id, mbuf, st, et, (unsigned long long) ls->negative);
+    }
+}
+
+/*
+ * Report how late a paced stream's sends were, in microseconds, after
+ * its token bucket came back into credit: as a "pacing_error_us"
+ * member of j for JSON output, else as a text line with -V.
+ */
+static void
+print_pacing_error(struct iperf_test *test, int id, const char *mbuf, double st, double et, const struct iperf_latency_summary *ps, cJSON *j)
+{
+    if (ps->count == 0)
+	return;
+    if (test->json_output) {
+	if (j != NULL)
+	    cJSON_AddItemToObject(j, "pacing_error_us", iperf_json_printf("waits: %d  p50: %f  p90: %f  p99: %f  max: %f", (int64_t) ps->count, ps->p50 / 1e3, ps->p90 / 1e3, ps->p99 / 1e3, ps->max / 1e3));
+    }
+    else if (test->verbose)
+	iperf_printf(test, report_pacing_error_format, id, mbuf, st, et, ps->p50 / 1e3, ps->p90 / 1e3, ps->p99 / 1e3, ps->max / 1e3);
+}
+
+/*
+ * Report the distribution of gaps between a paced stream's sends, in
+ * microseconds, leaving out the omit period: as a "send_gaps_us"
+ * member of j for JSON output, else as a text line with -V.
+ */
+static void
+print_send_gaps(struct iperf_test *test, struct iperf_stream *sp, const char *mbuf, double st, double et, cJSON *j)
+{
+    struct iperf_histogram gaps;
+    struct iperf_latency_summary gs;
+
+    if (sp->send_gaps == NULL)
+	return;
+    iperf_histogram_interval(sp->send_gaps, sp->send_gaps_omit, &gaps);
+    iperf_histogram_summarize(&gaps, &gs);
+    if (gs.count == 0)
+	return;
+    if (test->json_output) {
+	if (j != NULL)
+	    cJSON_AddItemToObject(j, "send_gaps_us", iperf_json_printf("sends: %d  p50: %f  p90: %f  p99: %f  p99_9: %f  max: %f", (int64_t) gs.count, gs.p50 / 1e3, gs.p90 / 1e3, gs.p99 / 1e3, gs.p999 / 1e3, gs.max / 1e3));
+    }
+    else if (test->verbose)
+	iperf_printf(test, report_send_gaps_format, sp->socket, mbuf, st, et, gs.p50 / 1e3, gs.p90 / 1e3, gs.p99 / 1e3, gs.p999 / 1e3, gs.max / 1e3);
+}
+
+/*
+ * Report duplicates, late datagrams and the reorder distance histogram
+ * for a UDP stream: as members of j for JSON output, else as text lines
+ * printed only when there is something to say.  Bucket i of the
+ * histogram counts distances 2^i..2^(i+1)-1.
+ */
+static void
+print_reordering(struct iperf_test *test, struct iperf_stream *sp, const char *mbuf, double st, double et, cJSON *j)
+{
+    int duplicates = sp->duplicate_packets - sp->omitted_duplicate_packets;
+    int late = sp->late_packets - sp->omitted_late_packets;
+    char dbuf[IPERF_SEQWIN_DIST_BUCKETS * 24 + 1];
+    cJSON *j_distance;
+    size_t len = 0;
+    int b, last = -1;
+
+    for (b = 0; b < IPERF_SEQWIN_DIST_BUCKETS; ++b)
+	if (sp->reorder_distance[b] != 0)
+	    last = b;
+
+    if (test->json_output) {
+	if (j == NULL)
+	    return;
+	cJSON_AddNumberToObject(j, "duplicates", duplicates);
+	cJSON_AddNumberToObject(j, "late", late);
+	j_distance = cJSON_CreateArray();
+	if (j_distance != NULL) {
+	    for (b = 0; b <= last; ++b)
+		cJSON_AddItemToArray(j_distance, cJSON_CreateNumber(sp->reorder_distance[b]));
+	    cJSON_AddItemToObject(j, "reorder_distance", j_distance);
+	}
+	return;
+    }
+
+    if (duplicates > 0 || late > 0)
+	iperf_printf(test, report_duplicates_format, sp->socket, mbuf, st, et, duplicates, late);
+    if (last >= 0) {
+	dbuf[0] = '\0';
+	for (b = 0; b <= last; ++b)
+	    if (sp->reorder_distance[b] != 0)
+		len += snprintf(dbuf + len, sizeof(dbuf) - len, " %llu:%llu", 1ULL << b, (unsigned long long) sp->reorder_distance[b]);
+	iperf_printf(test, report_reorder_distance_format, sp->socket, mbuf, dbuf);
+    }
+}
+
 /**
  * Print the interval results for one stream.
  * This function needs to know about the overall test so it can determine the
@@ -3818,7 +5259,7 @@ print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *
         zbuf[0] = '\0';
     }
 
-    irp = TAILQ_LAST(&sp->result->interval_results, irlisthead); /* get last entry in linked list */
+    irp = iperf_last_interval(sp->result); /* get last entry in linked list */
     if (irp == NULL) {
 	iperf_err(test, "print_interval_results error: interval_results is NULL");
         return;
@@ -3903,33 +5344,84 @@ print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *
 	    else {
 		lost_percent = 0.0;
 	    }
-	    if (test->json_output)
-		cJSON_AddItemToArray(json_interval_streams, iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  omitted: %b sender: %b", (int64_t) sp->socket, (double) st, (double) et, (double) irp->interval_duration, (int64_t) irp->bytes_transferred, bandwidth * 8, (double) irp->jitter * 1000.0, (int64_t) irp->interval_cnt_error, (int64_t) irp->interval_packet_count, (double) lost_percent, irp->omitted, sp->sender));
-	    else
+	    if (test->json_output) {
+		cJSON *j_stream = iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  omitted: %b sender: %b", (int64_t) sp->socket, (double) st, (double) et, (double) irp->interval_duration, (int64_t) irp->bytes_transferred, bandwidth * 8, (double) irp->jitter * 1000.0, (int64_t) irp->interval_cnt_error, (int64_t) irp->interval_packet_count, (double) lost_percent, irp->omitted, sp->sender);
+		if (j_stream != NULL && sp->latency != NULL)
+		    print_latency(test, sp->socket, mbuf, st, et, &irp->latency, j_stream);
+		cJSON_AddItemToArray(json_interval_streams, j_stream);
+	    }
+	    else {
 		iperf_printf(test, report_bw_udp_format, sp->socket, mbuf, st, et, ubuf, nbuf, irp->jitter * 1000.0, irp->interval_cnt_error, irp->interval_packet_count, lost_percent, irp->omitted?report_omitted:"");
+		if (sp->latency != NULL)
+		    print_latency(test, sp->socket, mbuf, st, et, &irp->latency, NULL);
+	    }
 	}
     }
 
+    if (sp->pacing_error != NULL)
+	print_pacing_error(test, sp->socket, mbuf, st, et, &irp->pacing_error,
+			   test->json_output ? cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1) : NULL);
+    if (sp->rr_rtt != NULL) {
+	cJSON *j_rr = NULL;
+
+	if (test->json_output && (j_rr = cJSON_CreateObject()) != NULL)
+	    cJSON_AddItemToObject(cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1), test->settings->crr ? "crr" : "rr", j_rr);
+	print_rr(test, sp->socket, mbuf, st, et, &irp->rr_rtt, &irp->crr_connect, j_rr);
+    }
+
     if (test->logfile || test->forceflush)
         iflush(test);
 }
 
+/**************************************************************************/
+/* Unmap a stream's buffer, unless it is one of the pool's. */
+static void
+iperf_release_buffer(struct iperf_stream *sp)
+{
+    if (sp->buffer_kind != IPERF_BUFFER_PRIVATE)
+	return;
+    if (sp->buffer_fd >= 0) {
+	munmap(sp->buffer, sp->settings->blksize);
+	close(sp->buffer_fd);
+    } else
+	iperf_payload_unmap(sp->buffer, sp->settings->blksize, sp->settings->hugepages);
+}
+
 /**************************************************************************/
 void
 iperf_free_stream(struct iperf_stream *sp)
 {
-    struct iperf_interval_results *irp, *nirp;
-
-    /* XXX: need to free interval list too! */
-    munmap(sp->buffer, sp->test->settings->blksize);
-    close(sp->buffer_fd);
+    iperf_release_buffer(sp);
+    if (sp->batch_buffer)
+	free(sp->batch_buffer);
+    iperf_histogram_free(sp->latency);
+    iperf_histogram_free(sp->latency_mark);
+    iperf_histogram_free(sp->latency_total);
+    iperf_seqwin_free(sp->seqwin);
+    iperf_histogram_free(sp->send_gaps);
+    iperf_histogram_free(sp->send_gaps_omit);
+    iperf_histogram_free(sp->pacing_error);
+    iperf_histogram_free(sp->pacing_error_mark);
+    iperf_histogram_free(sp->rr_rtt);
+    iperf_histogram_free(sp->rr_rtt_mark);
+    iperf_histogram_free(sp->rr_rtt_total);
+    iperf_histogram_free(sp->crr_connect);
+    iperf_histogram_free(sp->crr_connect_mark);
+    iperf_histogram_free(sp->crr_connect_total);
+    iperf_zc_free(sp->zc);
+    if (sp->rx_zc_map != NULL)
+	munmap(sp->rx_zc_map, sp->settings->blksize);
+    if (sp->crr_fd >= 0)
+	close(sp->crr_fd);
+    if (sp->splice_pipe[0] >= 0) {
+	close(sp->splice_pipe[0]);
+	close(sp->splice_pipe[1]);
+    }
+    if (sp->splice_fd >= 0 && sp->splice_fd != sp->diskfile_fd)
+	close(sp->splice_fd);
     if (sp->diskfile_fd >= 0)
 	close(sp->diskfile_fd);
-    for (irp = TAILQ_FIRST(&sp->result->interval_results); irp != NULL; irp = nirp) {
-        nirp = TAILQ_NEXT(irp, irlistentries);
-        free(irp);
-    }
-    free(sp->result);
+    free(sp->result->interval_results);
     if (sp->send_timer != NULL)
 	tmr_cancel(sp->send_timer);
     free(sp);
@@ -3940,73 +5432,68 @@ struct iperf_stream *
 iperf_new_stream(struct iperf_test *test, int s, int sender)
 {
     struct iperf_stream *sp;
+    struct iperf_time start, now, elapsed;
+    void *mem;
+    int pages = IPERF_PAGES_PLAIN;
     int ret = 0;
 
-    char template[1024];
-    if (test->tmp_template) {
-        snprintf(template, sizeof(template) / sizeof(char), "%s", test->tmp_template);
-    } else {
-        //find the system temporary dir *unix, windows, cygwin support
-        char* tempdir = getenv("TMPDIR");
-        if (tempdir == 0){
-            tempdir = getenv("TEMP");
-        }
-        if (tempdir == 0){
-            tempdir = getenv("TMP");
-        }
-        if (tempdir == 0){
-            tempdir = "/tmp";
-        }
-        snprintf(template, sizeof(template) / sizeof(char), "%s/iperf3.XXXXXX", tempdir);
-    }
-
-    sp = (struct iperf_stream *) malloc(sizeof(struct iperf_stream));
-    if (!sp) {
+    iperf_time_now(&start);
+    /*
+     * Aligned so that the hot fields at the start of the stream, and
+     * the byte counters after them, each fill one cache line.
+     */
+    if (posix_memalign(&mem, IPERF_CACHELINE, sizeof(struct iperf_stream)) != 0) {
         i_errno = IECREATESTREAM;
         return NULL;
     }
+    memset(mem, 0, sizeof(struct iperf_stream));
+    sp = (struct iperf_stream *) mem;
 
-    memset(sp, 0, sizeof(struct iperf_stream));
-
+    sp->crr_fd = -1;
+    sp->pace_index = -1;
+    sp->splice_pipe[0] = sp->splice_pipe[1] = sp->splice_fd = -1;
     sp->sender = sender;
     sp->test = test;
     sp->settings = test->settings;
-    sp->result = (struct iperf_stream_result *) malloc(sizeof(struct iperf_stream_result));
-    if (!sp->result) {
-        free(sp);
-        i_errno = IECREATESTREAM;
-        return NULL;
-    }
-
-    memset(sp->result, 0, sizeof(struct iperf_stream_result));
-    TAILQ_INIT(&sp->result->interval_results);
+    sp->result = &sp->result_data;
     
-    /* Create and randomize the buffer */
-    sp->buffer_fd = mkstemp(template);
-    if (sp->buffer_fd == -1) {
-        i_errno = IECREATESTREAM;
-        free(sp->result);
-        free(sp);
-        return NULL;
-    }
-    if (unlink(template) < 0) {
-        i_errno = IECREATESTREAM;
-        free(sp->result);
-        free(sp);
-        return NULL;
-    }
-    if (ftruncate(sp->buffer_fd, test->settings->blksize) < 0) {
+    /*
+     * Share the pool's payload or scratch block where we can; a private
+     * buffer only gets a temporary file behind it if -Z may send it.
+     */
+    if (test->payload_pool == NULL &&
+	(test->payload_pool = iperf_payload_pool_new(test)) == NULL) {
         i_errno = IECREATESTREAM;
-        free(sp->result);
         free(sp);
         return NULL;
     }
-    sp->buffer = (char *) mmap(NULL, test->settings->blksize, PROT_READ|PROT_WRITE, MAP_PRIVATE, sp->buffer_fd, 0);
-    if (sp->buffer == MAP_FAILED) {
-        i_errno = IECREATESTREAM;
-        free(sp->result);
-        free(sp);
-        return NULL;
+    sp->buffer_kind = iperf_payload_kind(test, sender);
+    sp->buffer_fd = -1;
+    if (sp->buffer_kind == IPERF_BUFFER_PAYLOAD) {
+	sp->buffer = test->payload_pool->payload;
+	sp->buffer_fd = test->payload_pool->fd;
+    } else if (sp->buffer_kind == IPERF_BUFFER_SCRATCH)
+	sp->buffer = test->payload_pool->scratch;
+    else {
+	if (test->zerocopy &&
+	    (sp->buffer_fd = iperf_payload_tempfile(test, test->settings->blksize)) < 0) {
+	    i_errno = IECREATESTREAM;
+	    free(sp);
+	    return NULL;
+	}
+	if (sp->buffer_fd >= 0)
+	    sp->buffer = (char *) mmap(NULL, test->settings->blksize, PROT_READ|PROT_WRITE, MAP_PRIVATE, sp->buffer_fd, 0);
+	else
+	    sp->buffer = iperf_payload_map(test->settings->blksize, test->settings->hugepages, &pages);
+	if (sp->buffer == MAP_FAILED || sp->buffer == NULL) {
+	    i_errno = IECREATESTREAM;
+	    if (sp->buffer_fd >= 0)
+		close(sp->buffer_fd);
+	    free(sp);
+	    return NULL;
+	}
+	sp->buffer_pages = pages;
+	++test->buffer_pages[pages];
     }
 
     /* Set socket */
@@ -4019,8 +5506,7 @@ iperf_new_stream(struct iperf_test *test, int s, int sender)
 	sp->diskfile_fd = open(test->diskfile_name, sender ? O_RDONLY : (O_WRONLY|O_CREAT|O_TRUNC), S_IRUSR|S_IWUSR);
 	if (sp->diskfile_fd == -1) {
 	    i_errno = IEFILE;
-            munmap(sp->buffer, sp->test->settings->blksize);
-            free(sp->result);
+            iperf_release_buffer(sp);
             free(sp);
 	    return NULL;
 	}
@@ -4031,20 +5517,114 @@ iperf_new_stream(struct iperf_test *test, int s, int sender)
     } else
         sp->diskfile_fd = -1;
 
+    if (test->settings->rr_request) {
+	/* Either end of an --rr stream both writes and reads. */
+	sp->snd = iperf_rr_send;
+	sp->rcv = iperf_rr_recv;
+	sp->rr_writing = sender;
+	sp->green_light = 1;
+	if (test->settings->crr) {
+	    sp->snd = iperf_crr_send;
+	    sp->rcv = iperf_crr_recv;
+	}
+    }
+
     /* Initialize stream */
-    if (test->repeating_payload)
-        fill_with_repeating_pattern(sp->buffer, test->settings->blksize);
-    else
-        ret = readentropy(sp->buffer, test->settings->blksize);
+    if (sp->buffer_kind == IPERF_BUFFER_PRIVATE) {
+	if (test->repeating_payload)
+	    fill_with_repeating_pattern(sp->buffer, test->settings->blksize);
+	else
+	    ret = readentropy(sp->buffer, test->settings->blksize);
+    }
 
     if ((ret < 0) || (iperf_init_stream(sp, test) < 0)) {
-        close(sp->buffer_fd);
-        munmap(sp->buffer, sp->test->settings->blksize);
-        free(sp->result);
+        iperf_release_buffer(sp);
         free(sp);
         return NULL;
     }
-    iperf_add_stream(test, sp);
+    sp->result->interval_results_size = test->interval_history;
+    sp->result->interval_results = calloc(sp->result->interval_results_size, sizeof(struct iperf_interval_results));
+    if (sp->result->interval_results == NULL) {
+	i_errno = IECREATESTREAM;
+	iperf_free_stream(sp);
+	return NULL;
+    }
+    if (!sender && test->protocol->id != Ptcp && test->protocol->id != Psctp) {
+	sp->seqwin = iperf_seqwin_new(test->settings->reorder_window ? test->settings->reorder_window : IPERF_SEQWIN_DEFAULT);
+	if (sp->seqwin == NULL) {
+	    i_errno = IECREATESTREAM;
+	    iperf_free_stream(sp);
+	    return NULL;
+	}
+    }
+    if (test->settings->latency_histogram && !sender &&
+	test->protocol->id != Ptcp && test->protocol->id != Psctp) {
+	sp->latency = iperf_histogram_new();
+	sp->latency_mark = iperf_histogram_new();
+	sp->latency_total = iperf_histogram_new();
+	if (sp->latency == NULL || sp->latency_mark == NULL || sp->latency_total == NULL) {
+	    i_errno = IECREATESTREAM;
+	    iperf_free_stream(sp);
+	    return NULL;
+	}
+    }
+    if (test->settings->rr_request && sender) {
+	sp->rr_rtt = iperf_histogram_new();
+	sp->rr_rtt_mark = iperf_histogram_new();
+	sp->rr_rtt_total = iperf_histogram_new();
+	if (sp->rr_rtt == NULL || sp->rr_rtt_mark == NULL || sp->rr_rtt_total == NULL) {
+	    i_errno = IECREATESTREAM;
+	    iperf_free_stream(sp);
+	    return NULL;
+	}
+    }
+    if (test->settings->msg_zerocopy && sender) {
+	sp->zc = iperf_zc_new(sp->buffer, test->settings->blksize, s);
+	if (sp->zc == NULL) {
+	    i_errno = IECREATESTREAM;
+	    iperf_free_stream(sp);
+	    return NULL;
+	}
+    }
+    if (test->settings->rx_zerocopy && !sender && test->protocol->id == Ptcp) {
+	sp->rx_zc_map = maprxzerocopy(sp->socket, test->settings->blksize);
+	if (sp->rx_zc_map == NULL) {
+	    i_errno = IESETRXZEROCOPY;
+	    iperf_free_stream(sp);
+	    return NULL;
+	}
+    }
+    if (test->settings->splice && !sender && test->protocol->id == Ptcp) {
+	/* Received data goes to the -F file, or else nowhere. */
+	if (sp->diskfile_fd >= 0)
+	    sp->splice_fd = sp->diskfile_fd;
+	else
+	    sp->splice_fd = open("/dev/null", O_WRONLY);
+	if (sp->splice_fd < 0 || splicepipe(sp->splice_pipe, test->settings->blksize) < 0) {
+	    i_errno = IESETSPLICE;
+	    iperf_free_stream(sp);
+	    return NULL;
+	}
+    }
+    if (test->settings->crr && sender) {
+	sp->crr_connect = iperf_histogram_new();
+	sp->crr_connect_mark = iperf_histogram_new();
+	sp->crr_connect_total = iperf_histogram_new();
+	if (sp->crr_connect == NULL || sp->crr_connect_mark == NULL || sp->crr_connect_total == NULL) {
+	    i_errno = IECREATESTREAM;
+	    iperf_free_stream(sp);
+	    return NULL;
+	}
+    }
+    if (iperf_add_stream(test, sp) < 0) {
+	iperf_free_stream(sp);
+	return NULL;
+    }
+
+    iperf_time_now(&now);
+    iperf_time_diff(&now, &start, &elapsed);
+    test->stream_setup_usecs += iperf_time_in_usecs(&elapsed);
+    ++test->streams_set_up;
 
     return sp;
 }
@@ -4087,29 +5667,70 @@ iperf_init_stream(struct iperf_stream *sp, struct iperf_test *test)
         }
     }
 
+    if (test->settings->msg_zerocopy && sp->sender && setzerocopy(sp->socket) < 0) {
+	i_errno = IESETZEROCOPY;
+	return -1;
+    }
+
+    /*
+     * Kernel busy polling is a bonus on top of the event loop's own
+     * spinning, and usually needs CAP_NET_ADMIN, so only warn (once).
+     */
+    if (test->settings->busy_poll &&
+	setbusypoll(sp->socket, test->settings->busy_poll) < 0 &&
+	SLIST_EMPTY(&test->streams))
+	warning("unable to set SO_BUSY_POLL on stream sockets");
+
     return 0;
 }
 
 /**************************************************************************/
-void
+int
 iperf_add_stream(struct iperf_test *test, struct iperf_stream *sp)
 {
-    int i;
-    struct iperf_stream *n, *prev;
+    struct iperf_stream **table, **senders, **receivers;
+    int size;
+
+    if (test->stream_table_len == test->stream_table_size) {
+	size = test->stream_table_size ? 2 * test->stream_table_size : 16;
+	table = realloc(test->stream_table, size * sizeof(*table));
+	if (table != NULL)
+	    test->stream_table = table;
+	senders = realloc(test->senders, size * sizeof(*senders));
+	if (senders != NULL)
+	    test->senders = senders;
+	receivers = realloc(test->receivers, size * sizeof(*receivers));
+	if (receivers != NULL)
+	    test->receivers = receivers;
+	if (table == NULL || senders == NULL || receivers == NULL) {
+	    i_errno = IECREATESTREAM;
+	    return -1;
+	}
+	test->stream_table_size = size;
+    }
 
+    /* Stream ids go 1, 3, 4, ...; keep them as they always were. */
     if (SLIST_EMPTY(&test->streams)) {
         SLIST_INSERT_HEAD(&test->streams, sp, streams);
         sp->id = 1;
     } else {
-        // for (n = test->streams, i = 2; n->next; n = n->next, ++i);
-        i = 2;
-        SLIST_FOREACH(n, &test->streams, streams) {
-            prev = n;
-            ++i;
-        }
-        SLIST_INSERT_AFTER(prev, sp, streams);
-        sp->id = i;
+        SLIST_INSERT_AFTER(test->streams_tail, sp, streams);
+        sp->id = test->stream_table_len + 2;
     }
+    test->streams_tail = sp;
+    test->stream_table[test->stream_table_len++] = sp;
+    if (sp->sender)
+	test->senders[test->num_senders++] = sp;
+    else
+	test->receivers[test->num_receivers++] = sp;
+    return 0;
+}
+
+void
+iperf_clear_stream_table(struct iperf_test *test)
+{
+    test->streams_tail = NULL;
+    test->stream_table_len = test->num_senders = test->num_receivers = 0;
 }
 
 /* This pair of routines gets inserted into the snd/rcv function pointers
@@ -4172,7 +5793,9 @@ diskfile_recv(struct iperf_stream *sp)
 
     r = sp->rcv2(sp);
     if (r > 0) {
-	(void) write(sp->diskfile_fd, sp->buffer, r);
+	/* With --splice the data is already in the file. */
+	if (sp->splice_fd < 0)
+	    (void) write(sp->diskfile_fd, sp->buffer, r);
 	(void) fsync(sp->diskfile_fd);
     }
     return r;
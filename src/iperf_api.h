@@ -44,6 +44,7 @@ struct iperf_stream_result;
 struct iperf_interval_results;
 struct iperf_stream;
 struct iperf_time;
+struct iperf_event_loop;
 
 #if !defined(__IPERF_H)
 typedef uint64_t iperf_size_t;
@@ -83,6 +84,27 @@ typedef uint64_t iperf_size_t;
 #define OPT_TIMESTAMPS 22
 #define OPT_SERVER_SKEW_THRESHOLD 23
 #define OPT_RUTP_PROXY 24
+#define OPT_EVENT_BACKEND 25
+#define OPT_THREADS 26
+#define OPT_PIN 27
+#define OPT_UDP_BATCH 28
+#define OPT_UDP_GSO 29
+#define OPT_UDP_GRO 30
+#define OPT_RX_TIMESTAMPS 31
+#define OPT_LATENCY_HISTOGRAM 32
+#define OPT_REORDER_WINDOW 33
+#define OPT_UDP_NS_HEADER 34
+#define OPT_BUCKET_DEPTH 35
+#define OPT_PACING_DRIVER 36
+#define OPT_TXTIME 37
+#define OPT_BUSY_POLL 38
+#define OPT_RR 39
+#define OPT_CRR 40
+#define OPT_MSG_ZEROCOPY 41
+#define OPT_RX_ZEROCOPY 42
+#define OPT_SPLICE 43
+#define OPT_HUGEPAGES 44
+#define OPT_INTERVAL_HISTORY 45
 
 /* states */
 #define TEST_START 1
@@ -135,12 +157,14 @@ int	iperf_get_test_zerocopy( struct iperf_test* ipt );
 int	iperf_get_test_get_server_output( struct iperf_test* ipt );
 char*	iperf_get_test_bind_address ( struct iperf_test* ipt );
 int	iperf_get_test_udp_counters_64bit( struct iperf_test* ipt );
+int	iperf_get_test_udp_ns_header( struct iperf_test* ipt );
 int	iperf_get_test_one_off( struct iperf_test* ipt );
 int iperf_get_test_tos( struct iperf_test* ipt );
 char*	iperf_get_extra_data( struct iperf_test* ipt );
 char*	iperf_get_iperf_version(void);
 int	iperf_get_test_no_delay( struct iperf_test* ipt );
 int	iperf_get_test_connect_timeout( struct iperf_test* ipt );
+int	iperf_get_test_num_threads( struct iperf_test* ipt );
 
 /* Setter routines for some fields inside iperf_test. */
 void	iperf_set_verbose( struct iperf_test* ipt, int verbose );
@@ -173,6 +197,7 @@ void	iperf_set_test_zerocopy( struct iperf_test* ipt, int zerocopy );
 void	iperf_set_test_get_server_output( struct iperf_test* ipt, int get_server_output );
 void	iperf_set_test_bind_address( struct iperf_test* ipt, const char *bind_address );
 void	iperf_set_test_udp_counters_64bit( struct iperf_test* ipt, int udp_counters_64bit );
+void	iperf_set_test_udp_ns_header( struct iperf_test* ipt, int udp_ns_header );
 void	iperf_set_test_one_off( struct iperf_test* ipt, int one_off );
 void    iperf_set_test_tos( struct iperf_test* ipt, int tos );
 void	iperf_set_test_extra_data( struct iperf_test* ipt, const char *dat );
@@ -189,6 +214,7 @@ void    iperf_set_test_server_rsa_privkey(struct iperf_test *ipt, const char *se
 #endif // HAVE_SSL
 
 void	iperf_set_test_connect_timeout(struct iperf_test *ipt, int ct);
+void	iperf_set_test_num_threads(struct iperf_test *ipt, int num_threads);
 
 /**
  * exchange_parameters - handles the param_Exchange part for client
@@ -202,6 +228,12 @@ int      iperf_exchange_parameters(struct iperf_test * test);
  */
 void      add_to_interval_list(struct iperf_stream_result * rp, struct iperf_interval_results *temp);
 
+/**
+ * iperf_last_interval -- the most recent interval, or NULL before the first
+ *
+ */
+struct iperf_interval_results *iperf_last_interval(struct iperf_stream_result *rp);
+
 /**
  * connect_msg -- displays connection message
  * denoting senfer/receiver details
@@ -249,8 +281,16 @@ struct iperf_stream *iperf_new_stream(struct iperf_test *, int, int);
 /**
  * iperf_add_stream -- add a stream to a test
  *
+ * returns 0 on success, -1 (with i_errno set) on failure
+ */
+int       iperf_add_stream(struct iperf_test * test, struct iperf_stream * stream);
+
+/**
+ * iperf_clear_stream_table -- forget the streams, once they have been
+ * removed from the list and freed
+ *
  */
-void      iperf_add_stream(struct iperf_test * test, struct iperf_stream * stream);
+void      iperf_clear_stream_table(struct iperf_test * test);
 
 /**
  * iperf_init_stream -- init resources associated with test
@@ -277,8 +317,12 @@ void build_tcpinfo_message(struct iperf_interval_results *r, char *message);
 
 int iperf_set_send_state(struct iperf_test *test, signed char state);
 void iperf_check_throttle(struct iperf_stream *sp, struct iperf_time *nowP);
-int iperf_send(struct iperf_test *, fd_set *) /* __attribute__((hot)) */;
-int iperf_recv(struct iperf_test *, fd_set *);
+int iperf_zc_wait(struct iperf_stream *sp);
+int iperf_send(struct iperf_test *, struct iperf_event_loop *) /* __attribute__((hot)) */;
+int iperf_recv(struct iperf_test *, struct iperf_event_loop *);
+int iperf_send_ready(struct iperf_test *, struct iperf_event_loop *, iperf_size_t *, iperf_size_t *);
+int iperf_recv_ready(struct iperf_test *, struct iperf_event_loop *, iperf_size_t *, iperf_size_t *);
+int iperf_init_event_loop(struct iperf_test *);
 void iperf_catch_sigend(void (*handler)(int));
 void iperf_got_sigend(struct iperf_test *test) __attribute__ ((noreturn));
 void usage(void);
@@ -367,6 +411,23 @@ enum {
     IETOTALRATE = 27,       // Total required bandwidth is larger than server's limit
     IETOTALINTERVAL = 28,   // Invalid time interval for calculating average data rate
     IESKEWTHRESHOLD = 29,   // Invalid value specified as skew threshold
+    IEEVENTBACKEND = 30,    // Unknown or unsupported event backend
+    IENUMTHREADS = 31,      // Number of worker threads too large or too small
+    IEPIN = 32,             // Bad CPU list for --pin
+    IEPINTHREADS = 33,      // --pin needs --threads
+    IEUDPBATCH = 34,        // UDP batch size out of range
+    IEUDPGSO = 35,          // UDP GSO segment count out of range
+    IEREORDERWINDOW = 36,   // Reorder window size out of range
+    IEBUCKETDEPTH = 37,     // Bad pacing bucket depth
+    IEPACINGDRIVER = 38,    // Unknown pacing driver, or unable to set it up
+    IEBUSYPOLL = 39,        // Busy-poll time out of range
+    IERRSIZE = 40,          // Bad request/response size
+    IERRMODE = 41,          // Request/response (--rr, --crr) mode needs TCP, no -R, --bidir, -b or -F
+    IEMSGZEROCOPY = 42,     // --msg-zerocopy can't be combined with other send paths
+    IERXZEROCOPY = 43,      // --rx-zerocopy needs TCP and page-multiple blocks
+    IESPLICE = 44,          // --splice needs TCP and its own receive path
+    IEINTERVALHISTORY = 45, // Interval history length out of range
+    IETXTIME = 46,          // Unknown --txtime qdisc
     /* Test errors */
     IENEWTEST = 100,        // Unable to create a new test (check perror)
     IEINITTEST = 101,       // Test initialization failed (check perror)
@@ -411,6 +472,14 @@ enum {
     IESETPACING= 140,       // Unable to set socket pacing rate
     IESETBUF2= 141,	    // Socket buffer size incorrect (written value != read value)
     IEAUTHTEST = 142,       // Test authorization failed
+    IEEVENTLOOP = 143,      // Unable to set up or register with the event loop (check perror)
+    IETHREAD = 144,         // Unable to start worker threads (check perror)
+    IESETUDPGRO = 145,      // Unable to enable UDP_GRO on a stream socket (check perror)
+    IESETRXTS = 146,        // Unable to enable kernel receive timestamps (check perror)
+    IESETTXTIME = 147,      // Unable to enable SO_TXTIME on a stream socket (check perror)
+    IESETZEROCOPY = 148,    // Unable to enable SO_ZEROCOPY on a stream socket (check perror)
+    IESETRXZEROCOPY = 149,  // Unable to map a stream socket for TCP_ZEROCOPY_RECEIVE (check perror)
+    IESETSPLICE = 150,      // Unable to set up a stream's splice pipe (check perror)
     /* Stream errors */
     IECREATESTREAM = 200,   // Unable to create a new stream (check herror/perror)
     IEINITSTREAM = 201,     // Unable to initialize stream (check herror/perror)
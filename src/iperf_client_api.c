@@ -42,6 +42,8 @@
 #include "iperf_util.h"
 #include "iperf_locale.h"
 #include "iperf_time.h"
+#include "iperf_worker.h"
+#include "iperf_crr.h"
 #include "net.h"
 #include "timer.h"
 
@@ -98,16 +100,13 @@ iperf_create_streams(struct iperf_test *test, int sender)
 	}
 #endif /* HAVE_TCP_CONGESTION */
 
-	if (sender)
-	    FD_SET(s, &test->write_set);
-	else
-	    FD_SET(s, &test->read_set);
-	if (s > test->max_fd) test->max_fd = s;
-
         sp = iperf_new_stream(test, s, sender);
         if (!sp)
             return -1;
 
+	if (iperf_register_stream(test, sp) < 0)
+	    return -1;
+
         /* Perform the new stream callback */
         if (test->on_new_stream)
             test->on_new_stream(sp);
@@ -336,8 +335,8 @@ iperf_connect(struct iperf_test *test)
     char buf[4096];
     char server_addr[INET6_ADDRSTRLEN]; 
     
-    FD_ZERO(&test->read_set);
-    FD_ZERO(&test->write_set);
+    if (iperf_init_event_loop(test) < 0)
+        return -1;
 
     make_cookie(test->cookie);
 
@@ -418,8 +417,10 @@ iperf_connect(struct iperf_test *test)
         return -1;
     }
 
-    FD_SET(test->ctrl_sck, &test->read_set);
-    if (test->ctrl_sck > test->max_fd) test->max_fd = test->ctrl_sck;
+    if (iperf_event_add(test->event_loop, test->ctrl_sck, IPERF_EV_READ, NULL) < 0) {
+        i_errno = IEEVENTLOOP;
+        return -1;
+    }
     len = sizeof(opt);
     if (getsockopt(test->ctrl_sck, IPPROTO_TCP, TCP_MAXSEG, &opt, &len) < 0) {
         test->ctrl_sck_mss = 0;
@@ -497,6 +498,8 @@ iperf_client_end(struct iperf_test *test)
 {
     struct iperf_stream *sp;
 
+    iperf_stop_workers(test);
+
     /* Close all stream sockets */
     SLIST_FOREACH(sp, &test->streams, streams) {
         close(sp->socket);
@@ -521,7 +524,7 @@ iperf_run_client(struct iperf_test * test)
 {
     int startup;
     int result = 0;
-    fd_set read_set, write_set;
+    struct iperf_event_loop *loop;
     struct iperf_time now;
     struct timeval* timeout = NULL;
     struct iperf_stream *sp;
@@ -555,23 +558,23 @@ iperf_run_client(struct iperf_test * test)
     /* Begin calculating CPU utilization */
     cpu_util(NULL);
 
+    loop = test->event_loop;
     startup = 1;
     while (test->state != IPERF_DONE) {
-	memcpy(&read_set, &test->read_set, sizeof(fd_set));
-	memcpy(&write_set, &test->write_set, sizeof(fd_set));
 	iperf_time_now(&now);
-	timeout = tmr_timeout(&now);
-	result = select(test->max_fd + 1, &read_set, &write_set, NULL, timeout);
+	timeout = iperf_workers_timeout(test, tmr_timeout(&now));
+	timeout = iperf_pacing_timeout(&test->pacing, timeout);
+	result = iperf_event_wait(loop, timeout);
 	if (result < 0 && errno != EINTR) {
   	    i_errno = IESELECT;
 	    goto cleanup_and_fail;
 	}
 	if (result > 0) {
-	    if (FD_ISSET(test->ctrl_sck, &read_set)) {
+	    if (iperf_event_is_ready(loop, test->ctrl_sck, IPERF_EV_READ)) {
  	        if (iperf_handle_message_client(test) < 0) {
 		    goto cleanup_and_fail;
 		}
-		FD_CLR(test->ctrl_sck, &read_set);
+		iperf_event_clear_ready(loop, test->ctrl_sck, IPERF_EV_READ);
 	    }
 	}
 
@@ -587,24 +590,31 @@ iperf_run_client(struct iperf_test * test)
 			setnonblocking(sp->socket, 1);
 		    }
 		}
+
+		iperf_start_busy_poll(test);
+		if (iperf_start_workers(test) < 0)
+		    goto cleanup_and_fail;
 	    }
 
 
-	    if (test->mode == BIDIRECTIONAL)
+	    if (test->mode == BIDIRECTIONAL || test->settings->rr_request)
 	    {
-                if (iperf_send(test, &write_set) < 0)
+                if (iperf_send(test, loop) < 0)
                     goto cleanup_and_fail;
-                if (iperf_recv(test, &read_set) < 0)
+                if (iperf_recv(test, loop) < 0)
                     goto cleanup_and_fail;
 	    } else if (test->mode == SENDER) {
                 // Regular mode. Client sends.
-                if (iperf_send(test, &write_set) < 0)
+                if (iperf_send(test, loop) < 0)
                     goto cleanup_and_fail;
 	    } else {
                 // Reverse mode. Client receives.
-                if (iperf_recv(test, &read_set) < 0)
+                if (iperf_recv(test, loop) < 0)
                     goto cleanup_and_fail;
 	    }
+	    iperf_pacing_run(&test->pacing, loop);
+	    if (iperf_check_workers(test) < 0)
+		goto cleanup_and_fail;
 
 
             /* Run the timers. */
@@ -626,10 +636,13 @@ iperf_run_client(struct iperf_test * test)
 	         (test->settings->blocks != 0 && (test->blocks_sent >= test->settings->blocks ||
 						  test->blocks_received >= test->settings->blocks)))) {
 
+		iperf_stop_workers(test);
+
 		// Unset non-blocking for non-UDP tests
 		if (test->protocol->id != Pudp && test->protocol->id != Prutp) {
 		    SLIST_FOREACH(sp, &test->streams, streams) {
 			setnonblocking(sp->socket, 0);
+			iperf_crr_close(sp);
 		    }
 		}
 
@@ -647,7 +660,7 @@ iperf_run_client(struct iperf_test * test)
 	// and gets blocked, so it can't receive state changes
 	// from the client side.
 	else if (test->mode == RECEIVER && test->state == TEST_END) {
-	    if (iperf_recv(test, &read_set) < 0)
+	    if (iperf_recv(test, loop) < 0)
 		goto cleanup_and_fail;
 	}
     }
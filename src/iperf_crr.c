@@ -0,0 +1,505 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_crr.h"
+#include "iperf_event.h"
+#include "iperf_histogram.h"
+#include "net.h"
+
+/* Most connections taken off the listen queue in one event loop pass. */
+#define CRR_ACCEPT_BATCH 64
+
+/* Each connection opens with the test's cookie and its stream's id. */
+#define CRR_HELLO_SIZE (COOKIE_SIZE + 4)
+
+/* A connection being served. */
+struct iperf_crr_conn
+{
+    int       fd;
+    int       done;		/* bytes of the request read, or of the response written */
+    int       writing;		/* the whole request is in, answering it */
+    struct iperf_stream *sp;	/* stream its bytes are counted against, NULL until the hello is in */
+    int       hello_done;	/* bytes of the hello read */
+    char      hello[CRR_HELLO_SIZE];
+};
+
+struct iperf_crr_server
+{
+    struct iperf_crr_conn *conns;
+    int       nconns;
+    int       size;
+    char     *buffer;		/* blksize bytes to read into, then blksize of response */
+};
+
+/* Record the time since sp->rr_start, while the test is running. */
+static void
+crr_record(struct iperf_stream *sp, struct iperf_histogram *h)
+{
+    struct iperf_time now, elapsed;
+
+    if (h == NULL || sp->test->state != TEST_RUNNING)
+	return;
+    iperf_time_now(&now);
+    iperf_time_diff(&now, &sp->rr_start, &elapsed);
+    iperf_histogram_record(h, iperf_time_in_nsecs(&elapsed));
+}
+
+/*
+ * Start the stream's next connection.  The server's address, and
+ * with -B the local one, are those of the stream socket.
+ */
+static int
+crr_connect(struct iperf_stream *sp)
+{
+    struct iperf_test *test = sp->test;
+    int s, saved_errno, flag = 1;
+
+    if (sp->crr_peer_len == 0) {
+	sp->crr_peer_len = sizeof(sp->crr_peer);
+	if (getpeername(sp->socket, (struct sockaddr *) &sp->crr_peer, &sp->crr_peer_len) < 0) {
+	    sp->crr_peer_len = 0;
+	    return -1;
+	}
+	if (test->bind_address != NULL) {
+	    sp->crr_local_len = sizeof(sp->crr_local);
+	    if (getsockname(sp->socket, (struct sockaddr *) &sp->crr_local, &sp->crr_local_len) < 0)
+		return -1;
+	    if (sp->crr_local.ss_family == AF_INET6)
+		((struct sockaddr_in6 *) &sp->crr_local)->sin6_port = 0;
+	    else
+		((struct sockaddr_in *) &sp->crr_local)->sin_port = 0;
+	}
+    }
+
+    if ((s = socket(sp->crr_peer.ss_family, SOCK_STREAM, 0)) < 0)
+	return -1;
+    if ((sp->crr_local_len != 0 && bind(s, (struct sockaddr *) &sp->crr_local, sp->crr_local_len) < 0) ||
+	(test->no_delay && setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) < 0) ||
+	setnonblocking(s, 1) < 0)
+	goto fail;
+    iperf_time_now(&sp->rr_start);
+    if (connect(s, (struct sockaddr *) &sp->crr_peer, sp->crr_peer_len) < 0 && errno != EINPROGRESS)
+	goto fail;
+
+    sp->crr_fd = s;
+    sp->crr_state = CRR_CONNECTING;
+    sp->rr_done = 0;
+    if (iperf_event_add(sp->event_loop, s, IPERF_EV_WRITE, sp) < 0) {
+	iperf_crr_close(sp);
+	return -1;
+    }
+    return 0;
+
+fail:
+    saved_errno = errno;
+    close(s);
+    errno = saved_errno;
+    return -1;
+}
+
+void
+iperf_crr_close(struct iperf_stream *sp)
+{
+    if (sp->crr_fd < 0)
+	return;
+    iperf_event_del(sp->event_loop, sp->crr_fd, IPERF_EV_READ | IPERF_EV_WRITE);
+    close(sp->crr_fd);
+    sp->crr_fd = -1;
+}
+
+int
+iperf_crr_send(struct iperf_stream *sp)
+{
+    int size = sp->settings->rr_request;
+    int n, r, err;
+    socklen_t len;
+
+    if (!sp->sender)
+	return 0;
+
+    if (sp->crr_fd < 0) {
+	/* The stream socket only gets the first connection going. */
+	if (iperf_event_del(sp->event_loop, sp->socket, IPERF_EV_WRITE) < 0 || crr_connect(sp) < 0)
+	    return NET_HARDERROR;
+	return 0;
+    }
+
+    if (sp->crr_state == CRR_CONNECTING) {
+	len = sizeof(err);
+	if (getsockopt(sp->crr_fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+	    return NET_HARDERROR;
+	if (err != 0) {
+	    errno = err;
+	    return NET_HARDERROR;
+	}
+	crr_record(sp, sp->crr_connect);
+	sp->crr_state = CRR_HELLO;
+	sp->rr_done = 0;
+    }
+
+    if (sp->crr_state == CRR_HELLO) {
+	/* The hello goes out in front of the request, in the same segment. */
+	char hello[CRR_HELLO_SIZE];
+	uint32_t id = htonl(sp->id);
+	struct iovec iov[2];
+
+	memcpy(hello, sp->test->cookie, COOKIE_SIZE);
+	memcpy(hello + COOKIE_SIZE, &id, sizeof(id));
+	iov[0].iov_base = hello + sp->rr_done;
+	iov[0].iov_len = CRR_HELLO_SIZE - sp->rr_done;
+	iov[1].iov_base = sp->buffer;
+	iov[1].iov_len = size < sp->settings->blksize ? size : sp->settings->blksize;
+	r = writev(sp->crr_fd, iov, 2);
+	if (r < 0)
+	    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : NET_HARDERROR;
+	if ((size_t) r < iov[0].iov_len) {
+	    sp->rr_done += r;
+	    return 0;
+	}
+	r -= iov[0].iov_len;
+	sp->rr_done = 0;
+	sp->crr_state = CRR_WRITING;
+    } else if (sp->crr_state == CRR_WRITING) {
+	n = size - sp->rr_done;
+	if (n > sp->settings->blksize)
+	    n = sp->settings->blksize;
+	r = Nwrite(sp->crr_fd, sp->buffer, n, Ptcp);
+	if (r < 0)
+	    return r;
+    } else
+	return 0;
+
+    sp->rr_done += r;
+    if (sp->test->state == TEST_RUNNING)
+	sp->result->bytes_sent += r;
+
+    if (sp->rr_done == size) {
+	sp->rr_done = 0;
+	sp->crr_state = CRR_READING;
+	if (iperf_event_add(sp->event_loop, sp->crr_fd, IPERF_EV_READ, sp) < 0 ||
+	    iperf_event_del(sp->event_loop, sp->crr_fd, IPERF_EV_WRITE) < 0)
+	    return NET_HARDERROR;
+    }
+    return r;
+}
+
+int
+iperf_crr_recv(struct iperf_stream *sp)
+{
+    int size = sp->settings->rr_response;
+    int n, r, total = 0;
+
+    /* Nothing is sent on the server's stream sockets; just notice them close. */
+    if (!sp->sender)
+	return Nread(sp->socket, sp->buffer, sp->settings->blksize, Ptcp);
+
+    if (sp->crr_fd < 0 || sp->crr_state != CRR_READING)
+	return 0;
+
+    /*
+     * Read the response, and then the end of the stream: the server
+     * closes first, so the connection's TIME_WAIT is left there.
+     */
+    for (;;) {
+	n = size - sp->rr_done;
+	if (n > sp->settings->blksize)
+	    n = sp->settings->blksize;
+	r = read(sp->crr_fd, sp->buffer, n > 0 ? n : 1);
+	if (r < 0) {
+	    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		return total;
+	    return NET_HARDERROR;
+	}
+	if (r == 0)
+	    break;
+	if (n == 0) {
+	    /* More than a response's worth */
+	    errno = EPROTO;
+	    return NET_HARDERROR;
+	}
+	sp->rr_done += r;
+	total += r;
+	if (sp->test->state == TEST_RUNNING)
+	    sp->result->bytes_received += r;
+	if (sp->rr_done == size)
+	    crr_record(sp, sp->rr_rtt);
+	else
+	    return total;
+    }
+
+    if (sp->rr_done < size) {
+	errno = ECONNRESET;
+	return NET_HARDERROR;
+    }
+    iperf_crr_close(sp);
+    if (sp->test->state == TEST_RUNNING && crr_connect(sp) < 0)
+	return NET_HARDERROR;
+    return total;
+}
+
+int
+iperf_crr_server_start(struct iperf_test *test)
+{
+    struct iperf_crr_server *cs;
+    struct iperf_stream *sp;
+    int blksize = test->settings->blksize;
+
+    cs = (struct iperf_crr_server *) calloc(1, sizeof(*cs));
+    if (cs == NULL || (cs->buffer = malloc(2 * blksize)) == NULL) {
+	free(cs);
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    /* Answer with the same kind of payload the streams would send. */
+    if ((sp = SLIST_FIRST(&test->streams)) != NULL)
+	memcpy(cs->buffer + blksize, sp->buffer, blksize);
+    else
+	memset(cs->buffer + blksize, 0, blksize);
+
+    if (setnonblocking(test->listener, 1) < 0) {
+	free(cs->buffer);
+	free(cs);
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    test->crr_server = cs;
+    return 0;
+}
+
+/*
+ * Take what is waiting off the listener.  Trouble with one connection
+ * only costs that connection; running out of descriptors or memory
+ * leaves the rest queued for a later pass.  Only a broken listener
+ * fails the test.
+ */
+int
+iperf_crr_accept(struct iperf_test *test, struct iperf_event_loop *loop)
+{
+    struct iperf_crr_server *cs = test->crr_server;
+    struct iperf_crr_conn *conns, *conn;
+    int i, s, size, flag = 1;
+
+    for (i = 0; i < CRR_ACCEPT_BATCH; ++i) {
+	if ((s = accept(test->listener, NULL, NULL)) < 0) {
+	    switch (errno) {
+	    case EAGAIN:
+#if (EAGAIN != EWOULDBLOCK)
+	    case EWOULDBLOCK:
+#endif
+	    case EINTR:
+	    case EMFILE:
+	    case ENFILE:
+	    case ENOBUFS:
+	    case ENOMEM:
+		return 0;
+	    case ECONNABORTED:
+	    case EPROTO:
+	    case EPERM:
+		continue;
+	    default:
+		i_errno = IEACCEPT;
+		return -1;
+	    }
+	}
+	if (cs->nconns == cs->size) {
+	    size = cs->size ? 2 * cs->size : 16;
+	    conns = (struct iperf_crr_conn *) realloc(cs->conns, size * sizeof(*conns));
+	    if (conns == NULL) {
+		close(s);
+		return 0;
+	    }
+	    cs->conns = conns;
+	    cs->size = size;
+	}
+	/* TCP_NODELAY fails on a connection the client has already reset. */
+	if (setnonblocking(s, 1) < 0 ||
+	    (test->no_delay && setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) < 0) ||
+	    iperf_event_add(loop, s, IPERF_EV_READ, NULL) < 0) {
+	    close(s);
+	    continue;
+	}
+	conn = &cs->conns[cs->nconns++];
+	conn->fd = s;
+	conn->done = 0;
+	conn->writing = 0;
+	conn->sp = NULL;
+	conn->hello_done = 0;
+    }
+    return 0;
+}
+
+/* The server's --crr stream with the given id, or NULL. */
+static struct iperf_stream *
+crr_stream(struct iperf_test *test, uint32_t id)
+{
+    struct iperf_stream *sp;
+    uint32_t i = id == 1 ? 0 : id - 2;	/* see iperf_add_stream() */
+
+    if (id == 0 || i >= (uint32_t) test->stream_table_len)
+	return NULL;
+    sp = test->stream_table[i];
+    return sp->id == (int) id && !sp->sender ? sp : NULL;
+}
+
+/*
+ * Read a connection's hello.  Something that doesn't start with the
+ * test's cookie, such as another client's control connection, is told
+ * the server is busy, just as iperf_accept() would.  Returns 0 while
+ * the hello is incomplete or once it checks out, nonzero to drop the
+ * connection.
+ */
+static int
+crr_hello(struct iperf_test *test, struct iperf_crr_conn *conn)
+{
+    signed char rbuf = ACCESS_DENIED;
+    uint32_t id;
+    int want, r;
+
+    want = (conn->hello_done < COOKIE_SIZE ? COOKIE_SIZE : CRR_HELLO_SIZE) - conn->hello_done;
+    r = read(conn->fd, conn->hello + conn->hello_done, want);
+    if (r < 0)
+	return errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+    if (r == 0)
+	return 1;
+    conn->hello_done += r;
+    if (conn->hello_done == COOKIE_SIZE && memcmp(conn->hello, test->cookie, COOKIE_SIZE) != 0) {
+	(void) write(conn->fd, &rbuf, sizeof(rbuf));
+	return 1;
+    }
+    if (conn->hello_done < CRR_HELLO_SIZE)
+	return 0;
+    memcpy(&id, conn->hello + COOKIE_SIZE, sizeof(id));
+    conn->sp = crr_stream(test, ntohl(id));
+    return conn->sp == NULL;
+}
+
+/* Move a connection along; nonzero once it is finished with. */
+static int
+crr_serve_conn(struct iperf_test *test, struct iperf_event_loop *loop, struct iperf_crr_conn *conn, char *buffer)
+{
+    int blksize = test->settings->blksize;
+    int n, r;
+
+    if (!conn->writing) {
+	if (!iperf_event_is_ready(loop, conn->fd, IPERF_EV_READ))
+	    return 0;
+	if (conn->sp == NULL) {
+	    if (crr_hello(test, conn))
+		return 1;
+	    if (conn->sp == NULL)
+		return 0;	/* more of the hello to come */
+	}
+	n = test->settings->rr_request - conn->done;
+	if (n > blksize)
+	    n = blksize;
+	r = read(conn->fd, buffer, n);
+	if (r < 0)
+	    return errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+	if (r == 0)
+	    return 1;		/* the client gave up on it */
+	conn->done += r;
+	if (test->state == TEST_RUNNING)
+	    conn->sp->result->bytes_received += r;
+	if (conn->done < test->settings->rr_request)
+	    return 0;
+	conn->done = 0;
+	conn->writing = 1;
+    } else if (!iperf_event_is_ready(loop, conn->fd, IPERF_EV_WRITE))
+	return 0;
+
+    while (conn->done < test->settings->rr_response) {
+	n = test->settings->rr_response - conn->done;
+	if (n > blksize)
+	    n = blksize;
+	r = write(conn->fd, buffer + blksize, n);
+	if (r < 0) {
+	    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		return 1;
+	    /* Wait for room in the send buffer. */
+	    if (iperf_event_add(loop, conn->fd, IPERF_EV_WRITE, NULL) < 0 ||
+		iperf_event_del(loop, conn->fd, IPERF_EV_READ) < 0)
+		return 1;
+	    return 0;
+	}
+	conn->done += r;
+	if (test->state == TEST_RUNNING)
+	    conn->sp->result->bytes_sent += r;
+    }
+    return 1;
+}
+
+static void
+crr_drop(struct iperf_event_loop *loop, struct iperf_crr_server *cs, int i)
+{
+    iperf_event_del(loop, cs->conns[i].fd, IPERF_EV_READ | IPERF_EV_WRITE);
+    close(cs->conns[i].fd);
+    cs->conns[i] = cs->conns[--cs->nconns];
+}
+
+void
+iperf_crr_serve(struct iperf_test *test, struct iperf_event_loop *loop)
+{
+    struct iperf_crr_server *cs = test->crr_server;
+    int i;
+
+    for (i = 0; i < cs->nconns; ) {
+	if (crr_serve_conn(test, loop, &cs->conns[i], cs->buffer))
+	    crr_drop(loop, cs, i);
+	else
+	    ++i;
+    }
+}
+
+void
+iperf_crr_server_free(struct iperf_test *test)
+{
+    struct iperf_crr_server *cs = test->crr_server;
+
+    if (cs == NULL)
+	return;
+    while (cs->nconns > 0)
+	crr_drop(test->event_loop, cs, cs->nconns - 1);
+    if (test->listener > 0)
+	setnonblocking(test->listener, 0);
+    free(cs->conns);
+    free(cs->buffer);
+    free(cs);
+    test->crr_server = NULL;
+}
@@ -0,0 +1,74 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_CRR_H
+#define __IPERF_CRR_H
+
+struct iperf_test;
+struct iperf_stream;
+struct iperf_event_loop;
+
+/*
+ * TCP connect/request/response (--crr) streams.  Each client stream
+ * keeps one short-lived connection in flight at a time: it connects
+ * to the server's listening port, writes a request of rr_request
+ * bytes, reads a response of rr_response bytes and, once the server
+ * has closed its end, closes the connection and starts the next.  The
+ * stream socket set up with the test only carries the peer address.
+ *
+ * Each connection opens with a hello: the test's cookie, then the
+ * stream's id as four bytes in network order, sent in front of the
+ * request.  On the server the connections are taken straight off the
+ * listener, without the per-test handshake, and served from the main
+ * event loop; their bytes are counted against the stream named in the
+ * hello.  A connection whose hello doesn't carry the cookie is told
+ * the server is busy and closed, like any other during a test.
+ */
+
+/* sp->crr_state */
+#define CRR_CONNECTING	0
+#define CRR_HELLO	1
+#define CRR_WRITING	2
+#define CRR_READING	3
+
+/* Stream snd/rcv routines; both return bytes moved or a NET_ error. */
+int iperf_crr_send(struct iperf_stream *sp);
+int iperf_crr_recv(struct iperf_stream *sp);
+
+/* Close the stream's connection in flight, if any. */
+void iperf_crr_close(struct iperf_stream *sp);
+
+/*
+ * Server side: start taking connections off test->listener, accept
+ * what is waiting when it is readable, serve those that loop reports
+ * ready, and close them all at the end of the test.
+ */
+int iperf_crr_server_start(struct iperf_test *test);
+int iperf_crr_accept(struct iperf_test *test, struct iperf_event_loop *loop);
+void iperf_crr_serve(struct iperf_test *test, struct iperf_event_loop *loop);
+void iperf_crr_server_free(struct iperf_test *test);
+
+#endif /* __IPERF_CRR_H */
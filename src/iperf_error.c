@@ -30,8 +30,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <unistd.h>
 #include "iperf.h"
 #include "iperf_api.h"
+#include "net.h"
 
 int gerror;
 
@@ -427,6 +429,89 @@ iperf_strerror(int int_errno)
     case IESKEWTHRESHOLD:
 	    snprintf(errstr, len, "skew threshold must be a positive number");
             break;
+	case IEEVENTBACKEND:
+	    snprintf(errstr, len, "unknown or unsupported event backend");
+	    break;
+	case IENUMTHREADS:
+	    snprintf(errstr, len, "number of worker threads must be between 1 and %d", MAX_THREADS);
+	    break;
+	case IEPIN:
+	    snprintf(errstr, len, "bad CPU list for --pin (use \"auto\" or a list such as 0,2,4-7)");
+	    break;
+	case IEPINTHREADS:
+	    snprintf(errstr, len, "--pin requires --threads");
+	    break;
+	case IEUDPBATCH:
+	    snprintf(errstr, len, "UDP batch size must be between 1 and %d", NET_MAX_BATCH);
+	    break;
+	case IEUDPGSO:
+	    snprintf(errstr, len, "UDP GSO segment count must be between 1 and %d", NET_MAX_GSO_SEGMENTS);
+	    break;
+	case IERRSIZE:
+	    snprintf(errstr, len, "request and response sizes must be between 1 and %d bytes", MAX_RR_SIZE);
+	    break;
+	case IERRMODE:
+	    snprintf(errstr, len, "request/response mode (--rr, --crr) needs TCP and can't be combined with -R, --bidir, -b or -F");
+	    break;
+	case IEMSGZEROCOPY:
+	    snprintf(errstr, len, "--msg-zerocopy needs TCP or UDP and can't be combined with -Z, -F, --rr, --crr, --udp-batch, --udp-gso or --txtime");
+	    break;
+	case IERXZEROCOPY:
+	    snprintf(errstr, len, "--rx-zerocopy needs TCP and a block size (-l) that is a multiple of the page size (%ld), and can't be combined with -F, --rr or --crr", sysconf(_SC_PAGESIZE));
+	    break;
+	case IESPLICE:
+	    snprintf(errstr, len, "--splice needs TCP, and can't be combined with --rr, --crr or --rx-zerocopy");
+	    break;
+	case IETXTIME:
+	    snprintf(errstr, len, "--txtime takes fq (CLOCK_MONOTONIC departure times, the default) or etf (CLOCK_TAI)");
+	    break;
+	case IEINTERVALHISTORY:
+	    snprintf(errstr, len, "interval history must be between 1 and %d intervals", MAX_INTERVAL_HISTORY);
+	    break;
+	case IEBUSYPOLL:
+	    snprintf(errstr, len, "busy-poll time must be between 1 and %d microseconds", MAX_BUSY_POLL);
+	    break;
+	case IEPACINGDRIVER:
+	    snprintf(errstr, len, "unknown pacing driver, or unable to set it up (use timer, timerfd or spin)");
+	    break;
+	case IEBUCKETDEPTH:
+	    snprintf(errstr, len, "pacing bucket depth must be a positive number of bytes, or of blocks with a \"p\" suffix");
+	    break;
+	case IEREORDERWINDOW:
+	    snprintf(errstr, len, "reorder window must be between %d and %d datagrams", IPERF_SEQWIN_MIN, IPERF_SEQWIN_MAX);
+	    break;
+	case IEEVENTLOOP:
+	    snprintf(errstr, len, "unable to set up event loop");
+	    perr = 1;
+	    break;
+	case IETHREAD:
+	    snprintf(errstr, len, "unable to start worker threads");
+	    perr = 1;
+	    break;
+	case IESETUDPGRO:
+	    snprintf(errstr, len, "unable to enable UDP receive offload (UDP_GRO)");
+	    perr = 1;
+	    break;
+	case IESETRXTS:
+	    snprintf(errstr, len, "unable to enable kernel receive timestamps (SO_TIMESTAMPNS)");
+	    perr = 1;
+	    break;
+	case IESETTXTIME:
+	    snprintf(errstr, len, "unable to enable departure times (SO_TXTIME)");
+	    perr = 1;
+	    break;
+	case IESETZEROCOPY:
+	    snprintf(errstr, len, "unable to enable MSG_ZEROCOPY sends (SO_ZEROCOPY)");
+	    perr = 1;
+	    break;
+	case IESETRXZEROCOPY:
+	    snprintf(errstr, len, "unable to map a stream socket for zerocopy receives (TCP_ZEROCOPY_RECEIVE)");
+	    perr = 1;
+	    break;
+	case IESETSPLICE:
+	    snprintf(errstr, len, "unable to set up a pipe to splice received data through");
+	    perr = 1;
+	    break;
 	default:
 	    snprintf(errstr, len, "int_errno=%d", int_errno);
 	    perr = 1;
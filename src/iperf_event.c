@@ -0,0 +1,517 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+
+/*
+ * Event notification for the client and server main loops.
+ *
+ * The loops used to copy a pair of master fd_sets, call select() and
+ * then walk every stream testing FD_ISSET, which both capped us at
+ * FD_SETSIZE descriptors and made every iteration cost O(streams).
+ * The event loop instead hands back a list of the descriptors that
+ * are actually ready, each tagged with the pointer (normally the
+ * iperf_stream) it was registered with.  select() is kept as the
+ * portable fallback; on Linux epoll is used by default.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+#include "iperf_config.h"
+#include "iperf_event.h"
+#include "iperf_time.h"
+
+#if defined(HAVE_EPOLL)
+#include <sys/epoll.h>
+#endif /* HAVE_EPOLL */
+
+
+/* Record readiness for fd from inside a backend's wait routine. */
+static void
+iperf_event_push(struct iperf_event_loop *loop, int fd, int events)
+{
+    struct iperf_event *ev;
+
+    if (loop->revents[fd] != 0 || loop->nready >= loop->ready_size)
+	return;
+    ev = &loop->ready[loop->nready++];
+    ev->fd = fd;
+    ev->events = events;
+    ev->data = loop->data[fd];
+    loop->revents[fd] = events;
+}
+
+/*************************************************************/
+
+static int
+select_init(struct iperf_event_loop *loop)
+{
+    FD_ZERO(&loop->read_set);
+    FD_ZERO(&loop->write_set);
+    return 0;
+}
+
+static void
+select_free(struct iperf_event_loop *loop)
+{
+}
+
+static int
+select_update(struct iperf_event_loop *loop, int fd, int oldmask, int newmask)
+{
+    if (fd >= FD_SETSIZE) {
+	errno = EINVAL;
+	return -1;
+    }
+    /* select() reports POLLERR as readable (and writable). */
+    if (newmask & (IPERF_EV_READ | IPERF_EV_ERROR))
+	FD_SET(fd, &loop->read_set);
+    else
+	FD_CLR(fd, &loop->read_set);
+    if (newmask & IPERF_EV_WRITE)
+	FD_SET(fd, &loop->write_set);
+    else
+	FD_CLR(fd, &loop->write_set);
+    return 0;
+}
+
+static int
+select_wait(struct iperf_event_loop *loop, struct timeval *timeout)
+{
+    fd_set read_set, write_set;
+    int result, fd, events;
+
+    memcpy(&read_set, &loop->read_set, sizeof(fd_set));
+    memcpy(&write_set, &loop->write_set, sizeof(fd_set));
+    result = select(loop->max_fd + 1, &read_set, &write_set, NULL, timeout);
+    if (result <= 0)
+	return result;
+
+    for (fd = 0; fd <= loop->max_fd && loop->nready < result; ++fd) {
+	events = 0;
+	if (FD_ISSET(fd, &read_set))
+	    events |= IPERF_EV_READ | IPERF_EV_ERROR;
+	if (FD_ISSET(fd, &write_set))
+	    events |= IPERF_EV_WRITE;
+	events &= loop->mask[fd];
+	if (events)
+	    iperf_event_push(loop, fd, events);
+    }
+    return loop->nready;
+}
+
+static struct iperf_event_backend select_backend = {
+    "select", select_init, select_free, select_update, select_wait
+};
+
+/*************************************************************/
+
+#if defined(HAVE_EPOLL)
+
+static int
+epoll_init(struct iperf_event_loop *loop)
+{
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0)
+	return -1;
+    return 0;
+}
+
+static void
+epoll_free(struct iperf_event_loop *loop)
+{
+    if (loop->epfd >= 0)
+	close(loop->epfd);
+    loop->epfd = -1;
+    free(loop->epevents);
+    loop->epevents = NULL;
+    loop->epevents_size = 0;
+}
+
+static int
+epoll_update(struct iperf_event_loop *loop, int fd, int oldmask, int newmask)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.data.fd = fd;
+    if (newmask & IPERF_EV_READ)
+	ev.events |= EPOLLIN;
+    if (newmask & IPERF_EV_WRITE)
+	ev.events |= EPOLLOUT;
+
+    if (newmask == 0) {
+	/* A descriptor that was closed has already left the epoll set. */
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, &ev) < 0 &&
+	    errno != ENOENT && errno != EBADF)
+	    return -1;
+	return 0;
+    }
+    if (oldmask == 0) {
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) == 0)
+	    return 0;
+	if (errno != EEXIST)
+	    return -1;
+	return epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &ev);
+    }
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &ev) == 0)
+	return 0;
+    /* The fd number was closed and reused behind our back. */
+    if (errno != ENOENT)
+	return -1;
+    return epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static int
+epoll_wait_events(struct iperf_event_loop *loop, struct timeval *timeout)
+{
+    struct epoll_event *events;
+    int ms, n, i, fd, mask, ready;
+
+    if (loop->epevents_size < loop->nfds || loop->epevents == NULL) {
+	int size = loop->nfds > 16 ? loop->nfds : 16;
+	void *p = realloc(loop->epevents, size * sizeof(struct epoll_event));
+	if (p == NULL)
+	    return -1;
+	loop->epevents = p;
+	loop->epevents_size = size;
+    }
+    events = loop->epevents;
+
+    /* Round up, so that we never wake before the next timer is due. */
+    if (timeout == NULL)
+	ms = -1;
+    else
+	ms = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+
+    n = epoll_wait(loop->epfd, events, loop->epevents_size, ms);
+    if (n <= 0)
+	return n;
+
+    for (i = 0; i < n; ++i) {
+	fd = events[i].data.fd;
+	if (fd < 0 || fd >= loop->size || (mask = loop->mask[fd]) == 0)
+	    continue;
+	/* Like select(), report errors and hangups as readable/writable. */
+	ready = 0;
+	if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+	    ready |= IPERF_EV_READ;
+	if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+	    ready |= IPERF_EV_WRITE;
+	if (events[i].events & (EPOLLERR | EPOLLHUP))
+	    ready |= IPERF_EV_ERROR;
+	ready &= mask;
+	if (ready)
+	    iperf_event_push(loop, fd, ready);
+    }
+    return loop->nready;
+}
+
+static struct iperf_event_backend epoll_backend = {
+    "epoll", epoll_init, epoll_free, epoll_update, epoll_wait_events
+};
+
+#endif /* HAVE_EPOLL */
+
+/*************************************************************/
+
+/* Backends in order of preference. */
+static struct iperf_event_backend *backends[] = {
+#if defined(HAVE_EPOLL)
+    &epoll_backend,
+#endif /* HAVE_EPOLL */
+    &select_backend,
+    NULL
+};
+
+static struct iperf_event_backend *
+find_backend(const char *name)
+{
+    int i;
+
+    if (name == NULL)
+	return backends[0];
+    for (i = 0; backends[i] != NULL; ++i)
+	if (strcmp(backends[i]->name, name) == 0)
+	    return backends[i];
+    return NULL;
+}
+
+int
+iperf_event_backend_available(const char *name)
+{
+    return find_backend(name) != NULL;
+}
+
+const char *
+iperf_event_backend_name(struct iperf_event_loop *loop)
+{
+    return loop->backend->name;
+}
+
+/* Make room for fd in the per-fd tables. */
+static int
+iperf_event_grow(struct iperf_event_loop *loop, int fd)
+{
+    int size;
+    unsigned char *mask, *revents;
+    void **data;
+
+    if (fd < loop->size)
+	return 0;
+    size = loop->size ? loop->size : 64;
+    while (size <= fd)
+	size *= 2;
+
+    mask = realloc(loop->mask, size);
+    if (mask == NULL)
+	return -1;
+    loop->mask = mask;
+    revents = realloc(loop->revents, size);
+    if (revents == NULL)
+	return -1;
+    loop->revents = revents;
+    data = realloc(loop->data, size * sizeof(void *));
+    if (data == NULL)
+	return -1;
+    loop->data = data;
+
+    memset(loop->mask + loop->size, 0, size - loop->size);
+    memset(loop->revents + loop->size, 0, size - loop->size);
+    memset(loop->data + loop->size, 0, (size - loop->size) * sizeof(void *));
+    loop->size = size;
+    return 0;
+}
+
+struct iperf_event_loop *
+iperf_event_loop_new(const char *name)
+{
+    struct iperf_event_loop *loop;
+    struct iperf_event_backend *backend;
+
+    backend = find_backend(name);
+    if (backend == NULL) {
+	errno = EINVAL;
+	return NULL;
+    }
+
+    loop = (struct iperf_event_loop *) calloc(1, sizeof(struct iperf_event_loop));
+    if (loop == NULL)
+	return NULL;
+    loop->backend = backend;
+    loop->max_fd = -1;
+    loop->epfd = -1;
+    if (loop->backend->init(loop) < 0) {
+	free(loop);
+	return NULL;
+    }
+    return loop;
+}
+
+void
+iperf_event_loop_free(struct iperf_event_loop *loop)
+{
+    if (loop == NULL)
+	return;
+    loop->backend->free(loop);
+    free(loop->mask);
+    free(loop->revents);
+    free(loop->data);
+    free(loop->ready);
+    free(loop);
+}
+
+int
+iperf_event_loop_reset(struct iperf_event_loop *loop)
+{
+    loop->backend->free(loop);
+    if (loop->size > 0) {
+	memset(loop->mask, 0, loop->size);
+	memset(loop->revents, 0, loop->size);
+	memset(loop->data, 0, loop->size * sizeof(void *));
+    }
+    loop->max_fd = -1;
+    loop->nfds = 0;
+    loop->nready = 0;
+    iperf_event_loop_set_busy_poll(loop, 0);
+    return loop->backend->init(loop);
+}
+
+/*
+ * Give fd the interest mask newmask with a single backend update,
+ * keeping the registration count, max_fd and ready-list size in step.
+ * The caller has made room for fd.
+ */
+static int
+iperf_event_set_mask(struct iperf_event_loop *loop, int fd, int newmask)
+{
+    int oldmask;
+
+    oldmask = loop->mask[fd];
+    if (newmask == oldmask)
+	return 0;
+    if (oldmask == 0 && loop->nfds >= loop->ready_size) {
+	int size = loop->ready_size ? loop->ready_size * 2 : 16;
+	struct iperf_event *ready = realloc(loop->ready, size * sizeof(struct iperf_event));
+	if (ready == NULL)
+	    return -1;
+	loop->ready = ready;
+	loop->ready_size = size;
+    }
+    if (loop->backend->update(loop, fd, oldmask, newmask) < 0)
+	return -1;
+    loop->mask[fd] = newmask;
+    if (oldmask == 0) {
+	++loop->nfds;
+	if (fd > loop->max_fd)
+	    loop->max_fd = fd;
+    } else if (newmask == 0) {
+	--loop->nfds;
+	loop->data[fd] = NULL;
+	if (fd == loop->max_fd)
+	    while (loop->max_fd >= 0 && loop->mask[loop->max_fd] == 0)
+		--loop->max_fd;
+    }
+    return 0;
+}
+
+int
+iperf_event_add(struct iperf_event_loop *loop, int fd, int events, void *data)
+{
+    if (fd < 0) {
+	errno = EBADF;
+	return -1;
+    }
+    if (iperf_event_grow(loop, fd) < 0)
+	return -1;
+    if (iperf_event_set_mask(loop, fd, loop->mask[fd] | events) < 0)
+	return -1;
+    loop->data[fd] = data;
+    return 0;
+}
+
+int
+iperf_event_del(struct iperf_event_loop *loop, int fd, int events)
+{
+    if (fd < 0 || fd >= loop->size)
+	return 0;
+
+    /* Don't let the current pass dispatch on what we just removed. */
+    loop->revents[fd] &= ~events;
+
+    return iperf_event_set_mask(loop, fd, loop->mask[fd] & ~events);
+}
+
+int
+iperf_event_mod(struct iperf_event_loop *loop, int fd, int add, int del)
+{
+    if (fd < 0) {
+	errno = EBADF;
+	return -1;
+    }
+    if (iperf_event_grow(loop, fd) < 0)
+	return -1;
+
+    loop->revents[fd] &= ~del;
+
+    return iperf_event_set_mask(loop, fd, (loop->mask[fd] & ~del) | add);
+}
+
+void
+iperf_event_loop_set_busy_poll(struct iperf_event_loop *loop, unsigned int usecs)
+{
+    loop->busy_poll_ns = (uint64_t) usecs * 1000;
+    loop->last_event_ns = 0;
+    loop->polls = 0;
+    loop->empty_polls = 0;
+}
+
+/*
+ * Spin with zero timeouts while the last event is recent enough, else
+ * fall back to the caller's (blocking) timeout.
+ */
+static int
+busy_poll_wait(struct iperf_event_loop *loop, struct timeval *timeout)
+{
+    struct iperf_time now;
+    struct timeval zero;
+    int spinning, r;
+
+    iperf_time_now(&now);
+    spinning = iperf_time_in_nsecs(&now) - loop->last_event_ns < loop->busy_poll_ns;
+    if (spinning) {
+	zero.tv_sec = 0;
+	zero.tv_usec = 0;
+	r = loop->backend->wait(loop, &zero);
+	++loop->polls;
+	if (r == 0)
+	    ++loop->empty_polls;
+    } else {
+	r = loop->backend->wait(loop, timeout);
+	if (r > 0)
+	    iperf_time_now(&now);
+    }
+    if (r > 0)
+	loop->last_event_ns = iperf_time_in_nsecs(&now);
+    return r;
+}
+
+int
+iperf_event_wait(struct iperf_event_loop *loop, struct timeval *timeout)
+{
+    int i;
+
+    /* Forget whatever the previous pass did not consume. */
+    for (i = 0; i < loop->nready; ++i)
+	if (loop->ready[i].fd < loop->size)
+	    loop->revents[loop->ready[i].fd] = 0;
+    loop->nready = 0;
+
+    if (loop->busy_poll_ns != 0)
+	return busy_poll_wait(loop, timeout);
+    return loop->backend->wait(loop, timeout);
+}
+
+int
+iperf_event_is_ready(struct iperf_event_loop *loop, int fd, int events)
+{
+    if (fd < 0 || fd >= loop->size)
+	return 0;
+    return (loop->revents[fd] & events) != 0;
+}
+
+void
+iperf_event_clear_ready(struct iperf_event_loop *loop, int fd, int events)
+{
+    if (fd < 0 || fd >= loop->size)
+	return;
+    loop->revents[fd] &= ~events;
+}
@@ -0,0 +1,152 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_EVENT_H
+#define __IPERF_EVENT_H
+
+#include <stdint.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+/* Interest / readiness flags */
+#define IPERF_EV_READ	0x01
+#define IPERF_EV_WRITE	0x02
+#define IPERF_EV_ERROR	0x04	/* pending socket error or error queue (POLLERR) */
+
+/* One entry of the ready-list filled in by iperf_event_wait(). */
+struct iperf_event
+{
+    int       fd;
+    int       events;		/* IPERF_EV_* bits that are ready */
+    void     *data;		/* pointer registered with the fd, if any */
+};
+
+struct iperf_event_loop;
+struct iperf_pacing;
+
+/*
+ * An event backend.  Each backend only has to track the kernel side
+ * of a registration; the loop keeps the per-fd interest mask and
+ * user data and hands both to update().
+ */
+struct iperf_event_backend
+{
+    const char *name;
+    int (*init)(struct iperf_event_loop *);
+    void (*free)(struct iperf_event_loop *);
+    int (*update)(struct iperf_event_loop *, int fd, int oldmask, int newmask);
+    int (*wait)(struct iperf_event_loop *, struct timeval *timeout);
+};
+
+struct iperf_event_loop
+{
+    struct iperf_event_backend *backend;
+
+    int       size;			/* slots in mask/revents/data */
+    unsigned char *mask;		/* registered interest, per fd */
+    unsigned char *revents;		/* readiness from the last wait, per fd */
+    void    **data;			/* user data, per fd */
+    int       max_fd;			/* highest fd with a registration */
+    int       nfds;			/* number of registered fds */
+
+    struct iperf_event *ready;		/* ready-list from the last wait */
+    int       nready;
+    int       ready_size;
+
+    /* Busy polling, see iperf_event_loop_set_busy_poll() */
+    uint64_t  busy_poll_ns;		/* spin this long after an event, 0 = never */
+    uint64_t  last_event_ns;		/* when a wait last found something */
+    uint64_t  polls;			/* zero-timeout waits made while spinning */
+    uint64_t  empty_polls;		/* ... that found nothing ready */
+
+    struct iperf_pacing *pacing;	/* precise -b pacing driver on this loop, or NULL */
+
+    /* Backend private state */
+    int       epfd;
+    void     *epevents;
+    int       epevents_size;
+    fd_set    read_set;
+    fd_set    write_set;
+};
+
+/*
+ * iperf_event_loop_new -- create an event loop using the named backend,
+ * or the best one available on this platform if name is NULL.
+ * Returns NULL on failure.
+ */
+struct iperf_event_loop *iperf_event_loop_new(const char *name);
+
+void iperf_event_loop_free(struct iperf_event_loop *loop);
+
+/* Drop every registration and stop busy polling, keeping the backend. */
+int iperf_event_loop_reset(struct iperf_event_loop *loop);
+
+const char *iperf_event_backend_name(struct iperf_event_loop *loop);
+
+/*
+ * iperf_event_loop_set_busy_poll -- after a wait finds something
+ * ready, make the following waits non-blocking for usecs microseconds
+ * so that a steady stream of events is picked up without the sleep
+ * and wake-up of a blocking wait.  0 turns spinning off.  Also resets
+ * the loop's poll counters.
+ */
+void iperf_event_loop_set_busy_poll(struct iperf_event_loop *loop, unsigned int usecs);
+
+/* Nonzero if the named backend is compiled in. */
+int iperf_event_backend_available(const char *name);
+
+/*
+ * iperf_event_add / iperf_event_del -- add or remove interest bits for
+ * a file descriptor, the equivalent of FD_SET / FD_CLR on the master
+ * fd_sets.  iperf_event_add replaces any data pointer registered for fd.
+ * Both return 0 on success, -1 on failure (with errno set).
+ */
+int iperf_event_add(struct iperf_event_loop *loop, int fd, int events, void *data);
+int iperf_event_del(struct iperf_event_loop *loop, int fd, int events);
+
+/*
+ * iperf_event_mod -- drop the del bits and add the add bits of fd's
+ * interest in one backend update (a single EPOLL_CTL_MOD under epoll),
+ * keeping its data pointer.  Returns 0 on success, -1 on failure.
+ */
+int iperf_event_mod(struct iperf_event_loop *loop, int fd, int add, int del);
+
+/*
+ * iperf_event_wait -- wait for readiness, filling loop->ready with
+ * loop->nready entries.  Returns the number of ready fds, 0 on timeout,
+ * or -1 on error (with errno set, EINTR included).
+ */
+int iperf_event_wait(struct iperf_event_loop *loop, struct timeval *timeout);
+
+/*
+ * iperf_event_is_ready / iperf_event_clear_ready -- test and consume
+ * readiness from the last wait, the equivalent of FD_ISSET / FD_CLR on
+ * the fd_sets returned by select().
+ */
+int iperf_event_is_ready(struct iperf_event_loop *loop, int fd, int events);
+void iperf_event_clear_ready(struct iperf_event_loop *loop, int fd, int events);
+
+#endif /* __IPERF_EVENT_H */
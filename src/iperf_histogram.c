@@ -0,0 +1,182 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "iperf_histogram.h"
+
+struct iperf_histogram *
+iperf_histogram_new(void)
+{
+    return (struct iperf_histogram *) calloc(1, sizeof(struct iperf_histogram));
+}
+
+void
+iperf_histogram_free(struct iperf_histogram *h)
+{
+    free(h);
+}
+
+void
+iperf_histogram_reset(struct iperf_histogram *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+/* Index of the highest set bit of v, which must be non-zero. */
+static int
+msb64(uint64_t v)
+{
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(v);
+#else
+    int n = 0;
+
+    while (v >>= 1)
+	++n;
+    return n;
+#endif
+}
+
+/*
+ * Bucket holding value: values below 2^SUB_BITS map to themselves;
+ * above that, value >> e (for the e that leaves SUB_BITS significant
+ * bits) picks one of HALF buckets in the e'th power-of-two range.
+ */
+int
+iperf_histogram_index(uint64_t value)
+{
+    int e;
+
+    if (value < (1 << IPERF_HIST_SUB_BITS))
+	return (int) value;
+    if (value >= ((uint64_t) 1 << IPERF_HIST_MAX_BITS))
+	value = ((uint64_t) 1 << IPERF_HIST_MAX_BITS) - 1;
+    e = msb64(value) - (IPERF_HIST_SUB_BITS - 1);
+    return e * IPERF_HIST_HALF + (int) (value >> e);
+}
+
+/* Highest value that lands in bucket index. */
+uint64_t
+iperf_histogram_highest(int index)
+{
+    int e;
+    uint64_t m;
+
+    if (index < (1 << IPERF_HIST_SUB_BITS))
+	return (uint64_t) index;
+    e = index / IPERF_HIST_HALF - 1;
+    m = (uint64_t) (index - e * IPERF_HIST_HALF);
+    return ((m + 1) << e) - 1;
+}
+
+void
+iperf_histogram_record(struct iperf_histogram *h, uint64_t value)
+{
+    h->counts[iperf_histogram_index(value)]++;
+}
+
+/*
+ * Count a value that came out negative, such as a datagram that seems
+ * to have arrived before it was sent, apart from the distribution.
+ */
+void
+iperf_histogram_record_negative(struct iperf_histogram *h)
+{
+    h->negative++;
+}
+
+void
+iperf_histogram_add(struct iperf_histogram *dst, const struct iperf_histogram *src)
+{
+    int i;
+
+    for (i = 0; i < IPERF_HIST_BUCKETS; ++i)
+	dst->counts[i] += src->counts[i];
+    dst->negative += src->negative;
+}
+
+/*
+ * Put what cur gained since mark into delta, and bring mark up to
+ * cur.  cur may be recorded into by another thread meanwhile; each
+ * bucket is read once, so nothing is counted twice or lost.
+ */
+void
+iperf_histogram_interval(const struct iperf_histogram *cur, struct iperf_histogram *mark, struct iperf_histogram *delta)
+{
+    uint64_t c;
+    int i;
+
+    for (i = 0; i < IPERF_HIST_BUCKETS; ++i) {
+	c = cur->counts[i];
+	delta->counts[i] = c - mark->counts[i];
+	mark->counts[i] = c;
+    }
+    c = cur->negative;
+    delta->negative = c - mark->negative;
+    mark->negative = c;
+}
+
+void
+iperf_histogram_summarize(const struct iperf_histogram *h, struct iperf_latency_summary *s)
+{
+    static const double pct[4] = { 50.0, 90.0, 99.0, 99.9 };
+    uint64_t *out[4];
+    uint64_t target[4];
+    uint64_t seen = 0;
+    int i, p = 0;
+
+    memset(s, 0, sizeof(*s));
+    s->negative = h->negative;
+    for (i = 0; i < IPERF_HIST_BUCKETS; ++i) {
+	if (h->counts[i] > 0) {
+	    s->count += h->counts[i];
+	    s->max = iperf_histogram_highest(i);
+	}
+    }
+    if (s->count == 0)
+	return;
+
+    out[0] = &s->p50;
+    out[1] = &s->p90;
+    out[2] = &s->p99;
+    out[3] = &s->p999;
+    for (p = 0; p < 4; ++p) {
+	/* rank of the percentile sample, counting from 1, rounded up */
+	double rank = pct[p] / 100.0 * s->count;
+
+	target[p] = (uint64_t) rank;
+	if ((double) target[p] < rank || target[p] < 1)
+	    target[p]++;
+    }
+    p = 0;
+    for (i = 0; i < IPERF_HIST_BUCKETS && p < 4; ++i) {
+	seen += h->counts[i];
+	while (p < 4 && seen >= target[p])
+	    *out[p++] = iperf_histogram_highest(i);
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_HISTOGRAM_H
+#define __IPERF_HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * Log-linear (HDR-style) histogram of non-negative values, used for
+ * per-datagram one-way latency in nanoseconds.  Values below
+ * 2^IPERF_HIST_SUB_BITS are counted exactly; above that every power of
+ * two is split into 2^(IPERF_HIST_SUB_BITS - 1) equal buckets, which
+ * keeps each bucket within 1/64 (about 1.6%) of its value.  Values of
+ * 2^IPERF_HIST_MAX_BITS (about 68 seconds in ns) and up land in the
+ * top bucket.  Recording is one shift and one increment.
+ */
+#define IPERF_HIST_SUB_BITS	7
+#define IPERF_HIST_MAX_BITS	36
+#define IPERF_HIST_HALF		(1 << (IPERF_HIST_SUB_BITS - 1))
+#define IPERF_HIST_BUCKETS	((IPERF_HIST_MAX_BITS - IPERF_HIST_SUB_BITS + 2) * IPERF_HIST_HALF)
+
+struct iperf_histogram
+{
+    uint64_t  counts[IPERF_HIST_BUCKETS];
+    uint64_t  negative;		/* values that came out below zero, not in counts */
+};
+
+/* Percentiles of a histogram, as the highest value of their bucket. */
+struct iperf_latency_summary
+{
+    uint64_t  count;
+    uint64_t  p50;
+    uint64_t  p90;
+    uint64_t  p99;
+    uint64_t  p999;
+    uint64_t  max;
+    uint64_t  negative;
+};
+
+struct iperf_histogram *iperf_histogram_new(void);
+void iperf_histogram_free(struct iperf_histogram *h);
+void iperf_histogram_reset(struct iperf_histogram *h);
+int iperf_histogram_index(uint64_t value);
+uint64_t iperf_histogram_highest(int index);
+void iperf_histogram_record(struct iperf_histogram *h, uint64_t value);
+void iperf_histogram_record_negative(struct iperf_histogram *h);
+void iperf_histogram_add(struct iperf_histogram *dst, const struct iperf_histogram *src);
+void iperf_histogram_interval(const struct iperf_histogram *cur, struct iperf_histogram *mark, struct iperf_histogram *delta);
+void iperf_histogram_summarize(const struct iperf_histogram *h, struct iperf_latency_summary *s);
+
+#endif /* __IPERF_HISTOGRAM_H */
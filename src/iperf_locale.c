@@ -109,8 +109,15 @@ const char usage_longstr[] = "Usage: iperf3 [-s|-c host] [options]\n"
                            "  -J, --json                output in JSON format\n"
                            "  --logfile f               send output to a log file\n"
                            "  --forceflush              force flushing output at every interval\n"
+                           "  --interval-history #      intervals of results to keep per stream\n"
+                           "                            (default %d)\n"
                            "  --timestamps<=format>     emit a timestamp at the start of each output line\n"
                            "                            (optional \"=\" and format string as per strftime(3))\n"
+                           "  --event-backend <name>    socket event backend to use (epoll or select,\n"
+                           "                            default is the best available)\n"
+                           "  --threads <n>             spread the streams over n worker threads\n"
+                           "  --pin <cpus>|auto         pin the worker threads to a CPU list (e.g. 0,2,4-7),\n"
+                           "                            or to the CPUs on the NIC's NUMA node\n"
     
                            "  -d, --debug               emit debugging output\n"
                            "  -v, --version             show version information and quit\n"
@@ -145,6 +152,10 @@ const char usage_longstr[] = "Usage: iperf3 [-s|-c host] [options]\n"
                            "                            (default %d Mbit/sec for UDP, unlimited for TCP)\n"
                            "                            (optional slash and packet count for burst mode)\n"
 			   "  --pacing-timer #[KMG]     set the timing for pacing, in microseconds (default 1000)\n"
+			   "  --bucket-depth #[KMG][p]  most bytes (or blocks, with p) a paced stream may\n"
+			   "                            send back to back (default two pacing timer ticks)\n"
+			   "  --pacing-driver <name>    wake paced senders with 'timer' (default), 'timerfd'\n"
+			   "                            or 'spin' (busy-wait the last 50 usecs)\n"
 #if defined(HAVE_SO_MAX_PACING_RATE)
                            "  --fq-rate #[KMG]          enable fair-queuing based socket pacing in\n"
 			   "                            bits/sec (Linux only)\n"
@@ -183,6 +194,40 @@ const char usage_longstr[] = "Usage: iperf3 [-s|-c host] [options]\n"
                            "  --extra-data str          data string to include in client and server JSON\n"
                            "  --get-server-output       get results from server\n"
                            "  --udp-counters-64bit      use 64-bit counters in UDP test packets\n"
+                           "  --udp-ns-header           carry nanosecond send times and 64-bit counters\n"
+                           "                            in UDP test packets\n"
+                           "  --udp-batch #             send/receive # UDP datagrams per system call\n"
+                           "                            (sendmmsg/recvmmsg)\n"
+                           "  --udp-gso #               send # UDP datagrams per UDP_SEGMENT (GSO) send\n"
+                           "                            (Linux only)\n"
+                           "  --udp-gro                 receive coalesced UDP reads (UDP_GRO) and split\n"
+                           "                            them into datagrams (Linux only)\n"
+                           "  --rx-timestamps           time UDP arrivals with kernel receive timestamps\n"
+                           "                            (SO_TIMESTAMPNS) for jitter\n"
+                           "  --txtime[=fq|etf]         give each paced UDP datagram a departure time\n"
+                           "                            (SO_TXTIME) for the fq (default) or etf qdisc\n"
+                           "                            (Linux only)\n"
+                           "  --busy-poll #             spin for # usecs after each event instead of\n"
+                           "                            sleeping, and set SO_BUSY_POLL on data sockets\n"
+                           "  --rr #[KMG][/#[KMG]]      TCP request/response mode: send a # byte request,\n"
+                           "                            await the /# byte reply (default the same size);\n"
+                           "                            report transactions/sec and round-trip percentiles\n"
+                           "  --msg-zerocopy            send from a ring of buffers with MSG_ZEROCOPY and\n"
+                           "                            report the bytes not copied (TCP/UDP, Linux only)\n"
+                           "  --rx-zerocopy             map received TCP pages (TCP_ZEROCOPY_RECEIVE)\n"
+                           "                            instead of copying them (Linux only)\n"
+                           "  --splice                  drain received TCP data (to /dev/null, or the\n"
+                           "                            -F file) with splice() instead of reading it\n"
+                           "  --hugepages               back stream buffers with 2 MB huge pages\n"
+                           "                            (MAP_HUGETLB, else transparent huge pages)\n"
+                           "  --crr #[KMG][/#[KMG]]     like --rr, but open a new connection for every\n"
+                           "                            transaction; report connections/sec and connect\n"
+                           "                            and flow completion time percentiles\n"
+                           "  --latency-histogram       report UDP one-way latency percentiles per interval\n"
+                           "                            and for the whole test (needs synchronized clocks)\n"
+                           "  --reorder-window #[KMG]   UDP receive window, in datagrams, for telling\n"
+                           "                            reordered, duplicate and lost datagrams apart\n"
+                           "                            (default 64K)\n"
                            "  --repeating-payload       use repeating pattern in payload, instead of\n"
                            "                            randomized payload (like in iperf2)\n"
 #if defined(HAVE_SSL)
@@ -412,9 +457,66 @@ const char server_reporting[] =
 const char reportCSV_peer[] =
 "%s,%u,%s,%u";
 
+const char report_latency_format[] =
+"[%3d]%s %6.2f-%-6.2f sec  latency p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f ms\n";
+
+const char report_sum_latency_format[] =
+"[SUM]%s %6.2f-%-6.2f sec  latency p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f ms\n";
+
+const char report_latency_negative_format[] =
+"[%3d]%s %6.2f-%-6.2f sec  latency: %llu datagrams arrived before they were sent (clocks not synchronized?)\n";
+
+const char report_sum_latency_negative_format[] =
+"[SUM]%s %6.2f-%-6.2f sec  latency: %llu datagrams arrived before they were sent (clocks not synchronized?)\n";
+
+const char report_rr_format[] =
+"[%3d]%s %6.2f-%-6.2f sec  %9.1f trans/sec  rtt p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f us\n";
+
+const char report_sum_rr_format[] =
+"[SUM]%s %6.2f-%-6.2f sec  %9.1f trans/sec  rtt p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f us\n";
+
+const char report_crr_format[] =
+"[%3d]%s %6.2f-%-6.2f sec  %9.1f conn/sec  connect p50 %.1f  p99 %.1f  max %.1f  fct p50 %.1f  p90 %.1f  p99 %.1f  max %.1f us\n";
+
+const char report_sum_crr_format[] =
+"[SUM]%s %6.2f-%-6.2f sec  %9.1f conn/sec  connect p50 %.1f  p99 %.1f  max %.1f  fct p50 %.1f  p90 %.1f  p99 %.1f  max %.1f us\n";
+
+const char report_msg_zerocopy_format[] =
+"[%3d] MSG_ZEROCOPY %.0f sends: %s not copied, %s copied; completion p50 %.1f  p99 %.1f  max %.1f us; %.0f waits for a buffer\n";
+
+const char report_sum_msg_zerocopy_format[] =
+"[SUM] MSG_ZEROCOPY %.0f sends: %s not copied, %s copied; completion p50 %.1f  p99 %.1f  max %.1f us; %.0f waits for a buffer\n";
+
+const char report_stream_setup_format[] =
+"Stream setup: %d streams in %.3f ms, max resident set %s\n";
+
+const char report_rx_zerocopy_format[] =
+"[%3d] TCP_ZEROCOPY_RECEIVE: %s mapped, %s copied (%.1f%% mapped)\n";
+
+const char report_sum_rx_zerocopy_format[] =
+"[SUM] TCP_ZEROCOPY_RECEIVE: %s mapped, %s copied (%.1f%% mapped)\n";
+
+const char report_pacing_error_format[] =
+"[%3d]%s %6.2f-%-6.2f sec  pacing error p50 %.3f  p90 %.3f  p99 %.3f  max %.3f us\n";
+
+const char report_send_gaps_format[] =
+"[%3d]%s %6.2f-%-6.2f sec  send gap p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f us\n";
+
+const char report_duplicates_format[] =
+"[%3d]%s %4.1f-%4.1f sec  %d datagrams duplicated, %d too late for the reorder window\n";
+
+const char report_reorder_distance_format[] =
+"[%3d]%s reorder distance (datagrams:count)%s\n";
+
+const char report_sum_pps[] =
+"Packet rate: sender %.0f pps, receiver %.0f pps\n";
+
 const char report_cpu[] =
 "CPU Utilization: %s/%s %.1f%% (%.1f%%u/%.1f%%s), %s/%s %.1f%% (%.1f%%u/%.1f%%s)\n";
 
+const char report_busy_poll_format[] =
+"Busy polling %d us: %s %.0f polls (%.1f%% empty) %.2f us CPU/block, %s %.0f polls (%.1f%% empty) %.2f us CPU/block\n";
+
 const char report_local[] = "local";
 const char report_remote[] = "remote";
 const char report_sender[] = "sender";
@@ -95,7 +95,26 @@ extern const char report_sum_datagrams[] ;
 extern const char server_reporting[] ;
 extern const char reportCSV_peer[] ;
 
+extern const char report_latency_format[] ;
+extern const char report_sum_latency_format[] ;
+extern const char report_latency_negative_format[] ;
+extern const char report_sum_latency_negative_format[] ;
+extern const char report_rr_format[] ;
+extern const char report_sum_rr_format[] ;
+extern const char report_crr_format[] ;
+extern const char report_sum_crr_format[] ;
+extern const char report_msg_zerocopy_format[] ;
+extern const char report_sum_msg_zerocopy_format[] ;
+extern const char report_stream_setup_format[] ;
+extern const char report_rx_zerocopy_format[] ;
+extern const char report_sum_rx_zerocopy_format[] ;
+extern const char report_pacing_error_format[] ;
+extern const char report_send_gaps_format[] ;
+extern const char report_duplicates_format[] ;
+extern const char report_reorder_distance_format[] ;
+extern const char report_sum_pps[] ;
 extern const char report_cpu[] ;
+extern const char report_busy_poll_format[] ;
 extern const char report_local[] ;
 extern const char report_remote[] ;
 extern const char report_sender[] ;
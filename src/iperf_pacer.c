@@ -0,0 +1,85 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include "iperf_pacer.h"
+
+/* iperf_pacer_init
+ *
+ * Start a bucket for rate bits per second, holding up to depth bytes.
+ * It starts full.
+ */
+void
+iperf_pacer_init(struct iperf_pacer *p, uint64_t rate, uint64_t depth, struct iperf_time *now)
+{
+    p->rate = rate / 8.0;
+    p->depth = depth;
+    p->tokens = p->depth;
+    p->last = *now;
+}
+
+/* iperf_pacer_ready
+ *
+ * Earn the tokens due since the last call and say whether the sender
+ * may send now.
+ */
+int
+iperf_pacer_ready(struct iperf_pacer *p, struct iperf_time *now)
+{
+    struct iperf_time delta;
+
+    if (iperf_time_diff(now, &p->last, &delta) == 0) {
+	p->tokens += p->rate * iperf_time_in_nsecs(&delta) / 1e9;
+	if (p->tokens > p->depth)
+	    p->tokens = p->depth;
+	p->last = *now;
+    }
+    return p->tokens > 0;
+}
+
+/* iperf_pacer_consume
+ *
+ * Take the tokens for a send of the given size.
+ */
+void
+iperf_pacer_consume(struct iperf_pacer *p, uint64_t bytes)
+{
+    p->tokens -= bytes;
+}
+
+/* iperf_pacer_wait
+ *
+ * Nanoseconds until the sender may send again, as of the last
+ * iperf_pacer_ready() call.
+ */
+uint64_t
+iperf_pacer_wait(struct iperf_pacer *p)
+{
+    if (p->tokens > 0 || p->rate <= 0)
+	return 0;
+    return (uint64_t) (-p->tokens * 1e9 / p->rate) + 1;
+}
@@ -0,0 +1,55 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_PACER_H
+#define __IPERF_PACER_H
+
+#include <stdint.h>
+
+#include "iperf_time.h"
+
+/*
+ * Token bucket for sender pacing.  Tokens are bytes, earned at the
+ * target rate from the nanosecond clock and capped at the bucket
+ * depth, so after a stall the sender gets at most one bucket's worth
+ * of catch-up instead of bursting until the long-run average is met.
+ * A send may overdraw the bucket; the sender then waits until the
+ * balance is positive again.
+ */
+struct iperf_pacer
+{
+    double    rate;		/* bytes per second */
+    double    depth;		/* bucket size, in bytes */
+    double    tokens;		/* may go negative after a send */
+    struct iperf_time last;	/* when tokens were last earned */
+};
+
+void iperf_pacer_init(struct iperf_pacer *p, uint64_t rate, uint64_t depth, struct iperf_time *now);
+int iperf_pacer_ready(struct iperf_pacer *p, struct iperf_time *now);
+void iperf_pacer_consume(struct iperf_pacer *p, uint64_t bytes);
+uint64_t iperf_pacer_wait(struct iperf_pacer *p);
+
+#endif /* __IPERF_PACER_H */
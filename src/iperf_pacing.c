@@ -0,0 +1,314 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(HAVE_TIMERFD)
+#include <sys/timerfd.h>
+#endif /* HAVE_TIMERFD */
+#if defined(HAVE_PR_SET_TIMERSLACK)
+#include <sys/prctl.h>
+#endif /* HAVE_PR_SET_TIMERSLACK */
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_pacing.h"
+
+static const char *driver_names[] = { "timer", "timerfd", "spin" };
+
+#define HEAP_ARITY 4
+
+int
+iperf_pacing_driver_parse(const char *name)
+{
+    int i;
+
+    for (i = 0; i < (int) (sizeof(driver_names) / sizeof(driver_names[0])); ++i)
+	if (strcmp(name, driver_names[i]) == 0)
+	    return i;
+    return -1;
+}
+
+const char *
+iperf_pacing_driver_name(int driver)
+{
+    if (driver < 0 || driver >= (int) (sizeof(driver_names) / sizeof(driver_names[0])))
+	return "unknown";
+    return driver_names[driver];
+}
+
+int
+iperf_pacing_driver_supported(int driver)
+{
+#if !defined(HAVE_TIMERFD)
+    if (driver == IPERF_PACING_TIMERFD)
+	return 0;
+#endif /* !HAVE_TIMERFD */
+    return driver >= IPERF_PACING_TIMER && driver <= IPERF_PACING_SPIN;
+}
+
+/*
+ * Set up a precise driver for one event loop, from the thread that
+ * will run it.  Nothing to do for the default timer driver.
+ */
+int
+iperf_pacing_init(struct iperf_pacing *pc, int driver, struct iperf_event_loop *loop)
+{
+    memset(pc, 0, sizeof(*pc));
+    pc->driver = driver;
+    pc->tfd = -1;
+    if (driver == IPERF_PACING_TIMER)
+	return 0;
+    loop->pacing = pc;
+    if (!iperf_pacing_driver_supported(driver)) {
+	pc->driver = IPERF_PACING_TIMER;
+	i_errno = IEUNIMP;
+	return -1;
+    }
+
+#if defined(HAVE_PR_SET_TIMERSLACK)
+    /* Don't let the kernel defer our wakeups by the default 50 us. */
+    (void) prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+#endif /* HAVE_PR_SET_TIMERSLACK */
+
+#if defined(HAVE_TIMERFD)
+    if (driver == IPERF_PACING_TIMERFD) {
+	pc->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (pc->tfd < 0 || iperf_event_add(loop, pc->tfd, IPERF_EV_READ, NULL) < 0) {
+	    if (pc->tfd >= 0)
+		close(pc->tfd);
+	    pc->driver = IPERF_PACING_TIMER;
+	    pc->tfd = -1;
+	    loop->pacing = NULL;
+	    i_errno = IEPACINGDRIVER;
+	    return -1;
+	}
+    }
+#endif /* HAVE_TIMERFD */
+    return 0;
+}
+
+void
+iperf_pacing_free(struct iperf_pacing *pc, struct iperf_event_loop *loop)
+{
+    if (pc->driver == IPERF_PACING_TIMERFD && pc->tfd >= 0) {
+	if (loop != NULL)
+	    iperf_event_del(loop, pc->tfd, IPERF_EV_READ);
+	close(pc->tfd);
+    }
+    if (loop != NULL && loop->pacing == pc)
+	loop->pacing = NULL;
+    /* The streams may be gone already; iperf_pacing_cancel() copes. */
+    free(pc->heap);
+    memset(pc, 0, sizeof(*pc));
+    pc->driver = IPERF_PACING_TIMER;
+    pc->tfd = -1;
+}
+
+static void
+heap_set(struct iperf_pacing *pc, int i, struct iperf_stream *sp)
+{
+    pc->heap[i] = sp;
+    sp->pace_index = i;
+}
+
+static void
+heap_up(struct iperf_pacing *pc, int i)
+{
+    struct iperf_stream *sp = pc->heap[i];
+    int parent;
+
+    while (i > 0) {
+	parent = (i - 1) / HEAP_ARITY;
+	if (iperf_time_compare(&sp->pace_due, &pc->heap[parent]->pace_due) >= 0)
+	    break;
+	heap_set(pc, i, pc->heap[parent]);
+	i = parent;
+    }
+    heap_set(pc, i, sp);
+}
+
+static void
+heap_down(struct iperf_pacing *pc, int i)
+{
+    struct iperf_stream *sp = pc->heap[i];
+    int child, c, last, best;
+
+    for (;;) {
+	child = i * HEAP_ARITY + 1;
+	if (child >= pc->heap_len)
+	    break;
+	last = child + HEAP_ARITY < pc->heap_len ? child + HEAP_ARITY : pc->heap_len;
+	best = child;
+	for (c = child + 1; c < last; ++c)
+	    if (iperf_time_compare(&pc->heap[c]->pace_due, &pc->heap[best]->pace_due) < 0)
+		best = c;
+	if (iperf_time_compare(&pc->heap[best]->pace_due, &sp->pace_due) >= 0)
+	    break;
+	heap_set(pc, i, pc->heap[best]);
+	i = best;
+    }
+    heap_set(pc, i, sp);
+}
+
+int
+iperf_pacing_defer(struct iperf_pacing *pc, struct iperf_stream *sp)
+{
+    if (pc->heap_len == pc->heap_size) {
+	int size = pc->heap_size ? pc->heap_size * 2 : 64;
+	struct iperf_stream **heap = realloc(pc->heap, size * sizeof(struct iperf_stream *));
+	if (heap == NULL)
+	    return -1;
+	pc->heap = heap;
+	pc->heap_size = size;
+    }
+    heap_set(pc, pc->heap_len++, sp);
+    heap_up(pc, sp->pace_index);
+    return 0;
+}
+
+void
+iperf_pacing_cancel(struct iperf_pacing *pc, struct iperf_stream *sp)
+{
+    int i = sp->pace_index;
+    struct iperf_stream *last;
+
+    sp->pace_index = -1;
+    if (pc == NULL || i < 0 || i >= pc->heap_len || pc->heap[i] != sp)
+	return;
+    last = pc->heap[--pc->heap_len];
+    if (i == pc->heap_len)
+	return;
+    heap_set(pc, i, last);
+    heap_up(pc, i);
+    heap_down(pc, last->pace_index);
+}
+
+/*
+ * Called after every pass of the event loop: let the loop's throttled
+ * senders whose time has come go if they are back in credit, and work
+ * out when the first of the others will be.
+ */
+void
+iperf_pacing_run(struct iperf_pacing *pc, struct iperf_event_loop *loop)
+{
+    struct iperf_stream *sp;
+    struct iperf_time now;
+    int pending;
+
+    if (pc->driver == IPERF_PACING_TIMER)
+	return;
+
+#if defined(HAVE_TIMERFD)
+    if (pc->tfd >= 0 && iperf_event_is_ready(loop, pc->tfd, IPERF_EV_READ)) {
+	uint64_t expirations;
+
+	(void) read(pc->tfd, &expirations, sizeof(expirations));
+	iperf_event_clear_ready(loop, pc->tfd, IPERF_EV_READ);
+    }
+#endif /* HAVE_TIMERFD */
+
+    iperf_time_now(&now);
+    while (pc->heap_len > 0) {
+	sp = pc->heap[0];
+	if (iperf_time_compare(&sp->pace_due, &now) > 0)
+	    break;
+	iperf_pacing_cancel(pc, sp);
+	iperf_check_throttle(sp, &now);
+	/* Still short (the wait is rounded): due again when the bucket says. */
+	if (!sp->green_light && !sp->test->done) {
+	    sp->pace_due = now;
+	    iperf_time_add_nsecs(&sp->pace_due, iperf_pacer_wait(&sp->pacer));
+	    (void) iperf_pacing_defer(pc, sp);	/* its slot was just freed */
+	}
+    }
+    pending = pc->heap_len > 0;
+    if (pending)
+	pc->due = pc->heap[0]->pace_due;
+    pc->pending = pending;
+
+#if defined(HAVE_TIMERFD)
+    if (pc->tfd >= 0 && (pending ? iperf_time_compare(&pc->due, &pc->armed) != 0 : pc->armed.secs != 0)) {
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	if (pending) {
+	    its.it_value.tv_sec = pc->due.secs;
+	    its.it_value.tv_nsec = pc->due.nsecs;
+	    pc->armed = pc->due;
+	} else
+	    memset(&pc->armed, 0, sizeof(pc->armed));
+	(void) timerfd_settime(pc->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+    }
+#endif /* HAVE_TIMERFD */
+}
+
+/*
+ * Shorten an event loop timeout for the spin driver: sleep until
+ * IPERF_PACING_SPIN_USECS before the next stream is due, then poll.
+ */
+struct timeval *
+iperf_pacing_timeout(struct iperf_pacing *pc, struct timeval *timeout)
+{
+    struct iperf_time now, left;
+    uint64_t usecs;
+
+    if (pc->driver != IPERF_PACING_SPIN || !pc->pending)
+	return timeout;
+    iperf_time_now(&now);
+    if (iperf_time_diff(&pc->due, &now, &left))
+	usecs = 0;
+    else {
+	usecs = iperf_time_in_usecs(&left);
+	usecs = usecs > IPERF_PACING_SPIN_USECS ? usecs - IPERF_PACING_SPIN_USECS : 0;
+    }
+    /*
+     * epoll only sleeps in whole milliseconds, rounded up, so cover the
+     * sub-millisecond remainder with nanosleep (timer slack is 1 ns) and
+     * hand the event loop whole milliseconds or a zero timeout.
+     */
+    if (usecs < 1000) {
+	if (usecs > 0) {
+	    struct timespec ts;
+
+	    ts.tv_sec = 0;
+	    ts.tv_nsec = usecs * 1000;
+	    nanosleep(&ts, NULL);
+	}
+	usecs = 0;
+    } else
+	usecs -= usecs % 1000;
+    if (timeout != NULL && (uint64_t) timeout->tv_sec * 1000000 + timeout->tv_usec < usecs)
+	return timeout;
+    pc->tv.tv_sec = usecs / 1000000;
+    pc->tv.tv_usec = usecs % 1000000;
+    return &pc->tv;
+}
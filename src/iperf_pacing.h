@@ -0,0 +1,87 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_PACING_H
+#define __IPERF_PACING_H
+
+#include <sys/time.h>
+
+#include "iperf_time.h"
+
+struct iperf_test;
+struct iperf_stream;
+struct iperf_event_loop;
+
+/*
+ * Pacing drivers decide when a -b sender whose token bucket is empty
+ * gets woken up again.  The default uses a periodic timer per stream
+ * (--pacing-timer).  The precise drivers instead wake each event loop
+ * exactly when the first of its streams comes back into credit: by
+ * arming a timerfd at that absolute time, or by sleeping until shortly
+ * before it and then polling.
+ */
+#define IPERF_PACING_TIMER	0
+#define IPERF_PACING_TIMERFD	1
+#define IPERF_PACING_SPIN	2
+
+#define IPERF_PACING_SPIN_USECS	50	/* spin driver: poll for the last 50 us */
+
+/*
+ * The loop's throttled senders wait in a 4-ary min-heap on pace_due
+ * (each stream knows its place, as timers do), so a pass of the loop
+ * only looks at the ones that are due rather than at every sender.
+ */
+struct iperf_pacing
+{
+    int       driver;
+    int       tfd;			/* IPERF_PACING_TIMERFD: the timerfd */
+    int       pending;			/* a stream is waiting for credit */
+    struct iperf_time due;		/* ... until this time */
+    struct iperf_time armed;		/* time the timerfd is set for */
+    struct timeval tv;			/* returned by iperf_pacing_timeout() */
+    struct iperf_stream **heap;		/* throttled streams, earliest pace_due first */
+    int       heap_len;
+    int       heap_size;
+};
+
+int iperf_pacing_driver_parse(const char *name);
+const char *iperf_pacing_driver_name(int driver);
+int iperf_pacing_driver_supported(int driver);
+
+int iperf_pacing_init(struct iperf_pacing *pc, int driver, struct iperf_event_loop *loop);
+void iperf_pacing_free(struct iperf_pacing *pc, struct iperf_event_loop *loop);
+void iperf_pacing_run(struct iperf_pacing *pc, struct iperf_event_loop *loop);
+
+/*
+ * iperf_pacing_defer -- have the loop wake sp once its pace_due comes.
+ * iperf_pacing_cancel -- take sp back out, if it is waiting.
+ * iperf_pacing_defer returns 0, or -1 if there's no memory for it.
+ */
+int iperf_pacing_defer(struct iperf_pacing *pc, struct iperf_stream *sp);
+void iperf_pacing_cancel(struct iperf_pacing *pc, struct iperf_stream *sp);
+struct timeval *iperf_pacing_timeout(struct iperf_pacing *pc, struct timeval *timeout);
+
+#endif /* __IPERF_PACING_H */
@@ -0,0 +1,263 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+#include "iperf_config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_payload.h"
+#include "iperf_util.h"
+
+/* Ask for 2 MB pages even where the default huge page size is 1 GB. */
+#if defined(MAP_HUGETLB) && !defined(MAP_HUGE_2MB) && defined(MAP_HUGE_SHIFT)
+# define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif /* MAP_HUGETLB && !MAP_HUGE_2MB && MAP_HUGE_SHIFT */
+
+struct iperf_payload_pool *
+iperf_payload_pool_new(struct iperf_test *test)
+{
+    struct iperf_payload_pool *pool;
+    size_t size = test->settings->blksize;
+    void *payload;
+    int pages;
+
+    pool = (struct iperf_payload_pool *) calloc(1, sizeof(*pool));
+    if (pool == NULL)
+	return NULL;
+    pool->size = size;
+    pool->fd = -1;
+    pool->huge = test->settings->hugepages;
+
+    if (test->zerocopy) {
+#if defined(HAVE_MEMFD_CREATE)
+	pool->fd = memfd_create("iperf3-payload", MFD_CLOEXEC);
+	if (pool->fd >= 0 && ftruncate(pool->fd, size) < 0) {
+	    close(pool->fd);
+	    pool->fd = -1;
+	}
+#endif /* HAVE_MEMFD_CREATE */
+	if (pool->fd < 0 && (pool->fd = iperf_payload_tempfile(test, size)) < 0)
+	    goto fail;
+	/*
+	 * Shared, so that sendfile() sends what we fill it with.  (This
+	 * stays on regular pages: hugetlbfs files can't be sendfile()d.)
+	 */
+	payload = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, pool->fd, 0);
+	if (payload == MAP_FAILED)
+	    goto fail;
+	pool->payload = payload;
+	++test->buffer_pages[IPERF_PAGES_PLAIN];
+    } else if ((pool->payload = iperf_payload_map(size, pool->huge, &pages)) == NULL)
+	goto fail;
+    else
+	++test->buffer_pages[pages];
+
+    if (test->repeating_payload)
+	fill_with_repeating_pattern(pool->payload, size);
+    else if (readentropy(pool->payload, size) < 0)
+	goto fail;
+    /* Catch any sender that writes into what the others are sending. */
+    (void) mprotect(pool->payload, pool->fd >= 0 ? size : iperf_payload_mapsize(size, pool->huge), PROT_READ);
+
+    if ((pool->scratch = iperf_payload_map(size, pool->huge, &pages)) == NULL)
+	goto fail;
+    ++test->buffer_pages[pages];
+    return pool;
+
+fail:
+    iperf_payload_pool_free(pool);
+    return NULL;
+}
+
+void
+iperf_payload_pool_free(struct iperf_payload_pool *pool)
+{
+    if (pool == NULL)
+	return;
+    if (pool->payload != NULL) {
+	if (pool->fd >= 0)
+	    munmap(pool->payload, pool->size);
+	else
+	    iperf_payload_unmap(pool->payload, pool->size, pool->huge);
+    }
+    if (pool->scratch != NULL)
+	iperf_payload_unmap(pool->scratch, pool->size, pool->huge);
+    if (pool->fd >= 0)
+	close(pool->fd);
+    free(pool);
+}
+
+/*
+ * Streams that write into their buffer before sending it (UDP
+ * headers, -F file data) or that read into it what they send back
+ * (--rr, --crr) keep a private one; so do RUTP streams.
+ */
+int
+iperf_payload_kind(struct iperf_test *test, int sender)
+{
+    int id = test->protocol->id;
+
+    if (test->settings->rr_request)
+	return IPERF_BUFFER_PRIVATE;
+    if (sender)
+	return (id == Ptcp || id == Psctp) && test->diskfile_name == NULL ?
+	    IPERF_BUFFER_PAYLOAD : IPERF_BUFFER_PRIVATE;
+    return id == Ptcp || id == Pudp || id == Psctp ?
+	IPERF_BUFFER_SCRATCH : IPERF_BUFFER_PRIVATE;
+}
+
+int
+iperf_payload_tempfile(struct iperf_test *test, size_t size)
+{
+    char template[1024];
+    char *tempdir;
+    int fd;
+
+    if (test->tmp_template) {
+        snprintf(template, sizeof(template) / sizeof(char), "%s", test->tmp_template);
+    } else {
+        //find the system temporary dir *unix, windows, cygwin support
+        tempdir = getenv("TMPDIR");
+        if (tempdir == 0){
+            tempdir = getenv("TEMP");
+        }
+        if (tempdir == 0){
+            tempdir = getenv("TMP");
+        }
+        if (tempdir == 0){
+            tempdir = "/tmp";
+        }
+        snprintf(template, sizeof(template) / sizeof(char), "%s/iperf3.XXXXXX", tempdir);
+    }
+
+    fd = mkstemp(template);
+    if (fd == -1)
+	return -1;
+    if (unlink(template) < 0 || ftruncate(fd, size) < 0) {
+	close(fd);
+	return -1;
+    }
+    return fd;
+}
+
+int
+has_hugepages(void)
+{
+#if defined(MAP_HUGETLB) || defined(MADV_HUGEPAGE)
+    return 1;
+#else /* MAP_HUGETLB || MADV_HUGEPAGE */
+    return 0;
+#endif /* MAP_HUGETLB || MADV_HUGEPAGE */
+}
+
+size_t
+iperf_payload_mapsize(size_t size, int huge)
+{
+    if (!huge)
+	return size;
+    return (size + IPERF_HUGE_PAGE_SIZE - 1) / IPERF_HUGE_PAGE_SIZE * IPERF_HUGE_PAGE_SIZE;
+}
+
+#if defined(MADV_HUGEPAGE)
+/* Whether madvise(MADV_HUGEPAGE) can get us anything at all. */
+static int
+thp_enabled(void)
+{
+    static int enabled = -1;
+    char line[128];
+    FILE *fp;
+
+    if (enabled < 0) {
+	enabled = 1;
+	if ((fp = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r")) != NULL) {
+	    if (fgets(line, sizeof(line), fp) != NULL && strstr(line, "[never]") != NULL)
+		enabled = 0;
+	    fclose(fp);
+	}
+    }
+    return enabled;
+}
+#endif /* MADV_HUGEPAGE */
+
+char *
+iperf_payload_map(size_t size, int huge, int *pages)
+{
+    size_t len = iperf_payload_mapsize(size, huge);
+    size_t head;
+    char *p;
+
+    if (pages != NULL)
+	*pages = IPERF_PAGES_PLAIN;
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_2MB)
+    if (huge) {
+	p = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|MAP_HUGE_2MB, -1, 0);
+	if (p != MAP_FAILED) {
+	    if (pages != NULL)
+		*pages = IPERF_PAGES_HUGETLB;
+	    return p;
+	}
+    }
+#endif /* MAP_HUGETLB && MAP_HUGE_2MB */
+    if (!huge) {
+	p = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	return p == MAP_FAILED ? NULL : p;
+    }
+
+    /*
+     * A THP can only back a 2 MB aligned range, so map a huge page
+     * more than we need and trim it to an aligned start.
+     */
+    p = mmap(NULL, len + IPERF_HUGE_PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+	return NULL;
+    head = (IPERF_HUGE_PAGE_SIZE - (uintptr_t) p % IPERF_HUGE_PAGE_SIZE) % IPERF_HUGE_PAGE_SIZE;
+    if (head != 0)
+	munmap(p, head);
+    munmap(p + head + len, IPERF_HUGE_PAGE_SIZE - head);
+    p += head;
+#if defined(MADV_HUGEPAGE)
+    /* No reserved huge pages: let khugepaged and faults use THP. */
+    if (madvise(p, len, MADV_HUGEPAGE) == 0 && thp_enabled() && pages != NULL)
+	*pages = IPERF_PAGES_THP;
+#endif /* MADV_HUGEPAGE */
+    return p;
+}
+
+void
+iperf_payload_unmap(char *p, size_t size, int huge)
+{
+    munmap(p, iperf_payload_mapsize(size, huge));
+}
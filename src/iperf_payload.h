@@ -0,0 +1,85 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_PAYLOAD_H
+#define __IPERF_PAYLOAD_H
+
+#include <stddef.h>
+
+struct iperf_test;
+
+/* Where a stream's buffer (sp->buffer_kind) comes from */
+#define IPERF_BUFFER_PRIVATE	0	/* mapped for the stream alone */
+#define IPERF_BUFFER_PAYLOAD	1	/* the pool's read-only payload */
+#define IPERF_BUFFER_SCRATCH	2	/* the pool's (or a worker's) scratch block */
+
+/* What iperf_payload_map() got for a --hugepages mapping */
+#define IPERF_PAGES_PLAIN	0	/* regular pages */
+#define IPERF_PAGES_THP		1	/* madvise(MADV_HUGEPAGE): transparent huge pages */
+#define IPERF_PAGES_HUGETLB	2	/* MAP_HUGETLB: reserved huge pages */
+
+#define IPERF_HUGE_PAGE_SIZE	(2 * 1024 * 1024)
+
+/*
+ * The blocks that a test's streams share instead of each mapping its
+ * own: one payload, filled once and then read-only, for senders that
+ * never write into their buffer, and one scratch block that receivers
+ * read into and throw away.  The payload only has a file descriptor
+ * (a memfd, or else an unlinked temporary file) when -Z needs one to
+ * sendfile() from.
+ */
+struct iperf_payload_pool
+{
+    size_t    size;
+    char     *payload;
+    int       fd;		/* backs the payload for -Z, or -1 */
+    char     *scratch;
+    int       huge;		/* payload (unless fd-backed) and scratch mapped for --hugepages */
+};
+
+struct iperf_payload_pool *iperf_payload_pool_new(struct iperf_test *test);
+void iperf_payload_pool_free(struct iperf_payload_pool *pool);
+
+/* Which IPERF_BUFFER_* a new sending or receiving stream should use. */
+int iperf_payload_kind(struct iperf_test *test, int sender);
+
+/* An unlinked temporary file of size bytes, or -1. */
+int iperf_payload_tempfile(struct iperf_test *test, size_t size);
+
+int has_hugepages(void);
+
+/*
+ * A private read-write mapping of size bytes, or NULL.  With huge set
+ * it is rounded up to whole 2 MB pages, taken from MAP_HUGETLB if any
+ * are reserved and else aligned and advised to be transparent huge
+ * pages; *pages (if not NULL) says which.  Unmap it with the same size
+ * and huge.
+ */
+char *iperf_payload_map(size_t size, int huge, int *pages);
+void iperf_payload_unmap(char *p, size_t size, int huge);
+size_t iperf_payload_mapsize(size_t size, int huge);
+
+#endif /* __IPERF_PAYLOAD_H */
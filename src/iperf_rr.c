@@ -0,0 +1,126 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_event.h"
+#include "iperf_histogram.h"
+#include "iperf_rr.h"
+#include "net.h"
+
+/* Size of the message this end of a stream writes, and of the one it reads. */
+#define RR_OUT(sp) ((sp)->sender ? (sp)->settings->rr_request : (sp)->settings->rr_response)
+#define RR_IN(sp) ((sp)->sender ? (sp)->settings->rr_response : (sp)->settings->rr_request)
+
+/* Point the stream's event loop interest at writing, or at reading. */
+static int
+rr_turn(struct iperf_stream *sp, int writing)
+{
+    sp->rr_writing = writing;
+    if (iperf_event_mod(sp->event_loop, sp->socket,
+			writing ? IPERF_EV_WRITE : IPERF_EV_READ,
+			writing ? IPERF_EV_READ : IPERF_EV_WRITE) < 0)
+	return NET_HARDERROR;
+    return 0;
+}
+
+int
+iperf_rr_send(struct iperf_stream *sp)
+{
+    int size = RR_OUT(sp);
+    int n, r;
+
+    if (!sp->rr_writing)
+	return 0;
+    if (sp->sender && sp->rr_done == 0)
+	iperf_time_now(&sp->rr_start);
+
+    n = size - sp->rr_done;
+    if (n > sp->settings->blksize)
+	n = sp->settings->blksize;
+    r = Nwrite(sp->socket, sp->buffer, n, Ptcp);
+    if (r < 0)
+	return r;
+    sp->rr_done += r;
+    if (sp->test->state == TEST_RUNNING)
+	sp->result->bytes_sent += r;
+
+    if (sp->rr_done == size) {
+	sp->rr_done = 0;
+	if (rr_turn(sp, 0) < 0)
+	    return NET_HARDERROR;
+    }
+    return r;
+}
+
+int
+iperf_rr_recv(struct iperf_stream *sp)
+{
+    int size = RR_IN(sp);
+    int n, r;
+    struct iperf_time now, rtt;
+
+    if (sp->rr_writing)
+	return 0;
+
+    n = size - sp->rr_done;
+    if (n > sp->settings->blksize)
+	n = sp->settings->blksize;
+    r = Nread(sp->socket, sp->buffer, n, Ptcp);
+    if (r <= 0)
+	return r;
+    sp->rr_done += r;
+    if (sp->test->state == TEST_RUNNING)
+	sp->result->bytes_received += r;
+    if (sp->rr_done < size)
+	return r;
+    sp->rr_done = 0;
+
+    if (sp->sender) {
+	/* A whole transaction: the client's next request goes out from the send path. */
+	if (sp->rr_rtt != NULL && sp->test->state == TEST_RUNNING) {
+	    iperf_time_now(&now);
+	    iperf_time_diff(&now, &sp->rr_start, &rtt);
+	    iperf_histogram_record(sp->rr_rtt, iperf_time_in_nsecs(&rtt));
+	}
+	if (rr_turn(sp, 1) < 0)
+	    return NET_HARDERROR;
+	return r;
+    }
+
+    /*
+     * The server answers at once, and only waits for the socket to
+     * become writable if the response doesn't go out in one write.
+     */
+    sp->rr_writing = 1;
+    if (iperf_rr_send(sp) < 0)
+	return NET_HARDERROR;
+    if (sp->rr_writing && rr_turn(sp, 1) < 0)
+	return NET_HARDERROR;
+    return r;
+}
@@ -0,0 +1,46 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_RR_H
+#define __IPERF_RR_H
+
+struct iperf_stream;
+
+/*
+ * TCP request/response (--rr) streams.  Each client stream writes a
+ * request of rr_request bytes and then reads a response of rr_response
+ * bytes, which the server stream writes as soon as it has read the
+ * whole request; the client records the time from the start of the
+ * request to the end of the response as one transaction.  A stream is
+ * only ever writing or reading, and moves its event loop interest
+ * between IPERF_EV_WRITE and IPERF_EV_READ to match.
+ */
+
+/* Stream snd/rcv routines; both return bytes moved or a NET_ error. */
+int iperf_rr_send(struct iperf_stream *sp);
+int iperf_rr_recv(struct iperf_stream *sp);
+
+#endif /* __IPERF_RR_H */
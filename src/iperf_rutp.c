@@ -44,6 +44,7 @@
 #include "iperf_api.h"
 #include "iperf_util.h"
 #include "iperf_rutp.h"
+#include "iperf_udp.h"
 #include "timer.h"
 #include "net.h"
 #include "cjson.h"
@@ -165,143 +166,47 @@ static char
 int
 iperf_rutp_recv(struct iperf_stream *sp)
 {
-    char *ptr;
-    uint32_t  sec, usec;
-    uint64_t  pcount;
-    int       r;
+    char     *buf, *ptr;
+    int       lens[NET_MAX_BATCH];
     int       size = sp->settings->blksize;
-    int       first_packet = 0;
-    double    transit = 0, d = 0;
-    struct iperf_time sent_time, arrival_time, temp_time;
+    int       n, i, r = 0;
+    struct iperf_time arrival_time;
 
-    r = Nread(sp->socket, sp->buffer, size, Pudp);
+    if (sp->settings->udp_batch > 1) {
+	if ((buf = iperf_udp_batch_buffer(sp)) == NULL)
+	    return NET_HARDERROR;
+	n = Nread_batch(sp->socket, buf, size, sp->settings->udp_batch, lens, NULL);
+    } else {
+	buf = sp->buffer;
+	lens[0] = Nread(sp->socket, buf, size, Pudp);
+	n = lens[0] > 0 ? 1 : lens[0];
+    }
 
     /*
      * If we got an error in the read, or if we didn't read anything
      * because the underlying read(2) got a EAGAIN, then skip packet
      * processing.
      */
-    if (r <= 0)
-        return r;
-
-    /* Only count bytes received while we're in the correct state. */
-    if (sp->test->state == TEST_RUNNING) {
-
-	/*
-	 * For jitter computation below, it's important to know if this
-	 * packet is the first packet received.
-	 */
-	if (sp->result->bytes_received == 0) {
-	    first_packet = 1;
+    if (n <= 0)
+        return n;
+
+    iperf_time_now(&arrival_time);
+    for (i = 0; i < n; ++i) {
+	r += lens[i];
+
+	/* Only count bytes received while we're in the correct state. */
+	if (sp->test->state != TEST_RUNNING) {
+	    if (sp->test->debug)
+		printf("Late receive, state = %d\n", sp->test->state);
+	    continue;
 	}
 
-	sp->result->bytes_received += r;
-	sp->result->bytes_received_this_interval += r;
-
-    ptr = iperf_rutp_parse_packet(sp, sp->buffer, r);
-    if (!ptr) {
-        return r;
-    }
-    
-	/* Dig the various counters out of the incoming UDP packet */
-	if (sp->test->udp_counters_64bit) {
-	    memcpy(&sec, ptr, sizeof(sec));
-	    memcpy(&usec, ptr+4, sizeof(usec));
-	    memcpy(&pcount, ptr+8, sizeof(pcount));
-	    sec = ntohl(sec);
-	    usec = ntohl(usec);
-	    pcount = be64toh(pcount);
-	    sent_time.secs = sec;
-	    sent_time.usecs = usec;
+	ptr = iperf_rutp_parse_packet(sp, buf + (size_t) i * size, lens[i]);
+	if (!ptr) {
+	    sp->result->bytes_received += lens[i];
+	    continue;
 	}
-	else {
-	    uint32_t pc;
-	    memcpy(&sec, ptr, sizeof(sec));
-	    memcpy(&usec, ptr+4, sizeof(usec));
-	    memcpy(&pc, ptr+8, sizeof(pc));
-	    sec = ntohl(sec);
-	    usec = ntohl(usec);
-	    pcount = ntohl(pc);
-	    sent_time.secs = sec;
-	    sent_time.usecs = usec;
-	}
-
-	if (sp->test->debug)
-	    fprintf(stderr, "pcount %" PRIu64 " packet_count %d\n", pcount, sp->packet_count);
-
-	/*
-	 * Try to handle out of order packets.  The way we do this
-	 * uses a constant amount of storage but might not be
-	 * correct in all cases.  In particular we seem to have the
-	 * assumption that packets can't be duplicated in the network,
-	 * because duplicate packets will possibly cause some problems here.
-	 *
-	 * First figure out if the sequence numbers are going forward.
-	 * Note that pcount is the sequence number read from the packet,
-	 * and sp->packet_count is the highest sequence number seen so
-	 * far (so we're expecting to see the packet with sequence number
-	 * sp->packet_count + 1 arrive next).
-	 */
-	if (pcount >= sp->packet_count + 1) {
-
-	    /* Forward, but is there a gap in sequence numbers? */
-	    if (pcount > sp->packet_count + 1) {
-		/* There's a gap so count that as a loss. */
-		sp->cnt_error += (pcount - 1) - sp->packet_count;
-	    }
-	    /* Update the highest sequence number seen so far. */
-	    sp->packet_count = pcount;
-	} else {
-
-	    /* 
-	     * Sequence number went backward (or was stationary?!?).
-	     * This counts as an out-of-order packet.
-	     */
-	    sp->outoforder_packets++;
-
-	    /*
-	     * If we have lost packets, then the fact that we are now
-	     * seeing an out-of-order packet offsets a prior sequence
-	     * number gap that was counted as a loss.  So we can take
-	     * away a loss.
-	     */
-	    if (sp->cnt_error > 0)
-		sp->cnt_error--;
-	
-	    /* Log the out-of-order packet */
-	    if (sp->test->debug) 
-		fprintf(stderr, "OUT OF ORDER - incoming packet sequence %" PRIu64 " but expected sequence %d on stream %d", pcount, sp->packet_count + 1, sp->socket);
-	}
-
-	/*
-	 * jitter measurement
-	 *
-	 * This computation is based on RFC 1889 (specifically
-	 * sections 6.3.1 and A.8).
-	 *
-	 * Note that synchronized clocks are not required since
-	 * the source packet delta times are known.  Also this
-	 * computation does not require knowing the round-trip
-	 * time.
-	 */
-	iperf_time_now(&arrival_time);
-
-	iperf_time_diff(&arrival_time, &sent_time, &temp_time);
-	transit = iperf_time_in_secs(&temp_time);
-
-	/* Hack to handle the first packet by initializing prev_transit. */
-	if (first_packet)
-	    sp->prev_transit = transit;
-
-	d = transit - sp->prev_transit;
-	if (d < 0)
-	    d = -d;
-	sp->prev_transit = transit;
-	sp->jitter += (d - sp->jitter) / 16.0;
-    }
-    else {
-	if (sp->test->debug)
-	    printf("Late receive, state = %d\n", sp->test->state);
+	iperf_udp_account(sp, ptr, lens[i], &arrival_time);
     }
 
     return r;
@@ -316,54 +221,44 @@ int
 iperf_rutp_send(struct iperf_stream *sp)
 {
     int r;
-    char *ret;
+    char *buf, *ret;
     int       size = sp->settings->blksize;
+    int       n = 1, i;
     struct iperf_time before;
 
-    iperf_time_now(&before);
-
-    ++sp->packet_count;
+    if (sp->settings->udp_batch > 1) {
+	n = sp->settings->udp_batch;
+	if ((buf = iperf_udp_batch_buffer(sp)) == NULL)
+	    return NET_HARDERROR;
+    } else
+	buf = sp->buffer;
 
-    ret = iperf_rutp_make_packet((uint64_t)sp->socket, sp->buffer, sp->settings->blksize, 
-                                    &sp->test->rutp_server);
-    if (!ret) {
-        return -1;
-    }
-    if (sp->test->udp_counters_64bit) {
-
-    	uint32_t  sec, usec;
-    	uint64_t  pcount;
+    iperf_time_now(&before);
 
-    	sec = htonl(before.secs);
-    	usec = htonl(before.usecs);
-    	pcount = htobe64(sp->packet_count);
-    	
-    	memcpy(ret, &sec, sizeof(sec));
-    	memcpy(ret+4, &usec, sizeof(usec));
-    	memcpy(ret+8, &pcount, sizeof(pcount));
-	
+    for (i = 0; i < n; ++i) {
+	ret = iperf_rutp_make_packet((uint64_t)sp->socket, buf + (size_t) i * size, size,
+				     &sp->test->rutp_server);
+	if (!ret) {
+	    return -1;
+	}
+	iperf_udp_put_header(sp, ret, &before);
     }
-    else {
-
-    	uint32_t  sec, usec, pcount;
 
-    	sec = htonl(before.secs);
-    	usec = htonl(before.usecs);
-    	pcount = htonl(sp->packet_count);
-    	
-    	memcpy(ret, &sec, sizeof(sec));
-    	memcpy(ret+4, &usec, sizeof(usec));
-    	memcpy(ret+8, &pcount, sizeof(pcount));
-	
+    if (n > 1) {
+	r = Nwrite_batch(sp->socket, buf, size, n, NULL);
+	if (r < 0) {
+	    sp->packet_count -= n;
+	    return r;
+	}
+	sp->packet_count -= n - r;
+	r *= size;
+    } else {
+	r = Nwrite(sp->socket, buf, size, Pudp);
+	if (r < 0)
+	    return r;
     }
 
-    r = Nwrite(sp->socket, sp->buffer, size, Pudp);
-
-    if (r < 0)
-	return r;
-
     sp->result->bytes_sent += r;
-    sp->result->bytes_sent_this_interval += r;
 
     if (sp->test->debug)
 	printf("sent %d bytes of %d, total %" PRIu64 "\n", r, sp->settings->blksize, sp->result->bytes_sent);
@@ -556,8 +451,10 @@ iperf_rutp_accept(struct iperf_test *test)
         return -1;
     }
 
-    FD_SET(test->prot_listener, &test->read_set);
-    test->max_fd = (test->max_fd < test->prot_listener) ? test->prot_listener : test->max_fd;
+    if (iperf_event_add(test->event_loop, test->prot_listener, IPERF_EV_READ, NULL) < 0) {
+        i_errno = IEEVENTLOOP;
+        return -1;
+    }
 
     /* Let the client know we're ready "accept" another UDP "stream" */
     //buf = 987654321;		/* any content will work here */
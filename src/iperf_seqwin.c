@@ -0,0 +1,131 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "iperf_seqwin.h"
+
+/*
+ * Make a window of at least size datagrams (rounded up to a power of
+ * two).  Sequence numbers are expected to start at 1.
+ */
+struct iperf_seqwin *
+iperf_seqwin_new(uint64_t size)
+{
+    struct iperf_seqwin *w;
+    uint64_t n = IPERF_SEQWIN_MIN;
+
+    while (n < size && n < IPERF_SEQWIN_MAX)
+	n <<= 1;
+    w = (struct iperf_seqwin *) calloc(1, sizeof(struct iperf_seqwin));
+    if (w == NULL)
+	return NULL;
+    w->bits = (uint64_t *) calloc(n / 64, sizeof(uint64_t));
+    if (w->bits == NULL) {
+	free(w);
+	return NULL;
+    }
+    w->size = n;
+    w->top = 1;
+    return w;
+}
+
+void
+iperf_seqwin_free(struct iperf_seqwin *w)
+{
+    if (w == NULL)
+	return;
+    free(w->bits);
+    free(w);
+}
+
+/* Clear the bits of sequence numbers [from, to), which are less than size apart. */
+static void
+clear_range(struct iperf_seqwin *w, uint64_t from, uint64_t to)
+{
+    uint64_t mask = w->size - 1;
+    uint64_t i, end, word;
+
+    while (from < to) {
+	i = from & mask;
+	word = i / 64;
+	/* end of this run: the word boundary, the wrap, or to */
+	end = from + (64 - (i % 64));
+	if (end > to)
+	    end = to;
+	if (end - from == 64)
+	    w->bits[word] = 0;
+	else
+	    w->bits[word] &= ~(((((uint64_t) 1) << (end - from)) - 1) << (i % 64));
+	from = end;
+    }
+}
+
+/*
+ * Classify sequence number seq and mark it seen.  For a reordered
+ * datagram *distance is how far it is behind the highest one seen.
+ */
+enum iperf_seq_class
+iperf_seqwin_update(struct iperf_seqwin *w, uint64_t seq, uint64_t *distance)
+{
+    uint64_t i = seq & (w->size - 1);
+    uint64_t bit = ((uint64_t) 1) << (i % 64);
+
+    if (seq >= w->top) {
+	/* Slide forward, forgetting what falls out of the window */
+	if (seq - w->top >= w->size)
+	    memset(w->bits, 0, w->size / 8);
+	else
+	    clear_range(w, w->top, seq);
+	w->bits[i / 64] |= bit;
+	w->top = seq + 1;
+	w->unique++;
+	return IPERF_SEQ_NEW;
+    }
+    if (w->top - seq > w->size)
+	return IPERF_SEQ_LATE;
+    if (w->bits[i / 64] & bit)
+	return IPERF_SEQ_DUPLICATE;
+    w->bits[i / 64] |= bit;
+    w->unique++;
+    if (distance != NULL)
+	*distance = w->top - 1 - seq;
+    return IPERF_SEQ_REORDERED;
+}
+
+/* Histogram bucket of a reorder distance: floor(log2(distance)). */
+int
+iperf_seqwin_dist_bucket(uint64_t distance)
+{
+    int b = 0;
+
+    while (distance > 1 && b < IPERF_SEQWIN_DIST_BUCKETS - 1) {
+	distance >>= 1;
+	++b;
+    }
+    return b;
+}
@@ -0,0 +1,69 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_SEQWIN_H
+#define __IPERF_SEQWIN_H
+
+#include <stdint.h>
+
+/*
+ * Sliding receive window over datagram sequence numbers, one bit per
+ * sequence number in [top - size, top).  Each arriving sequence number
+ * is classified as new (at or beyond top), reordered (an unset bit
+ * inside the window), duplicate (a set bit) or late (below the window,
+ * where we can no longer tell).  Work per datagram is O(1) amortized:
+ * moving the window forward clears each bit once, a word at a time.
+ */
+#define IPERF_SEQWIN_DEFAULT	65536		/* default window, in datagrams */
+#define IPERF_SEQWIN_MIN	64
+#define IPERF_SEQWIN_MAX	(1 << 24)
+#define IPERF_SEQWIN_DIST_BUCKETS 25		/* reorder distances 2^i..2^(i+1)-1 */
+
+enum iperf_seq_class {
+    IPERF_SEQ_NEW = 0,
+    IPERF_SEQ_REORDERED,
+    IPERF_SEQ_DUPLICATE,
+    IPERF_SEQ_LATE
+};
+
+struct iperf_seqwin
+{
+    uint64_t *bits;
+    uint64_t  size;		/* window, in datagrams (a power of two) */
+    uint64_t  top;		/* one past the highest sequence number seen */
+    uint64_t  unique;		/* distinct sequence numbers seen */
+};
+
+struct iperf_seqwin *iperf_seqwin_new(uint64_t size);
+void iperf_seqwin_free(struct iperf_seqwin *w);
+enum iperf_seq_class iperf_seqwin_update(struct iperf_seqwin *w, uint64_t seq, uint64_t *distance);
+int iperf_seqwin_dist_bucket(uint64_t distance);
+
+/* Highest sequence number seen, and how many below it never arrived */
+#define iperf_seqwin_highest(w)	((w)->top - 1)
+#define iperf_seqwin_lost(w)	((w)->top - 1 - (w)->unique)
+
+#endif /* __IPERF_SEQWIN_H */
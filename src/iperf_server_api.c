@@ -55,6 +55,8 @@
 #include "iperf_util.h"
 #include "timer.h"
 #include "iperf_time.h"
+#include "iperf_worker.h"
+#include "iperf_crr.h"
 #include "net.h"
 #include "units.h"
 #include "iperf_util.h"
@@ -94,10 +96,12 @@ iperf_server_listen(struct iperf_test *test)
 	    iflush(test);
     }
 
-    FD_ZERO(&test->read_set);
-    FD_ZERO(&test->write_set);
-    FD_SET(test->listener, &test->read_set);
-    if (test->listener > test->max_fd) test->max_fd = test->listener;
+    if (iperf_init_event_loop(test) < 0)
+        return -1;
+    if (iperf_event_add(test->event_loop, test->listener, IPERF_EV_READ, NULL) < 0) {
+        i_errno = IEEVENTLOOP;
+        return -1;
+    }
 
     return 0;
 }
@@ -130,8 +134,10 @@ iperf_accept(struct iperf_test *test)
             i_errno = IERECVCOOKIE;
             return -1;
         }
-	FD_SET(test->ctrl_sck, &test->read_set);
-	if (test->ctrl_sck > test->max_fd) test->max_fd = test->ctrl_sck;
+	if (iperf_event_add(test->event_loop, test->ctrl_sck, IPERF_EV_READ, NULL) < 0) {
+	    i_errno = IEEVENTLOOP;
+	    return -1;
+	}
 
 	if (iperf_set_send_state(test, PARAM_EXCHANGE) != 0)
             return -1;
@@ -183,11 +189,11 @@ iperf_handle_message_server(struct iperf_test *test)
             break;
         case TEST_END:
 	    test->done = 1;
+	    iperf_stop_workers(test);
             cpu_util(test->cpu_util);
             test->stats_callback(test);
             SLIST_FOREACH(sp, &test->streams, streams) {
-                FD_CLR(sp->socket, &test->read_set);
-                FD_CLR(sp->socket, &test->write_set);
+                iperf_event_del(test->event_loop, sp->socket, IPERF_EV_READ | IPERF_EV_WRITE | IPERF_EV_ERROR);
                 close(sp->socket);
             }
             test->reporter_callback(test);
@@ -208,6 +214,7 @@ iperf_handle_message_server(struct iperf_test *test)
 	    // Temporarily be in DISPLAY_RESULTS phase so we can get
 	    // ending summary statistics.
 	    signed char oldstate = test->state;
+	    iperf_stop_workers(test);
 	    cpu_util(test->cpu_util);
 	    test->state = DISPLAY_RESULTS;
 	    test->reporter_callback(test);
@@ -216,8 +223,7 @@ iperf_handle_message_server(struct iperf_test *test)
             // XXX: Remove this line below!
 	    iperf_err(test, "the client has terminated");
             SLIST_FOREACH(sp, &test->streams, streams) {
-                FD_CLR(sp->socket, &test->read_set);
-                FD_CLR(sp->socket, &test->write_set);
+                iperf_event_del(test->event_loop, sp->socket, IPERF_EV_READ | IPERF_EV_WRITE | IPERF_EV_ERROR);
                 close(sp->socket);
             }
             test->state = IPERF_DONE;
@@ -240,13 +246,16 @@ server_timer_proc(TimerClientData client_data, struct iperf_time *nowP)
     if (test->done)
         return;
     test->done = 1;
+    iperf_free_workers(test);
     /* Free streams */
     while (!SLIST_EMPTY(&test->streams)) {
         sp = SLIST_FIRST(&test->streams);
         SLIST_REMOVE_HEAD(&test->streams, streams);
+        iperf_event_del(test->event_loop, sp->socket, IPERF_EV_READ | IPERF_EV_WRITE | IPERF_EV_ERROR);
         close(sp->socket);
         iperf_free_stream(sp);
     }
+    iperf_clear_stream_table(test);
     close(test->ctrl_sck);
 }
 
@@ -363,10 +372,12 @@ cleanup_server(struct iperf_test *test)
 {
     struct iperf_stream *sp;
 
+    iperf_stop_workers(test);
+    iperf_crr_server_free(test);
+
     /* Close open streams */
     SLIST_FOREACH(sp, &test->streams, streams) {
-	FD_CLR(sp->socket, &test->read_set);
-	FD_CLR(sp->socket, &test->write_set);
+	iperf_event_del(test->event_loop, sp->socket, IPERF_EV_READ | IPERF_EV_WRITE | IPERF_EV_ERROR);
 	close(sp->socket);
     }
 
@@ -414,7 +425,7 @@ iperf_run_server(struct iperf_test *test)
 #if defined(HAVE_TCP_CONGESTION)
     int saved_errno;
 #endif /* HAVE_TCP_CONGESTION */
-    fd_set read_set, write_set;
+    struct iperf_event_loop *loop;
     struct iperf_stream *sp;
     struct iperf_time now;
     struct timeval* timeout;
@@ -450,6 +461,7 @@ iperf_run_server(struct iperf_test *test)
     // Begin calculating CPU utilization
     cpu_util(NULL);
 
+    loop = test->event_loop;
     test->state = IPERF_START;
     send_streams_accepted = 0;
     rec_streams_accepted = 0;
@@ -463,12 +475,9 @@ iperf_run_server(struct iperf_test *test)
             return -1;	
 	}
 
-        memcpy(&read_set, &test->read_set, sizeof(fd_set));
-        memcpy(&write_set, &test->write_set, sizeof(fd_set));
-
 	iperf_time_now(&now);
-	timeout = tmr_timeout(&now);
-        result = select(test->max_fd + 1, &read_set, &write_set, NULL, timeout);
+	timeout = iperf_pacing_timeout(&test->pacing, tmr_timeout(&now));
+        result = iperf_event_wait(loop, timeout);
 
         if (result < 0 && errno != EINTR) {
 	    cleanup_server(test);
@@ -476,13 +485,24 @@ iperf_run_server(struct iperf_test *test)
             return -1;
         }
 	if (result > 0) {
-            if (FD_ISSET(test->listener, &read_set)) {
+            if (test->crr_server != NULL) {
+                /* --crr connections skip the handshake; iperf_crr_serve() checks their cookie. */
+                if (iperf_event_is_ready(loop, test->listener, IPERF_EV_READ)) {
+                    if (iperf_crr_accept(test, loop) < 0) {
+                        cleanup_server(test);
+                        return -1;
+                    }
+                    iperf_event_clear_ready(loop, test->listener, IPERF_EV_READ);
+                }
+                iperf_crr_serve(test, loop);
+            }
+            else if (iperf_event_is_ready(loop, test->listener, IPERF_EV_READ)) {
                 if (test->state != CREATE_STREAMS) {
                     if (iperf_accept(test) < 0) {
 			cleanup_server(test);
                         return -1;
                     }
-                    FD_CLR(test->listener, &read_set);
+                    iperf_event_clear_ready(loop, test->listener, IPERF_EV_READ);
 
                     // Set streams number
                     if (test->mode == BIDIRECTIONAL) {
@@ -497,16 +517,16 @@ iperf_run_server(struct iperf_test *test)
                     }
                 }
             }
-            if (FD_ISSET(test->ctrl_sck, &read_set)) {
+            if (iperf_event_is_ready(loop, test->ctrl_sck, IPERF_EV_READ)) {
                 if (iperf_handle_message_server(test) < 0) {
 		    cleanup_server(test);
                     return -1;
 		}
-                FD_CLR(test->ctrl_sck, &read_set);                
+                iperf_event_clear_ready(loop, test->ctrl_sck, IPERF_EV_READ);
             }
 
             if (test->state == CREATE_STREAMS) {
-                if (FD_ISSET(test->prot_listener, &read_set)) {
+                if (iperf_event_is_ready(loop, test->prot_listener, IPERF_EV_READ)) {
     
                     if ((s = test->protocol->accept(test)) < 0) {
 			cleanup_server(test);
@@ -575,12 +595,10 @@ iperf_run_server(struct iperf_test *test)
                                 return -1;
                             }
 
-                            if (sp->sender)
-                                FD_SET(s, &test->write_set);
-                            else
-                                FD_SET(s, &test->read_set);
-
-                            if (s > test->max_fd) test->max_fd = s;
+                            if (iperf_register_stream(test, sp) < 0) {
+                                cleanup_server(test);
+                                return -1;
+                            }
 
                             /*
                              * If the protocol isn't UDP, or even if it is but
@@ -599,17 +617,17 @@ iperf_run_server(struct iperf_test *test)
                             flag = -1;
                         }
                     }
-                    FD_CLR(test->prot_listener, &read_set);
+                    iperf_event_clear_ready(loop, test->prot_listener, IPERF_EV_READ);
                 }
 
 
                 if (rec_streams_accepted == streams_to_rec && send_streams_accepted == streams_to_send) {
                     if (test->protocol->id != Ptcp) {
-                        FD_CLR(test->prot_listener, &test->read_set);
+                        iperf_event_del(loop, test->prot_listener, IPERF_EV_READ);
                         close(test->prot_listener);
                     } else { 
                         if (test->no_delay || test->settings->mss || test->settings->socket_bufsize) {
-                            FD_CLR(test->listener, &test->read_set);
+                            iperf_event_del(loop, test->listener, IPERF_EV_READ);
                             close(test->listener);
 			    test->listener = 0;
                             if ((s = netannounce(test->settings->domain, Ptcp, test->bind_address, test->server_port)) < 0) {
@@ -618,8 +636,11 @@ iperf_run_server(struct iperf_test *test)
                                 return -1;
                             }
                             test->listener = s;
-                            FD_SET(test->listener, &test->read_set);
-			    if (test->listener > test->max_fd) test->max_fd = test->listener;
+                            if (iperf_event_add(loop, test->listener, IPERF_EV_READ, NULL) < 0) {
+				cleanup_server(test);
+                                i_errno = IEEVENTLOOP;
+                                return -1;
+                            }
                         }
                     }
                     test->prot_listener = -1;
@@ -659,35 +680,51 @@ iperf_run_server(struct iperf_test *test)
 			cleanup_server(test);
                         return -1;
 		    }
+		    if (test->settings->crr && iperf_crr_server_start(test) < 0) {
+			cleanup_server(test);
+			return -1;
+		    }
+		    iperf_start_busy_poll(test);
+		    if (iperf_start_workers(test) < 0) {
+			cleanup_server(test);
+			return -1;
+		    }
                 }
             }
 
             if (test->state == TEST_RUNNING) {
-                if (test->mode == BIDIRECTIONAL) {
-                    if (iperf_recv(test, &read_set) < 0) {
+                if (test->mode == BIDIRECTIONAL || test->settings->rr_request) {
+                    if (iperf_recv(test, loop) < 0) {
                         cleanup_server(test);
                         return -1;
                     }
-                    if (iperf_send(test, &write_set) < 0) {
+                    if (iperf_send(test, loop) < 0) {
                         cleanup_server(test);
                         return -1;
                     }
                 } else if (test->mode == SENDER) {
                     // Reverse mode. Server sends.
-                    if (iperf_send(test, &write_set) < 0) {
+                    if (iperf_send(test, loop) < 0) {
 			cleanup_server(test);
                         return -1;
 		    }
                 } else {
                     // Regular mode. Server receives.
-                    if (iperf_recv(test, &read_set) < 0) {
+                    if (iperf_recv(test, loop) < 0) {
 			cleanup_server(test);
                         return -1;
 		    }
                 }
+		if (iperf_check_workers(test) < 0) {
+		    cleanup_server(test);
+		    return -1;
+		}
 	    }
         }
 
+	if (test->state == TEST_RUNNING)
+	    iperf_pacing_run(&test->pacing, loop);
+
 	if (result == 0 ||
 	    (timeout != NULL && timeout->tv_sec == 0 && timeout->tv_usec == 0)) {
 	    /* Run the timers. */
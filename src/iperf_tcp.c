@@ -41,6 +41,7 @@
 #include "iperf.h"
 #include "iperf_api.h"
 #include "iperf_tcp.h"
+#include "iperf_zerocopy.h"
 #include "net.h"
 #include "cjson.h"
 
@@ -55,9 +56,19 @@
 int
 iperf_tcp_recv(struct iperf_stream *sp)
 {
-    int r;
-
-    r = Nread(sp->socket, sp->buffer, sp->settings->blksize, Ptcp);
+    int r, mapped;
+
+    if (sp->splice_fd >= 0)
+	r = Nsplice(sp->socket, sp->splice_pipe, sp->splice_fd, sp->settings->blksize);
+    else if (sp->rx_zc_map != NULL) {
+	r = Nread_zerocopy(sp->socket, sp->rx_zc_map, sp->settings->blksize, sp->buffer, sp->settings->blksize, &mapped);
+	if (r > 0) {
+	    sp->rx_zc_mapped += mapped;
+	    sp->rx_zc_copied += r - mapped;
+	}
+    }
+    else
+	r = Nread(sp->socket, sp->buffer, sp->settings->blksize, Ptcp);
 
     if (r < 0)
         return r;
@@ -65,7 +76,6 @@ iperf_tcp_recv(struct iperf_stream *sp)
     /* Only count bytes received while we're in the correct state. */
     if (sp->test->state == TEST_RUNNING) {
 	sp->result->bytes_received += r;
-	sp->result->bytes_received_this_interval += r;
     }
     else {
 	if (sp->test->debug)
@@ -85,7 +95,14 @@ iperf_tcp_send(struct iperf_stream *sp)
 {
     int r;
 
-    if (sp->test->zerocopy)
+    if (sp->zc != NULL) {
+	if (iperf_zc_reap(sp->zc, sp->socket) < 0)
+	    return NET_HARDERROR;
+	if (iperf_zc_buffer(sp->zc) == NULL)
+	    return iperf_zc_wait(sp);
+	r = iperf_zc_send(sp->zc, sp->socket, sp->settings->blksize);
+    }
+    else if (sp->test->zerocopy)
 	r = Nsendfile(sp->buffer_fd, sp->socket, sp->buffer, sp->settings->blksize);
     else
 	r = Nwrite(sp->socket, sp->buffer, sp->settings->blksize, Ptcp);
@@ -94,7 +111,6 @@ iperf_tcp_send(struct iperf_stream *sp)
         return r;
 
     sp->result->bytes_sent += r;
-    sp->result->bytes_sent_this_interval += r;
 
     if (sp->test->debug)
 	printf("sent %d bytes of %d, total %" PRIu64 "\n", r, sp->settings->blksize, sp->result->bytes_sent);
@@ -166,7 +182,7 @@ iperf_tcp_listen(struct iperf_test *test)
 	struct addrinfo hints, *res;
 	char portstr[6];
 
-        FD_CLR(s, &test->read_set);
+        iperf_event_del(test->event_loop, s, IPERF_EV_READ);
         close(s);
 
         snprintf(portstr, 6, "%d", test->server_port);
@@ -43,7 +43,7 @@ iperf_time_now(struct iperf_time *time1)
     result = clock_gettime(CLOCK_MONOTONIC, &ts);
     if (result == 0) {
         time1->secs = (uint32_t) ts.tv_sec;
-        time1->usecs = (uint32_t) ts.tv_nsec / 1000;
+        time1->nsecs = (uint32_t) ts.tv_nsec;
     }
     return result;
 }
@@ -59,12 +59,95 @@ iperf_time_now(struct iperf_time *time1)
     int result;
     result = gettimeofday(&tv, NULL);
     time1->secs = tv.tv_sec;
-    time1->usecs = tv.tv_usec;
+    time1->nsecs = tv.tv_usec * 1000;
     return result;
 }
 
 #endif
 
+/* iperf_time_realtime_offset
+ *
+ * Returns the number of nanoseconds to add to a CLOCK_REALTIME time,
+ * such as a kernel receive timestamp, to put it on the clock that
+ * iperf_time_now() reads.
+ */
+int64_t
+iperf_time_realtime_offset(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec rt, now;
+
+    if (clock_gettime(CLOCK_REALTIME, &rt) < 0 ||
+        clock_gettime(CLOCK_MONOTONIC, &now) < 0)
+        return 0;
+    return ((int64_t) now.tv_sec - rt.tv_sec) * 1000000000LL + (now.tv_nsec - rt.tv_nsec);
+#else
+    /* iperf_time_now() already reads the realtime clock */
+    return 0;
+#endif
+}
+
+/* iperf_time_tai_offset
+ *
+ * Returns the number of nanoseconds to add to an iperf_time_now()
+ * time to put it on CLOCK_TAI, or 0 if there is no such clock.
+ */
+int64_t
+iperf_time_tai_offset(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_TAI)
+    struct timespec tai, now;
+
+    if (clock_gettime(CLOCK_TAI, &tai) < 0 ||
+        clock_gettime(CLOCK_MONOTONIC, &now) < 0)
+        return 0;
+    return ((int64_t) tai.tv_sec - now.tv_sec) * 1000000000LL + (tai.tv_nsec - now.tv_nsec);
+#else
+    return 0;
+#endif
+}
+
+/* iperf_time_from_realtime
+ *
+ * Convert a CLOCK_REALTIME time to an iperf_time, given the offset
+ * from iperf_time_realtime_offset().
+ */
+void
+iperf_time_from_realtime(struct iperf_time *time1, uint64_t secs, uint32_t nsecs, int64_t offset)
+{
+    int64_t ns = (int64_t) secs * 1000000000LL + nsecs + offset;
+
+    if (ns < 0)
+        ns = 0;
+    iperf_time_from_nsecs(time1, (uint64_t) ns);
+}
+
+/* iperf_time_to_realtime
+ *
+ * The reverse of iperf_time_from_realtime(): move an iperf_time onto
+ * CLOCK_REALTIME, which, unlike our own clock, hosts can agree on.
+ */
+void
+iperf_time_to_realtime(struct iperf_time *time1, int64_t offset)
+{
+    int64_t ns = (int64_t) iperf_time_in_nsecs(time1) - offset;
+
+    if (ns < 0)
+        ns = 0;
+    iperf_time_from_nsecs(time1, (uint64_t) ns);
+}
+
+/* iperf_time_from_nsecs
+ *
+ * Set an iperf_time from a count of nanoseconds.
+ */
+void
+iperf_time_from_nsecs(struct iperf_time *time1, uint64_t nsecs)
+{
+    time1->secs = (uint32_t) (nsecs / 1000000000ULL);
+    time1->nsecs = (uint32_t) (nsecs % 1000000000ULL);
+}
+
 /* iperf_time_add_usecs
  *
  * Add a number of microseconds to a iperf_time.
@@ -72,24 +155,40 @@ iperf_time_now(struct iperf_time *time1)
 void
 iperf_time_add_usecs(struct iperf_time *time1, uint64_t usecs)
 {
-    time1->secs += usecs / 1000000L;
-    time1->usecs += usecs % 1000000L;
-    if ( time1->usecs >= 1000000L ) {
-        time1->secs += time1->usecs / 1000000L;
-        time1->usecs %= 1000000L;
+    iperf_time_add_nsecs(time1, usecs * 1000);
+}
+
+/* iperf_time_add_nsecs
+ *
+ * Add a number of nanoseconds to a iperf_time.
+ */
+void
+iperf_time_add_nsecs(struct iperf_time *time1, uint64_t nsecs)
+{
+    time1->secs += nsecs / 1000000000ULL;
+    time1->nsecs += nsecs % 1000000000ULL;
+    if ( time1->nsecs >= 1000000000UL ) {
+        time1->secs += time1->nsecs / 1000000000UL;
+        time1->nsecs %= 1000000000UL;
     }
 }
 
 uint64_t
 iperf_time_in_usecs(struct iperf_time *time)
 {
-    return time->secs * 1000000LL + time->usecs;
+    return time->secs * 1000000LL + time->nsecs / 1000;
+}
+
+uint64_t
+iperf_time_in_nsecs(struct iperf_time *time)
+{
+    return time->secs * 1000000000ULL + time->nsecs;
 }
 
 double
 iperf_time_in_secs(struct iperf_time *time)
 {
-    return time->secs + time->usecs / 1000000.0; 
+    return time->secs + time->nsecs / 1000000000.0; 
 }
 
 /* iperf_time_compare
@@ -106,9 +205,9 @@ iperf_time_compare(struct iperf_time *time1, struct iperf_time *time2)
         return -1;
     if (time1->secs > time2->secs)
         return 1;
-    if (time1->usecs < time2->usecs)
+    if (time1->nsecs < time2->nsecs)
         return -1;
-    if (time1->usecs > time2->usecs)
+    if (time1->nsecs > time2->nsecs)
         return 1;
     return 0;
 }
@@ -130,25 +229,25 @@ iperf_time_diff(struct iperf_time *time1, struct iperf_time *time2, struct iperf
     cmp = iperf_time_compare(time1, time2);
     if (cmp == 0) {
         diff->secs = 0;
-        diff->usecs = 0;
+        diff->nsecs = 0;
         past = 1;
     } 
     else if (cmp == 1) {
         diff->secs = time1->secs - time2->secs;
-        diff->usecs = time1->usecs;
-        if (diff->usecs < time2->usecs) {
+        diff->nsecs = time1->nsecs;
+        if (diff->nsecs < time2->nsecs) {
             diff->secs -= 1;
-            diff->usecs += 1000000;
+            diff->nsecs += 1000000000;
         }
-        diff->usecs = diff->usecs - time2->usecs;
+        diff->nsecs = diff->nsecs - time2->nsecs;
     } else {
         diff->secs = time2->secs - time1->secs;
-        diff->usecs = time2->usecs;
-        if (diff->usecs < time1->usecs) {
+        diff->nsecs = time2->nsecs;
+        if (diff->nsecs < time1->nsecs) {
             diff->secs -= 1;
-            diff->usecs += 1000000;
+            diff->nsecs += 1000000000;
         }
-        diff->usecs = diff->usecs - time1->usecs;
+        diff->nsecs = diff->nsecs - time1->nsecs;
         past = 1;
     }
 
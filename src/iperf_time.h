@@ -31,19 +31,33 @@
 
 struct iperf_time {
     uint32_t secs;
-    uint32_t usecs;
+    uint32_t nsecs;
 };
 
 int iperf_time_now(struct iperf_time *time1);
 
 void iperf_time_add_usecs(struct iperf_time *time1, uint64_t usecs);
 
+void iperf_time_add_nsecs(struct iperf_time *time1, uint64_t nsecs);
+
 int iperf_time_compare(struct iperf_time *time1, struct iperf_time *time2);
 
 int iperf_time_diff(struct iperf_time *time1, struct iperf_time *time2, struct iperf_time *diff);
 
 uint64_t iperf_time_in_usecs(struct iperf_time *time);
 
+uint64_t iperf_time_in_nsecs(struct iperf_time *time);
+
+void iperf_time_from_nsecs(struct iperf_time *time1, uint64_t nsecs);
+
 double iperf_time_in_secs(struct iperf_time *time);
 
+int64_t iperf_time_realtime_offset(void);
+
+int64_t iperf_time_tai_offset(void);
+
+void iperf_time_from_realtime(struct iperf_time *time1, uint64_t secs, uint32_t nsecs, int64_t offset);
+
+void iperf_time_to_realtime(struct iperf_time *time1, int64_t offset);
+
 #endif
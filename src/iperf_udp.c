@@ -36,6 +36,7 @@
 #include <netinet/in.h>
 #ifdef HAVE_STDINT_H
 #include <stdint.h>
+#include <time.h>
 #endif
 #include <sys/time.h>
 #include <sys/select.h>
@@ -44,6 +45,7 @@
 #include "iperf_api.h"
 #include "iperf_util.h"
 #include "iperf_udp.h"
+#include "iperf_zerocopy.h"
 #include "timer.h"
 #include "net.h"
 #include "cjson.h"
@@ -61,6 +63,379 @@
 # endif
 #endif
 
+/*
+ * iperf_udp_put_header
+ *
+ * Stamps the next sequence number and the send time into the iperf
+ * header at the start of a datagram.  For --latency-histogram the send
+ * time is on CLOCK_REALTIME, so that a receiver on another host with a
+ * synchronized clock can take it from its arrival time.
+ */
+void
+iperf_udp_put_header(struct iperf_stream *sp, char *buf, struct iperf_time *sent_time)
+{
+    struct iperf_time wall;
+
+    ++sp->packet_count;
+    if (sp->settings->latency_histogram) {
+	wall = *sent_time;
+	iperf_time_to_realtime(&wall, iperf_time_realtime_offset());
+	sent_time = &wall;
+    }
+
+    if (sp->test->udp_ns_header) {
+
+	uint64_t  nsec, pcount;
+
+	nsec = htobe64(iperf_time_in_nsecs(sent_time));
+	pcount = htobe64(sp->packet_count);
+
+	memcpy(buf, &nsec, sizeof(nsec));
+	memcpy(buf+8, &pcount, sizeof(pcount));
+
+    }
+    else if (sp->test->udp_counters_64bit) {
+
+	uint32_t  sec, usec;
+	uint64_t  pcount;
+
+	sec = htonl(sent_time->secs);
+	usec = htonl(sent_time->nsecs / 1000);
+	pcount = htobe64(sp->packet_count);
+	
+	memcpy(buf, &sec, sizeof(sec));
+	memcpy(buf+4, &usec, sizeof(usec));
+	memcpy(buf+8, &pcount, sizeof(pcount));
+	
+    }
+    else {
+
+	uint32_t  sec, usec, pcount;
+
+	sec = htonl(sent_time->secs);
+	usec = htonl(sent_time->nsecs / 1000);
+	pcount = htonl(sp->packet_count);
+	
+	memcpy(buf, &sec, sizeof(sec));
+	memcpy(buf+4, &usec, sizeof(usec));
+	memcpy(buf+8, &pcount, sizeof(pcount));
+	
+    }
+}
+
+/*
+ * iperf_udp_account
+ *
+ * Accounts for one received datagram of len bytes whose iperf header
+ * starts at buf: byte count, loss, reordering and jitter.
+ */
+void
+iperf_udp_account(struct iperf_stream *sp, const char *buf, int len, struct iperf_time *arrival_time)
+{
+    uint32_t  sec, usec;
+    uint64_t  pcount, distance;
+    int       first_packet = 0;
+    double    transit = 0, d = 0;
+    struct iperf_time sent_time, temp_time;
+
+    /*
+     * For jitter computation below, it's important to know if this
+     * packet is the first packet received.
+     */
+    if (sp->result->bytes_received == 0) {
+	first_packet = 1;
+    }
+
+    sp->result->bytes_received += len;
+
+    /* Dig the various counters out of the incoming UDP packet */
+    if (sp->test->udp_ns_header) {
+	uint64_t nsec;
+	memcpy(&nsec, buf, sizeof(nsec));
+	memcpy(&pcount, buf+8, sizeof(pcount));
+	pcount = be64toh(pcount);
+	iperf_time_from_nsecs(&sent_time, be64toh(nsec));
+    }
+    else if (sp->test->udp_counters_64bit) {
+	memcpy(&sec, buf, sizeof(sec));
+	memcpy(&usec, buf+4, sizeof(usec));
+	memcpy(&pcount, buf+8, sizeof(pcount));
+	sec = ntohl(sec);
+	usec = ntohl(usec);
+	pcount = be64toh(pcount);
+	sent_time.secs = sec;
+	sent_time.nsecs = usec * 1000;
+    }
+    else {
+	uint32_t pc;
+	memcpy(&sec, buf, sizeof(sec));
+	memcpy(&usec, buf+4, sizeof(usec));
+	memcpy(&pc, buf+8, sizeof(pc));
+	sec = ntohl(sec);
+	usec = ntohl(usec);
+	pcount = ntohl(pc);
+	sent_time.secs = sec;
+	sent_time.nsecs = usec * 1000;
+    }
+
+    if (sp->test->debug)
+	fprintf(stderr, "pcount %" PRIu64 " packet_count %d\n", pcount, sp->packet_count);
+
+    /*
+     * Sequence numbers start at 1.  A 0 is malformed or forged; let it
+     * into the window and it passes for a reordered datagram, one more
+     * than the highest seen, and the loss count goes below zero.  It
+     * can't be placed, so count it with the late ones and go no further.
+     */
+    if (pcount == 0) {
+	sp->late_packets++;
+	if (sp->test->debug)
+	    fprintf(stderr, "BAD SEQUENCE - incoming packet sequence 0 on stream %d\n", sp->socket);
+	return;
+    }
+
+    /*
+     * Classify the sequence number against the stream's receive window:
+     * new (possibly after a gap, which counts as loss until filled),
+     * reordered (fills a gap; how far behind the highest sequence
+     * number so far goes in the reorder distance histogram), duplicate,
+     * or too late to tell, which leaves the loss count alone.
+     */
+    switch (iperf_seqwin_update(sp->seqwin, pcount, &distance)) {
+	case IPERF_SEQ_NEW:
+	    break;
+
+	case IPERF_SEQ_REORDERED:
+	    sp->outoforder_packets++;
+	    sp->reorder_distance[iperf_seqwin_dist_bucket(distance)]++;
+	    if (sp->test->debug)
+		fprintf(stderr, "OUT OF ORDER - incoming packet sequence %" PRIu64 " but expected sequence %d on stream %d\n", pcount, sp->packet_count + 1, sp->socket);
+	    break;
+
+	case IPERF_SEQ_DUPLICATE:
+	    sp->duplicate_packets++;
+	    if (sp->test->debug)
+		fprintf(stderr, "DUPLICATE - incoming packet sequence %" PRIu64 " on stream %d\n", pcount, sp->socket);
+	    break;
+
+	case IPERF_SEQ_LATE:
+	    sp->late_packets++;
+	    if (sp->test->debug)
+		fprintf(stderr, "TOO LATE - incoming packet sequence %" PRIu64 " is behind the receive window on stream %d\n", pcount, sp->socket);
+	    break;
+    }
+    sp->packet_count = iperf_seqwin_highest(sp->seqwin);
+    sp->cnt_error = iperf_seqwin_lost(sp->seqwin);
+
+    /*
+     * jitter measurement
+     *
+     * This computation is based on RFC 1889 (specifically
+     * sections 6.3.1 and A.8).
+     *
+     * Note that synchronized clocks are not required since
+     * the source packet delta times are known.  Also this
+     * computation does not require knowing the round-trip
+     * time.
+     */
+    /* --latency-histogram senders stamp CLOCK_REALTIME, move it onto ours */
+    if (sp->settings->latency_histogram)
+	iperf_time_from_realtime(&sent_time, sent_time.secs, sent_time.nsecs, iperf_time_realtime_offset());
+    if (iperf_time_diff(arrival_time, &sent_time, &temp_time) == 0) {
+	transit = iperf_time_in_secs(&temp_time);
+	if (sp->latency != NULL)
+	    iperf_histogram_record(sp->latency, iperf_time_in_nsecs(&temp_time));
+    }
+    else {
+	/* Arrived "before" it was sent: the clocks are out of step */
+	transit = -iperf_time_in_secs(&temp_time);
+	if (sp->latency != NULL)
+	    iperf_histogram_record_negative(sp->latency);
+    }
+
+    /* Hack to handle the first packet by initializing prev_transit. */
+    if (first_packet)
+	sp->prev_transit = transit;
+
+    d = transit - sp->prev_transit;
+    if (d < 0)
+	d = -d;
+    sp->prev_transit = transit;
+    sp->jitter += (d - sp->jitter) / 16.0;
+}
+
+/*
+ * iperf_udp_batch_buffer
+ *
+ * Returns the stream's --udp-batch / --udp-gso buffer, one blksize
+ * slot per datagram, allocating it on first use.  Each slot starts out
+ * as a copy of the stream's payload.  With --udp-gro the buffer is
+ * also big enough for the largest coalesced read.
+ */
+char *
+iperf_udp_batch_buffer(struct iperf_stream *sp)
+{
+    int size = sp->settings->blksize;
+    int n = sp->settings->udp_batch;
+    size_t len;
+    int i;
+
+    if (sp->settings->udp_gso > n)
+	n = sp->settings->udp_gso;
+    if (n < 1)
+	n = 1;
+    len = (size_t) size * n;
+    if (sp->settings->udp_gro && len < NET_MAX_GRO_BYTES)
+	len = NET_MAX_GRO_BYTES;
+    if (sp->batch_buffer == NULL) {
+	sp->batch_buffer = (char *) malloc(len);
+	if (sp->batch_buffer == NULL)
+	    return NULL;
+	for (i = 0; i < n; ++i)
+	    memcpy(sp->batch_buffer + (size_t) i * size, sp->buffer, size);
+    }
+    return sp->batch_buffer;
+}
+
+/*
+ * iperf_udp_txtime
+ *
+ * Departure time, in iperf_time_now() nanoseconds, for the stream's
+ * next --txtime datagram: one datagram (or, with -b rate/burst, one
+ * burst) per blksize bytes' worth of the target rate, never in the
+ * past, so the sender can hand the kernel a whole batch at once and
+ * the qdisc spaces it out.
+ */
+static uint64_t
+iperf_udp_txtime(struct iperf_stream *sp, uint64_t now)
+{
+    struct iperf_settings *settings = sp->settings;
+    uint64_t burst = settings->burst > 1 ? settings->burst : 1;
+    uint64_t t;
+
+    if (sp->txtime_burst == 0 && sp->txtime_next < now)
+	sp->txtime_next = now;
+    t = sp->txtime_next;
+    if (++sp->txtime_burst >= burst) {
+	sp->txtime_burst = 0;
+	sp->txtime_next += burst * settings->blksize * 8 * UINT64_C(1000000000) / settings->rate;
+    }
+    return t;
+}
+
+/*
+ * What to add to an iperf_udp_txtime() departure time to put it on
+ * the socket's SO_TXTIME clock: nothing for fq, TAI's offset for etf.
+ */
+static int64_t
+iperf_udp_txtime_shift(struct iperf_stream *sp)
+{
+    return sp->settings->txtime == NET_TXTIME_ETF ? iperf_time_tai_offset() : 0;
+}
+
+/*
+ * Give back the departure times of datagrams that weren't sent, so
+ * the next send starts with the first of them.
+ */
+static void
+iperf_udp_txtime_unsend(struct iperf_stream *sp, uint64_t first_unsent)
+{
+    sp->txtime_next = first_unsent;
+    sp->txtime_burst = 0;
+}
+
+/*
+ * Arrival time of a datagram: its kernel receive timestamp moved onto
+ * our clock by offset, or the current time if the kernel gave none.
+ */
+static void
+iperf_udp_arrival(const struct timespec *ts, int64_t offset, struct iperf_time *arrival_time)
+{
+    if (ts->tv_sec != 0 || ts->tv_nsec != 0)
+	iperf_time_from_realtime(arrival_time, ts->tv_sec, ts->tv_nsec, offset);
+    else
+	iperf_time_now(arrival_time);
+}
+
+/*
+ * Receive a batch of datagrams with one recvmmsg.  Without
+ * --rx-timestamps every datagram in the batch gets the same arrival
+ * time.
+ */
+static int
+iperf_udp_recv_batch(struct iperf_stream *sp)
+{
+    int       size = sp->settings->blksize;
+    int       lens[NET_MAX_BATCH];
+    struct timespec stamps[NET_MAX_BATCH];
+    int       stamped = sp->settings->rx_timestamps;
+    int64_t   offset = 0;
+    int       n, i, r = 0;
+    char     *buf;
+    struct iperf_time arrival_time;
+
+    if ((buf = iperf_udp_batch_buffer(sp)) == NULL)
+	return NET_HARDERROR;
+    n = Nread_batch(sp->socket, buf, size, sp->settings->udp_batch, lens, stamped ? stamps : NULL);
+    if (n <= 0)
+	return n;
+
+    if (stamped)
+	offset = iperf_time_realtime_offset();
+    else
+	iperf_time_now(&arrival_time);
+    for (i = 0; i < n; ++i) {
+	r += lens[i];
+	/* Only count bytes received while we're in the correct state. */
+	if (sp->test->state == TEST_RUNNING) {
+	    if (stamped)
+		iperf_udp_arrival(&stamps[i], offset, &arrival_time);
+	    iperf_udp_account(sp, buf + (size_t) i * size, lens[i], &arrival_time);
+	}
+    }
+    if (sp->test->state != TEST_RUNNING && sp->test->debug)
+	printf("Late receive, state = %d\n", sp->test->state);
+
+    return r;
+}
+
+/*
+ * Receive one read that the kernel may have coalesced from several
+ * datagrams (UDP_GRO), and account for each datagram in it.  They all
+ * share the read's arrival time.
+ */
+static int
+iperf_udp_recv_gro(struct iperf_stream *sp)
+{
+    int       segsize, off, len, r;
+    char     *buf;
+    struct timespec stamp;
+    struct iperf_time arrival_time;
+
+    if ((buf = iperf_udp_batch_buffer(sp)) == NULL)
+	return NET_HARDERROR;
+    r = Nread_gro(sp->socket, buf, NET_MAX_GRO_BYTES, &segsize, sp->settings->rx_timestamps ? &stamp : NULL);
+    if (r <= 0)
+	return r;
+
+    if (sp->test->state == TEST_RUNNING) {
+	if (sp->settings->rx_timestamps)
+	    iperf_udp_arrival(&stamp, iperf_time_realtime_offset(), &arrival_time);
+	else
+	    iperf_time_now(&arrival_time);
+	for (off = 0; off < r; off += segsize) {
+	    len = r - off < segsize ? r - off : segsize;
+	    iperf_udp_account(sp, buf + off, len, &arrival_time);
+	}
+    }
+    else {
+	if (sp->test->debug)
+	    printf("Late receive, state = %d\n", sp->test->state);
+    }
+
+    return r;
+}
+
 /* iperf_udp_recv
  *
  * receives the data for UDP
@@ -68,15 +443,20 @@
 int
 iperf_udp_recv(struct iperf_stream *sp)
 {
-    uint32_t  sec, usec;
-    uint64_t  pcount;
     int       r;
     int       size = sp->settings->blksize;
-    int       first_packet = 0;
-    double    transit = 0, d = 0;
-    struct iperf_time sent_time, arrival_time, temp_time;
+    struct timespec stamp;
+    struct iperf_time arrival_time;
+
+    if (sp->settings->udp_gro)
+	return iperf_udp_recv_gro(sp);
+    if (sp->settings->udp_batch > 1)
+	return iperf_udp_recv_batch(sp);
 
-    r = Nread(sp->socket, sp->buffer, size, Pudp);
+    if (sp->settings->rx_timestamps)
+	r = Nread_stamped(sp->socket, sp->buffer, size, &stamp);
+    else
+	r = Nread(sp->socket, sp->buffer, size, Pudp);
 
     /*
      * If we got an error in the read, or if we didn't read anything
@@ -88,123 +468,125 @@ iperf_udp_recv(struct iperf_stream *sp)
 
     /* Only count bytes received while we're in the correct state. */
     if (sp->test->state == TEST_RUNNING) {
+	if (sp->settings->rx_timestamps)
+	    iperf_udp_arrival(&stamp, iperf_time_realtime_offset(), &arrival_time);
+	else
+	    iperf_time_now(&arrival_time);
+	iperf_udp_account(sp, sp->buffer, r, &arrival_time);
+    }
+    else {
+	if (sp->test->debug)
+	    printf("Late receive, state = %d\n", sp->test->state);
+    }
 
-	/*
-	 * For jitter computation below, it's important to know if this
-	 * packet is the first packet received.
-	 */
-	if (sp->result->bytes_received == 0) {
-	    first_packet = 1;
-	}
+    return r;
+}
 
-	sp->result->bytes_received += r;
-	sp->result->bytes_received_this_interval += r;
-
-	/* Dig the various counters out of the incoming UDP packet */
-	if (sp->test->udp_counters_64bit) {
-	    memcpy(&sec, sp->buffer, sizeof(sec));
-	    memcpy(&usec, sp->buffer+4, sizeof(usec));
-	    memcpy(&pcount, sp->buffer+8, sizeof(pcount));
-	    sec = ntohl(sec);
-	    usec = ntohl(usec);
-	    pcount = be64toh(pcount);
-	    sent_time.secs = sec;
-	    sent_time.usecs = usec;
-	}
-	else {
-	    uint32_t pc;
-	    memcpy(&sec, sp->buffer, sizeof(sec));
-	    memcpy(&usec, sp->buffer+4, sizeof(usec));
-	    memcpy(&pc, sp->buffer+8, sizeof(pc));
-	    sec = ntohl(sec);
-	    usec = ntohl(usec);
-	    pcount = ntohl(pc);
-	    sent_time.secs = sec;
-	    sent_time.usecs = usec;
-	}
 
-	if (sp->test->debug)
-	    fprintf(stderr, "pcount %" PRIu64 " packet_count %d\n", pcount, sp->packet_count);
-
-	/*
-	 * Try to handle out of order packets.  The way we do this
-	 * uses a constant amount of storage but might not be
-	 * correct in all cases.  In particular we seem to have the
-	 * assumption that packets can't be duplicated in the network,
-	 * because duplicate packets will possibly cause some problems here.
-	 *
-	 * First figure out if the sequence numbers are going forward.
-	 * Note that pcount is the sequence number read from the packet,
-	 * and sp->packet_count is the highest sequence number seen so
-	 * far (so we're expecting to see the packet with sequence number
-	 * sp->packet_count + 1 arrive next).
-	 */
-	if (pcount >= sp->packet_count + 1) {
-
-	    /* Forward, but is there a gap in sequence numbers? */
-	    if (pcount > sp->packet_count + 1) {
-		/* There's a gap so count that as a loss. */
-		sp->cnt_error += (pcount - 1) - sp->packet_count;
-	    }
-	    /* Update the highest sequence number seen so far. */
-	    sp->packet_count = pcount;
-	} else {
-
-	    /* 
-	     * Sequence number went backward (or was stationary?!?).
-	     * This counts as an out-of-order packet.
-	     */
-	    sp->outoforder_packets++;
+/*
+ * Send a batch of --udp-batch datagrams (or a single --txtime one)
+ * with one sendmmsg.  Sequence numbers and departure times of any the
+ * kernel didn't take are handed back.
+ */
+static int
+iperf_udp_send_batch(struct iperf_stream *sp)
+{
+    int       size = sp->settings->blksize;
+    int       n = sp->settings->udp_batch > 1 ? sp->settings->udp_batch : 1;
+    int       i, r;
+    char     *buf;
+    uint64_t  txtimes[NET_MAX_BATCH], ktimes[NET_MAX_BATCH], *tp = NULL;
+    int64_t   shift = 0;
+    struct iperf_time before, stamp;
 
-	    /*
-	     * If we have lost packets, then the fact that we are now
-	     * seeing an out-of-order packet offsets a prior sequence
-	     * number gap that was counted as a loss.  So we can take
-	     * away a loss.
-	     */
-	    if (sp->cnt_error > 0)
-		sp->cnt_error--;
-	
-	    /* Log the out-of-order packet */
-	    if (sp->test->debug) 
-		fprintf(stderr, "OUT OF ORDER - incoming packet sequence %" PRIu64 " but expected sequence %d on stream %d", pcount, sp->packet_count + 1, sp->socket);
-	}
+    if ((buf = iperf_udp_batch_buffer(sp)) == NULL)
+	return NET_HARDERROR;
 
-	/*
-	 * jitter measurement
-	 *
-	 * This computation is based on RFC 1889 (specifically
-	 * sections 6.3.1 and A.8).
-	 *
-	 * Note that synchronized clocks are not required since
-	 * the source packet delta times are known.  Also this
-	 * computation does not require knowing the round-trip
-	 * time.
-	 */
-	iperf_time_now(&arrival_time);
+    iperf_time_now(&before);
+    if (sp->settings->txtime && sp->settings->rate != 0) {
+	tp = txtimes;
+	shift = iperf_udp_txtime_shift(sp);
+    }
+    for (i = 0; i < n; ++i) {
+	if (tp != NULL) {
+	    /* The header carries the time the datagram is let go. */
+	    tp[i] = iperf_udp_txtime(sp, iperf_time_in_nsecs(&before));
+	    ktimes[i] = tp[i] + shift;
+	    iperf_time_from_nsecs(&stamp, tp[i]);
+	    iperf_udp_put_header(sp, buf + (size_t) i * size, &stamp);
+	} else
+	    iperf_udp_put_header(sp, buf + (size_t) i * size, &before);
+    }
 
-	iperf_time_diff(&arrival_time, &sent_time, &temp_time);
-	transit = iperf_time_in_secs(&temp_time);
+    r = Nwrite_batch(sp->socket, buf, size, n, tp != NULL ? ktimes : NULL);
+    if (r < 0) {
+	sp->packet_count -= n;
+	if (tp != NULL)
+	    iperf_udp_txtime_unsend(sp, tp[0]);
+	return r;
+    }
+    sp->packet_count -= n - r;
+    if (tp != NULL && r < n)
+	iperf_udp_txtime_unsend(sp, tp[r]);
 
-	/* Hack to handle the first packet by initializing prev_transit. */
-	if (first_packet)
-	    sp->prev_transit = transit;
+    sp->result->bytes_sent += (iperf_size_t) r * size;
 
-	d = transit - sp->prev_transit;
-	if (d < 0)
-	    d = -d;
-	sp->prev_transit = transit;
-	sp->jitter += (d - sp->jitter) / 16.0;
+    if (sp->test->debug)
+	printf("sent %d datagrams of %d bytes, total %" PRIu64 "\n", r, size, sp->result->bytes_sent);
+
+    return r * size;
+}
+
+/*
+ * Send --udp-gso datagrams as one UDP_SEGMENT super-buffer that the
+ * kernel (or NIC) cuts into datagrams.  The receiver sees ordinary
+ * datagrams, each with its own header.  A super-buffer can't be
+ * larger than 64 KB, so fewer segments may be sent than asked for.
+ */
+static int
+iperf_udp_send_gso(struct iperf_stream *sp)
+{
+    int       size = sp->settings->blksize;
+    int       n = sp->settings->udp_gso;
+    int       i, r;
+    char     *buf;
+    uint64_t  txtime = 0;
+    struct iperf_time before;
+
+    if (n > NET_MAX_GSO_BYTES / size)
+	n = NET_MAX_GSO_BYTES / size;
+    if (n < 1)
+	n = 1;
+    if ((buf = iperf_udp_batch_buffer(sp)) == NULL)
+	return NET_HARDERROR;
+
+    iperf_time_now(&before);
+    if (sp->settings->txtime && sp->settings->rate != 0) {
+	/* The segments leave together; the next send waits for all of them. */
+	txtime = iperf_udp_txtime(sp, iperf_time_in_nsecs(&before));
+	for (i = 1; i < n; ++i)
+	    (void) iperf_udp_txtime(sp, 0);
+	iperf_time_from_nsecs(&before, txtime);
     }
-    else {
-	if (sp->test->debug)
-	    printf("Late receive, state = %d\n", sp->test->state);
+    for (i = 0; i < n; ++i)
+	iperf_udp_put_header(sp, buf + (size_t) i * size, &before);
+
+    r = Nwrite_gso(sp->socket, buf, size, n, txtime != 0 ? txtime + iperf_udp_txtime_shift(sp) : 0);
+    if (r <= 0) {
+	sp->packet_count -= n;
+	if (txtime != 0)
+	    iperf_udp_txtime_unsend(sp, txtime);
+	return r;
     }
 
+    sp->result->bytes_sent += r;
+
+    if (sp->test->debug)
+	printf("sent %d bytes in %d segments, total %" PRIu64 "\n", r, n, sp->result->bytes_sent);
+
     return r;
 }
 
-
 /* iperf_udp_send
  *
  * sends the data for UDP
@@ -214,47 +596,39 @@ iperf_udp_send(struct iperf_stream *sp)
 {
     int r;
     int       size = sp->settings->blksize;
+    char     *buf = sp->buffer;
     struct iperf_time before;
 
-    iperf_time_now(&before);
-
-    ++sp->packet_count;
-
-    if (sp->test->udp_counters_64bit) {
-
-	uint32_t  sec, usec;
-	uint64_t  pcount;
-
-	sec = htonl(before.secs);
-	usec = htonl(before.usecs);
-	pcount = htobe64(sp->packet_count);
-	
-	memcpy(sp->buffer, &sec, sizeof(sec));
-	memcpy(sp->buffer+4, &usec, sizeof(usec));
-	memcpy(sp->buffer+8, &pcount, sizeof(pcount));
-	
+    if (sp->settings->udp_gso > 1)
+	return iperf_udp_send_gso(sp);
+    if (sp->settings->udp_batch > 1 || sp->settings->txtime)
+	return iperf_udp_send_batch(sp);
+
+    /* With --msg-zerocopy the header goes in a ring slot the kernel is done with. */
+    if (sp->zc != NULL) {
+	if (iperf_zc_reap(sp->zc, sp->socket) < 0)
+	    return NET_HARDERROR;
+	if ((buf = iperf_zc_buffer(sp->zc)) == NULL)
+	    return iperf_zc_wait(sp);
     }
-    else {
 
-	uint32_t  sec, usec, pcount;
+    iperf_time_now(&before);
 
-	sec = htonl(before.secs);
-	usec = htonl(before.usecs);
-	pcount = htonl(sp->packet_count);
-	
-	memcpy(sp->buffer, &sec, sizeof(sec));
-	memcpy(sp->buffer+4, &usec, sizeof(usec));
-	memcpy(sp->buffer+8, &pcount, sizeof(pcount));
-	
-    }
+    iperf_udp_put_header(sp, buf, &before);
 
-    r = Nwrite(sp->socket, sp->buffer, size, Pudp);
+    if (sp->zc != NULL)
+	r = iperf_zc_send(sp->zc, sp->socket, size);
+    else
+	r = Nwrite(sp->socket, buf, size, Pudp);
 
-    if (r < 0)
+    if (r <= 0) {
+	/* The datagram didn't go; its sequence number is reused. */
+	if (sp->zc != NULL)
+	    --sp->packet_count;
 	return r;
+    }
 
     sp->result->bytes_sent += r;
-    sp->result->bytes_sent_this_interval += r;
 
     if (sp->test->debug)
 	printf("sent %d bytes of %d, total %" PRIu64 "\n", r, sp->settings->blksize, sp->result->bytes_sent);
@@ -437,6 +811,21 @@ iperf_udp_accept(struct iperf_test *test)
 	}
     }
 
+    if (test->settings->txtime && settxtime(s, test->settings->txtime) < 0) {
+	i_errno = IESETTXTIME;
+	return -1;
+    }
+
+    /* Have the kernel coalesce received datagrams if asked to. */
+    if (test->settings->udp_gro && setudpgro(s) < 0) {
+	i_errno = IESETUDPGRO;
+	return -1;
+    }
+    if (test->settings->rx_timestamps && setrxtimestamps(s) < 0) {
+	i_errno = IESETRXTS;
+	return -1;
+    }
+
     /*
      * Create a new "listening" socket to replace the one we were using before.
      */
@@ -446,8 +835,10 @@ iperf_udp_accept(struct iperf_test *test)
         return -1;
     }
 
-    FD_SET(test->prot_listener, &test->read_set);
-    test->max_fd = (test->max_fd < test->prot_listener) ? test->prot_listener : test->max_fd;
+    if (iperf_event_add(test->event_loop, test->prot_listener, IPERF_EV_READ, NULL) < 0) {
+        i_errno = IEEVENTLOOP;
+        return -1;
+    }
 
     /* Let the client know we're ready "accept" another UDP "stream" */
     buf = 987654321;		/* any content will work here */
@@ -549,6 +940,21 @@ iperf_udp_connect(struct iperf_test *test)
 	}
     }
 
+    if (test->settings->txtime && settxtime(s, test->settings->txtime) < 0) {
+	i_errno = IESETTXTIME;
+	return -1;
+    }
+
+    /* Have the kernel coalesce received datagrams if asked to. */
+    if (test->settings->udp_gro && setudpgro(s) < 0) {
+	i_errno = IESETUDPGRO;
+	return -1;
+    }
+    if (test->settings->rx_timestamps && setrxtimestamps(s) < 0) {
+	i_errno = IESETRXTS;
+	return -1;
+    }
+
 #ifdef SO_RCVTIMEO
     /* 30 sec timeout for a case when there is a network problem. */
     tv.tv_sec = 30;
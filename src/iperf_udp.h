@@ -44,6 +44,27 @@ int iperf_udp_recv(struct iperf_stream *);
  */
 int iperf_udp_send(struct iperf_stream *) /* __attribute__((hot)) */;
 
+/**
+ * iperf_udp_put_header -- stamp the next sequence number and the send
+ * time into the iperf header at buf
+ *
+ */
+void iperf_udp_put_header(struct iperf_stream *, char *, struct iperf_time *);
+
+/**
+ * iperf_udp_account -- count a received datagram of len bytes whose
+ * iperf header is at buf, updating loss, reordering and jitter
+ *
+ */
+void iperf_udp_account(struct iperf_stream *, const char *, int, struct iperf_time *);
+
+/**
+ * iperf_udp_batch_buffer -- the stream's --udp-batch buffer, allocated
+ * on first use
+ *
+ */
+char *iperf_udp_batch_buffer(struct iperf_stream *);
+
 
 /**
  * iperf_udp_accept -- accepts a new UDP connection
@@ -45,6 +45,9 @@
 #include <time.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
 
 #include "cjson.h"
 #include "iperf.h"
@@ -137,15 +140,11 @@ make_cookie(const char *cookie)
 int
 is_closed(int fd)
 {
-    struct timeval tv;
-    fd_set readset;
-
-    FD_ZERO(&readset);
-    FD_SET(fd, &readset);
-    tv.tv_sec = 0;
-    tv.tv_usec = 0;
-
-    if (select(fd+1, &readset, NULL, NULL, &tv) < 0) {
+    /*
+     * Don't use select() here, the descriptor may well be past
+     * FD_SETSIZE when running with a large number of streams.
+     */
+    if (fcntl(fd, F_GETFD) < 0) {
         if (errno == EBADF)
             return 1;
     }
@@ -420,6 +419,111 @@ iperf_dump_fdset(FILE *fp, const char *str, int nfds, fd_set *fds)
     fprintf(fp, "]\n");
 }
 
+/*
+ * Parse a CPU list in the kernel's cpulist format ("0,2,4-7") into
+ * cpus[], in the order given.  Returns the number of CPUs, or -1 if
+ * the list is malformed or has more than maxcpus entries.
+ */
+int
+parse_cpu_list(const char *str, int *cpus, int maxcpus)
+{
+    const char *p = str;
+    char *end;
+    long first, last, cpu;
+    int n = 0;
+
+    while (*p != '\0' && *p != '\n') {
+	first = strtol(p, &end, 10);
+	if (end == p || first < 0)
+	    return -1;
+	last = first;
+	p = end;
+	if (*p == '-') {
+	    ++p;
+	    last = strtol(p, &end, 10);
+	    if (end == p || last < first)
+		return -1;
+	    p = end;
+	}
+	for (cpu = first; cpu <= last; ++cpu) {
+	    if (n >= maxcpus)
+		return -1;
+	    cpus[n++] = (int) cpu;
+	}
+	if (*p == ',')
+	    ++p;
+	else if (*p != '\0' && *p != '\n')
+	    return -1;
+    }
+    return n > 0 ? n : -1;
+}
+
+/*
+ * Find the NUMA node of the network device that a connected socket's
+ * local address belongs to, from /sys/class/net/<dev>/device/numa_node.
+ * Returns -1 if it can't be determined, as for loopback or virtual
+ * devices or on machines that aren't NUMA.
+ */
+int
+get_socket_numa_node(int s)
+{
+    struct sockaddr_storage sa;
+    socklen_t len = sizeof(sa);
+    struct ifaddrs *ifap, *ifa;
+    char path[256];
+    FILE *fp;
+    int node = -1;
+
+    if (getsockname(s, (struct sockaddr *) &sa, &len) < 0)
+	return -1;
+    if (getifaddrs(&ifap) < 0)
+	return -1;
+    for (ifa = ifap; ifa != NULL; ifa = ifa->ifa_next) {
+	if (ifa->ifa_addr == NULL || ifa->ifa_addr->sa_family != sa.ss_family)
+	    continue;
+	if (sa.ss_family == AF_INET) {
+	    if (((struct sockaddr_in *) ifa->ifa_addr)->sin_addr.s_addr !=
+		((struct sockaddr_in *) &sa)->sin_addr.s_addr)
+		continue;
+	} else if (sa.ss_family == AF_INET6) {
+	    if (memcmp(&((struct sockaddr_in6 *) ifa->ifa_addr)->sin6_addr,
+		       &((struct sockaddr_in6 *) &sa)->sin6_addr, sizeof(struct in6_addr)) != 0)
+		continue;
+	} else
+	    continue;
+	snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", ifa->ifa_name);
+	if ((fp = fopen(path, "r")) != NULL) {
+	    if (fscanf(fp, "%d", &node) != 1)
+		node = -1;
+	    fclose(fp);
+	}
+	break;
+    }
+    freeifaddrs(ifap);
+    return node;
+}
+
+/*
+ * Fill cpus[] with the CPUs of a NUMA node, from
+ * /sys/devices/system/node/node<n>/cpulist.  Returns the number of
+ * CPUs, or -1 on failure.
+ */
+int
+get_numa_node_cpus(int node, int *cpus, int maxcpus)
+{
+    char path[256], buf[4096];
+    FILE *fp;
+    int n = -1;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    if ((fp = fopen(path, "r")) == NULL)
+	return -1;
+    if (fgets(buf, sizeof(buf), fp) != NULL)
+	n = parse_cpu_list(buf, cpus, maxcpus);
+    fclose(fp);
+    return n;
+}
+
 /*
  * daemon(3) implementation for systems lacking one.
  * Cobbled together from various daemon(3) implementations,
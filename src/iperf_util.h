@@ -56,6 +56,12 @@ cJSON* iperf_json_printf(const char *format, ...);
 
 void iperf_dump_fdset(FILE *fp, const char *str, int nfds, fd_set *fds);
 
+int parse_cpu_list(const char *str, int *cpus, int maxcpus);
+
+int get_socket_numa_node(int s);
+
+int get_numa_node_cpus(int node, int *cpus, int maxcpus);
+
 #ifndef HAVE_DAEMON
 extern int daemon(int nochdir, int noclose);
 #endif /* HAVE_DAEMON */
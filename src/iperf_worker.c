@@ -0,0 +1,616 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+
+/*
+ * Worker threads for --threads.
+ *
+ * The main thread keeps the control connection, the timers and all of
+ * the reporting.  Each worker gets a share of the streams and its own
+ * event loop, and calls snd/rcv on them.  Nothing on the data path takes
+ * a lock: a stream's result counters and a worker's byte/block counters
+ * each have exactly one writer, and the main thread only reads them
+ * (taking differences against marks of its own rather than resetting).
+ *
+ * With --pin each worker is pinned to one CPU, and copies its streams'
+ * buffers into memory it touches first so they end up on its node.
+ */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#if defined(HAVE_CPUSET_SETAFFINITY)
+#include <sys/param.h>
+#include <sys/cpuset.h>
+#endif /* HAVE_CPUSET_SETAFFINITY */
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_event.h"
+#include "iperf_payload.h"
+#include "iperf_time.h"
+#include "iperf_util.h"
+#include "iperf_worker.h"
+
+/* How often the main thread looks at the workers' totals for -n / -k */
+#define WORKER_POLL_USECS 1000
+
+
+/*
+ * Work out the CPUs named by --pin.  For "auto" these are the CPUs of
+ * the NUMA node that the NIC carrying socket s is attached to, if that
+ * can be found.  Returns the number of CPUs, 0 for no pinning, or -1.
+ */
+static int
+iperf_pin_cpus(struct iperf_test *test, int s, int *cpus)
+{
+    int n;
+
+    if (test->pin_spec == NULL)
+	return 0;
+    if (strcmp(test->pin_spec, "auto") != 0) {
+	if ((n = parse_cpu_list(test->pin_spec, cpus, MAX_PIN_CPUS)) < 0) {
+	    i_errno = IEPIN;
+	    return -1;
+	}
+	return n;
+    }
+
+    test->pin_node = get_socket_numa_node(s);
+    if (test->pin_node < 0 ||
+	(n = get_numa_node_cpus(test->pin_node, cpus, MAX_PIN_CPUS)) <= 0) {
+	if (test->verbose)
+	    iperf_printf(test, "NUMA node of the data interface is unknown, not pinning worker threads\n");
+	test->pin_node = -1;
+	return 0;
+    }
+    if (test->verbose)
+	iperf_printf(test, "Pinning worker threads to NUMA node %d\n", test->pin_node);
+    return n;
+}
+
+static int
+iperf_create_workers(struct iperf_test *test, int s)
+{
+    struct iperf_worker *w;
+    int cpus[MAX_PIN_CPUS];
+    int i, ncpus;
+
+    if ((ncpus = iperf_pin_cpus(test, s, cpus)) < 0)
+	return -1;
+
+    test->workers = (struct iperf_worker *) calloc(test->num_threads, sizeof(struct iperf_worker));
+    if (test->workers == NULL) {
+	i_errno = IETHREAD;
+	return -1;
+    }
+    for (i = 0; i < test->num_threads; ++i) {
+	w = &test->workers[i];
+	w->id = i;
+	w->test = test;
+	w->wakeup[0] = w->wakeup[1] = -1;
+	w->cpu = ncpus > 0 ? cpus[i % ncpus] : -1;
+    }
+    for (i = 0; i < test->num_threads; ++i) {
+	w = &test->workers[i];
+	w->event_loop = iperf_event_loop_new(test->event_backend);
+	if (w->event_loop == NULL)
+	    goto fail;
+	if (pipe(w->wakeup) < 0)
+	    goto fail;
+	if (iperf_event_add(w->event_loop, w->wakeup[0], IPERF_EV_READ, NULL) < 0)
+	    goto fail;
+    }
+    return 0;
+
+  fail:
+    i_errno = IEEVENTLOOP;
+    return -1;
+}
+
+int
+iperf_register_stream(struct iperf_test *test, struct iperf_stream *sp)
+{
+    struct iperf_event_loop *loop = test->event_loop;
+    struct iperf_worker *w;
+    int i, n;
+
+    if (test->num_threads > 0) {
+	if (test->workers == NULL && iperf_create_workers(test, sp->socket) < 0)
+	    return -1;
+
+	for (i = 0, n = 0; i < test->num_threads; ++i)
+	    n += test->workers[i].num_streams;
+	w = &test->workers[n % test->num_threads];
+	if (w->num_streams == w->streams_size) {
+	    int size = w->streams_size ? w->streams_size * 2 : 8;
+	    struct iperf_stream **streams = realloc(w->streams, size * sizeof(struct iperf_stream *));
+	    if (streams == NULL) {
+		i_errno = IETHREAD;
+		return -1;
+	    }
+	    w->streams = streams;
+	    w->streams_size = size;
+	}
+	w->streams[w->num_streams++] = sp;
+
+	/* A UDP server's stream socket started out as the listener. */
+	iperf_event_del(test->event_loop, sp->socket, IPERF_EV_READ | IPERF_EV_WRITE | IPERF_EV_ERROR);
+	loop = w->event_loop;
+    }
+
+    if (iperf_event_add(loop, sp->socket, sp->sender ? IPERF_EV_WRITE : IPERF_EV_READ, sp) < 0) {
+	i_errno = IEEVENTLOOP;
+	return -1;
+    }
+    sp->event_loop = loop;
+    return 0;
+}
+
+#if defined(HAVE_PTHREAD)
+
+/*
+ * Re-enable rate-limited senders.  In single-threaded mode this is done
+ * by a pacing timer per stream, but the timer list belongs to the main
+ * thread.
+ */
+static void
+iperf_worker_pace(struct iperf_worker *w, struct iperf_time *nowP)
+{
+    int i;
+
+    for (i = 0; i < w->num_streams; ++i)
+	if (w->streams[i]->sender)
+	    iperf_check_throttle(w->streams[i], nowP);
+}
+
+/* Pin the calling worker thread to its CPU. */
+static int
+iperf_worker_pin(struct iperf_worker *w)
+{
+#if defined(HAVE_SCHED_SETAFFINITY)
+    cpu_set_t cpu_set;
+
+    CPU_ZERO(&cpu_set);
+    CPU_SET(w->cpu, &cpu_set);
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpu_set) != 0) {
+	w->error = IEAFFINITY;
+	return -1;
+    }
+    return 0;
+#elif defined(HAVE_CPUSET_SETAFFINITY)
+    cpuset_t cpumask;
+
+    CPU_ZERO(&cpumask);
+    CPU_SET(w->cpu, &cpumask);
+    if (cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1,
+			   sizeof(cpuset_t), &cpumask) != 0) {
+	w->error = IEAFFINITY;
+	return -1;
+    }
+    return 0;
+#else /* neither HAVE_SCHED_SETAFFINITY nor HAVE_CPUSET_SETAFFINITY */
+    w->error = IEAFFINITY;
+    return -1;
+#endif /* neither HAVE_SCHED_SETAFFINITY nor HAVE_CPUSET_SETAFFINITY */
+}
+
+/*
+ * Point the worker's streams at the blocks iperf_map_worker_buffers()
+ * mapped for it.  Pinned workers copy the payload and private buffers
+ * into theirs from this thread, so that it touches the pages first and
+ * the kernel puts them on the worker's node.
+ */
+static void
+iperf_worker_localize_buffers(struct iperf_worker *w)
+{
+    struct iperf_payload_pool *pool = w->test->payload_pool;
+    struct iperf_stream *sp;
+    size_t len = w->test->settings->blksize;
+    char *buf;
+    int i;
+
+    if (pool == NULL)		/* no streams */
+	return;
+    if (w->payload != NULL) {
+	memcpy(w->payload, pool->payload, len);
+	(void) mprotect(w->payload, iperf_payload_mapsize(len, w->test->settings->hugepages), PROT_READ);
+    }
+
+    for (i = 0; i < w->num_streams; ++i) {
+	sp = w->streams[i];
+	switch (sp->buffer_kind) {
+	case IPERF_BUFFER_SCRATCH:
+	    sp->buffer = w->scratch;
+	    break;
+	case IPERF_BUFFER_PAYLOAD:
+	    if (w->payload != NULL)
+		sp->buffer = w->payload;
+	    break;
+	default:
+	    if (w->buffers == NULL || (buf = w->buffers[i]) == NULL)
+		break;
+	    memcpy(buf, sp->buffer, len);
+	    if (sp->buffer_fd >= 0)
+		munmap(sp->buffer, len);
+	    else
+		iperf_payload_unmap(sp->buffer, len, w->test->settings->hugepages);
+	    sp->buffer = buf;
+	    w->buffers[i] = NULL;
+	    break;
+	}
+    }
+}
+
+static void *
+iperf_worker_thread(void *arg)
+{
+    struct iperf_worker *w = arg;
+    struct iperf_test *test = w->test;
+    struct iperf_time now, next_pace, delta;
+    struct timeval tv, *timeout;
+    struct iperf_pacing pc;
+    int pacing, result;
+
+    if (w->cpu >= 0 && iperf_worker_pin(w) < 0)
+	return NULL;
+    iperf_worker_localize_buffers(w);
+
+    pacing = test->settings->rate != 0;
+    iperf_time_now(&next_pace);
+    if (iperf_pacing_init(&pc, pacing ? test->settings->pacing_driver : IPERF_PACING_TIMER, w->event_loop) < 0) {
+	w->error = i_errno;
+	return NULL;
+    }
+
+    for (;;) {
+	timeout = NULL;
+	if (pc.driver != IPERF_PACING_TIMER)
+	    timeout = iperf_pacing_timeout(&pc, NULL);
+	else if (pacing) {
+	    iperf_time_now(&now);
+	    if (iperf_time_compare(&next_pace, &now) <= 0) {
+		iperf_worker_pace(w, &now);
+		next_pace = now;
+		iperf_time_add_usecs(&next_pace, test->settings->pacing_timer);
+	    }
+	    iperf_time_diff(&next_pace, &now, &delta);
+	    tv.tv_sec = delta.secs;
+	    tv.tv_usec = delta.nsecs / 1000;
+	    timeout = &tv;
+	}
+
+	result = iperf_event_wait(w->event_loop, timeout);
+	if (result < 0) {
+	    if (errno == EINTR)
+		continue;
+	    w->error = IESELECT;
+	    break;
+	}
+	if (iperf_event_is_ready(w->event_loop, w->wakeup[0], IPERF_EV_READ))
+	    break;
+	if (result > 0 &&
+	    (iperf_send_ready(test, w->event_loop, &w->bytes_sent, &w->blocks_sent) < 0 ||
+	     iperf_recv_ready(test, w->event_loop, &w->bytes_received, &w->blocks_received) < 0)) {
+	    w->error = i_errno;
+	    break;
+	}
+	iperf_pacing_run(&pc, w->event_loop);
+    }
+
+    iperf_pacing_free(&pc, w->event_loop);
+    return NULL;
+}
+
+int
+iperf_start_workers(struct iperf_test *test)
+{
+    struct iperf_worker *w;
+    int i;
+
+    if (test->workers == NULL)
+	return 0;
+    for (i = 0; i < test->num_threads; ++i) {
+	w = &test->workers[i];
+	if (w->running)
+	    continue;
+	if (pthread_create(&w->thread, NULL, iperf_worker_thread, w) != 0) {
+	    i_errno = IETHREAD;
+	    return -1;
+	}
+	w->running = 1;
+    }
+    if (test->debug)
+	printf("Started %d worker threads\n", test->num_threads);
+    return 0;
+}
+
+#else /* HAVE_PTHREAD */
+
+int
+iperf_start_workers(struct iperf_test *test)
+{
+    if (test->workers == NULL)
+	return 0;
+    i_errno = IEUNIMP;
+    return -1;
+}
+
+#endif /* HAVE_PTHREAD */
+
+/*
+ * Give each worker's receiving streams a scratch block of their own, so
+ * that no two threads read datagrams into the same memory, and pinned
+ * workers a payload and private buffers of their own as well.  Mapped
+ * here rather than by the worker, so that the start of test report
+ * counts them; their pages are only touched once the worker runs.
+ * (Zerocopy sends read buffer_fd, so a -Z buffer's file mapping is
+ * replaced by plain pages.)
+ */
+int
+iperf_map_worker_buffers(struct iperf_test *test)
+{
+    struct iperf_worker *w;
+    struct iperf_stream *sp;
+    size_t len = test->settings->blksize;
+    int huge = test->settings->hugepages;
+    int i, j, pages;
+
+    if (test->workers == NULL || test->payload_pool == NULL)
+	return 0;
+    for (i = 0; i < test->num_threads; ++i) {
+	w = &test->workers[i];
+	if (w->scratch != NULL)		/* already mapped */
+	    continue;
+	if ((w->scratch = iperf_payload_map(len, huge, &pages)) == NULL) {
+	    i_errno = IECREATESTREAM;
+	    return -1;
+	}
+	++test->buffer_pages[pages];
+	if (w->cpu < 0 || w->num_streams == 0)
+	    continue;
+	if ((w->payload = iperf_payload_map(len, huge, &pages)) != NULL)
+	    ++test->buffer_pages[pages];
+	if ((w->buffers = (char **) calloc(w->num_streams, sizeof(char *))) == NULL) {
+	    i_errno = IECREATESTREAM;
+	    return -1;
+	}
+	for (j = 0; j < w->num_streams; ++j) {
+	    sp = w->streams[j];
+	    if (sp->buffer_kind != IPERF_BUFFER_PRIVATE ||
+		(w->buffers[j] = iperf_payload_map(len, huge && sp->buffer_fd < 0, &pages)) == NULL)
+		continue;
+	    --test->buffer_pages[sp->buffer_pages];
+	    ++test->buffer_pages[pages];
+	    sp->buffer_pages = pages;
+	}
+    }
+    return 0;
+}
+
+/* Point the worker's streams back at the pool and drop its blocks. */
+static void
+iperf_worker_release_buffers(struct iperf_worker *w)
+{
+    struct iperf_payload_pool *pool = w->test->payload_pool;
+    struct iperf_stream *sp;
+    size_t len = w->test->settings->blksize;
+    int huge = w->test->settings->hugepages;
+    int i;
+
+    for (i = 0; i < w->num_streams; ++i) {
+	sp = w->streams[i];
+	if (sp->buffer_kind == IPERF_BUFFER_SCRATCH)
+	    sp->buffer = pool->scratch;
+	else if (sp->buffer_kind == IPERF_BUFFER_PAYLOAD)
+	    sp->buffer = pool->payload;
+	else if (w->buffers != NULL && w->buffers[i] != NULL)	/* the worker never ran */
+	    iperf_payload_unmap(w->buffers[i], len, huge && sp->buffer_fd < 0);
+    }
+    if (w->scratch != NULL)
+	iperf_payload_unmap(w->scratch, len, huge);
+    if (w->payload != NULL)
+	iperf_payload_unmap(w->payload, len, huge);
+    w->scratch = w->payload = NULL;
+    free(w->buffers);
+    w->buffers = NULL;
+}
+
+void
+iperf_start_busy_poll(struct iperf_test *test)
+{
+    int i;
+
+    if (test->workers == NULL) {
+	iperf_event_loop_set_busy_poll(test->event_loop, test->settings->busy_poll);
+	return;
+    }
+    for (i = 0; i < test->num_threads; ++i)
+	if (!test->workers[i].running)
+	    iperf_event_loop_set_busy_poll(test->workers[i].event_loop, test->settings->busy_poll);
+}
+
+void
+iperf_busy_poll_counts(struct iperf_test *test, uint64_t *polls, uint64_t *empty_polls)
+{
+    int i;
+
+    *polls = test->event_loop->polls;
+    *empty_polls = test->event_loop->empty_polls;
+    if (test->workers == NULL)
+	return;
+    for (i = 0; i < test->num_threads; ++i) {
+	*polls += test->workers[i].event_loop->polls;
+	*empty_polls += test->workers[i].event_loop->empty_polls;
+    }
+}
+
+/* Fold the workers' counters into the test's totals. */
+static void
+iperf_collect_workers(struct iperf_test *test)
+{
+    struct iperf_worker *w;
+    iperf_size_t bytes_sent = 0, blocks_sent = 0;
+    iperf_size_t bytes_received = 0, blocks_received = 0;
+    int i;
+
+    for (i = 0; i < test->num_threads; ++i) {
+	w = &test->workers[i];
+	bytes_sent += w->bytes_sent - w->bytes_sent_omit;
+	blocks_sent += w->blocks_sent - w->blocks_sent_omit;
+	bytes_received += w->bytes_received;
+	blocks_received += w->blocks_received;
+    }
+    test->bytes_sent = bytes_sent;
+    test->blocks_sent = blocks_sent;
+    test->bytes_received = bytes_received;
+    test->blocks_received = blocks_received;
+}
+
+int
+iperf_check_workers(struct iperf_test *test)
+{
+    int i;
+
+    if (test->workers == NULL || !test->workers[0].running)
+	return 0;
+    for (i = 0; i < test->num_threads; ++i)
+	if (test->workers[i].error) {
+	    i_errno = test->workers[i].error;
+	    return -1;
+	}
+    iperf_collect_workers(test);
+    return 0;
+}
+
+struct timeval *
+iperf_workers_timeout(struct iperf_test *test, struct timeval *timeout)
+{
+    static struct timeval tv;
+
+    if (test->workers == NULL || !test->workers[0].running ||
+	(test->settings->bytes == 0 && test->settings->blocks == 0))
+	return timeout;
+    if (timeout != NULL &&
+	(timeout->tv_sec > 0 || timeout->tv_usec > WORKER_POLL_USECS)) {
+	tv.tv_sec = 0;
+	tv.tv_usec = WORKER_POLL_USECS;
+	return &tv;
+    }
+    if (timeout == NULL) {
+	tv.tv_sec = 0;
+	tv.tv_usec = WORKER_POLL_USECS;
+	return &tv;
+    }
+    return timeout;
+}
+
+void
+iperf_stop_workers(struct iperf_test *test)
+{
+    struct iperf_worker *w;
+    struct iperf_stream *sp;
+    int i, j, stopped = 0;
+
+    if (test->workers == NULL)
+	return;
+
+    for (i = 0; i < test->num_threads; ++i) {
+	w = &test->workers[i];
+	if (!w->running)
+	    continue;
+	if (write(w->wakeup[1], "x", 1) < 0)
+	    warning("unable to wake worker thread");
+#if defined(HAVE_PTHREAD)
+	pthread_join(w->thread, NULL);
+#endif /* HAVE_PTHREAD */
+	w->running = 0;
+	stopped = 1;
+    }
+    if (!stopped)
+	return;
+    iperf_collect_workers(test);
+
+    /* Let the main loop drain or close the streams from here on. */
+    for (i = 0; i < test->num_threads; ++i) {
+	w = &test->workers[i];
+	iperf_worker_release_buffers(w);
+	for (j = 0; j < w->num_streams; ++j) {
+	    sp = w->streams[j];
+	    iperf_event_del(w->event_loop, sp->socket, IPERF_EV_READ | IPERF_EV_WRITE | IPERF_EV_ERROR);
+	    if (iperf_event_add(test->event_loop, sp->socket, sp->sender ? IPERF_EV_WRITE : IPERF_EV_READ, sp) == 0)
+		sp->event_loop = test->event_loop;
+	}
+    }
+}
+
+void
+iperf_reset_worker_stats(struct iperf_test *test)
+{
+    struct iperf_worker *w;
+    int i;
+
+    if (test->workers == NULL)
+	return;
+    for (i = 0; i < test->num_threads; ++i) {
+	w = &test->workers[i];
+	w->bytes_sent_omit = w->bytes_sent;
+	w->blocks_sent_omit = w->blocks_sent;
+    }
+}
+
+void
+iperf_free_workers(struct iperf_test *test)
+{
+    struct iperf_worker *w;
+    int i;
+
+    if (test->workers == NULL)
+	return;
+    iperf_stop_workers(test);
+    for (i = 0; i < test->num_threads; ++i) {
+	w = &test->workers[i];
+	iperf_worker_release_buffers(w);
+	iperf_event_loop_free(w->event_loop);
+	if (w->wakeup[0] >= 0)
+	    close(w->wakeup[0]);
+	if (w->wakeup[1] >= 0)
+	    close(w->wakeup[1]);
+	free(w->streams);
+    }
+    free(test->workers);
+    test->workers = NULL;
+}
@@ -0,0 +1,104 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_WORKER_H
+#define __IPERF_WORKER_H
+
+#include <stdint.h>
+
+struct iperf_test;
+struct iperf_stream;
+
+/**
+ * iperf_register_stream -- add a new stream's socket to an event loop.
+ * With --threads streams are dealt out round-robin to the workers,
+ * otherwise they go in the test's own loop.
+ * returns 0 on success, -1 (with i_errno set) on failure
+ *
+ */
+int iperf_register_stream(struct iperf_test *, struct iperf_stream *);
+
+/**
+ * iperf_start_workers -- start one thread per worker; each runs its
+ * event loop and sends/receives on its streams until stopped.
+ * Does nothing without --threads.
+ *
+ */
+int iperf_start_workers(struct iperf_test *);
+
+/**
+ * iperf_map_worker_buffers -- map the buffers the workers' streams will
+ * use instead of the pool's, counting them in test->buffer_pages.  Call
+ * once the streams are registered and before the test start report.
+ * Does nothing without --threads.
+ * returns 0 on success, -1 (with i_errno set) on failure
+ *
+ */
+int iperf_map_worker_buffers(struct iperf_test *);
+
+/**
+ * iperf_start_busy_poll -- with --busy-poll, make the event loops that
+ * carry the data streams (the workers' with --threads, else the
+ * test's own) spin instead of blocking.  Call before the workers start.
+ *
+ */
+void iperf_start_busy_poll(struct iperf_test *);
+
+/**
+ * iperf_busy_poll_counts -- total non-blocking polls, and polls that
+ * found nothing ready, made by the test's event loops.
+ *
+ */
+void iperf_busy_poll_counts(struct iperf_test *, uint64_t *polls, uint64_t *empty_polls);
+
+/**
+ * iperf_stop_workers -- stop and join the worker threads, fold their
+ * counters into the test and hand their streams back to the test's
+ * event loop.  Safe to call more than once.
+ *
+ */
+void iperf_stop_workers(struct iperf_test *);
+
+/**
+ * iperf_check_workers -- called from the main loop: refresh the test's
+ * byte and block totals from the running workers.
+ * returns -1 (with i_errno set) if a worker has failed
+ *
+ */
+int iperf_check_workers(struct iperf_test *);
+
+/**
+ * iperf_workers_timeout -- cap an event loop timeout so that the main
+ * thread polls the workers' totals often enough for -n / -k.
+ *
+ */
+struct timeval *iperf_workers_timeout(struct iperf_test *, struct timeval *);
+
+void iperf_reset_worker_stats(struct iperf_test *);
+
+void iperf_free_workers(struct iperf_test *);
+
+#endif /* __IPERF_WORKER_H */
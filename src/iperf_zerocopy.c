@@ -0,0 +1,154 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "iperf_histogram.h"
+#include "iperf_zerocopy.h"
+#include "net.h"
+
+/*
+ * Slots to keep a full send buffer in flight: completions only come
+ * back once the data has left the socket, so a smaller ring runs dry
+ * while the socket could still take more.
+ */
+static int
+iperf_zc_slots(int size, int fd)
+{
+    int sndbuf = 0, n = IPERF_ZC_MIN_SLOTS;
+    socklen_t len = sizeof(sndbuf);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &len) < 0)
+	sndbuf = 0;
+    while (n < IPERF_ZC_MAX_SLOTS && (int64_t) n * size < sndbuf &&
+	   (int64_t) n * 2 * size <= IPERF_ZC_MAX_RING)
+	n *= 2;
+    return n;
+}
+
+struct iperf_zc *
+iperf_zc_new(const char *payload, int size, int fd)
+{
+    struct iperf_zc *zc;
+    int i;
+
+    zc = (struct iperf_zc *) calloc(1, sizeof(*zc));
+    if (zc == NULL)
+	return NULL;
+    zc->size = size;
+    zc->nslots = iperf_zc_slots(size, fd);
+    zc->ring = malloc((size_t) zc->nslots * size);
+    zc->slots = (struct iperf_zc_slot *) calloc(zc->nslots, sizeof(struct iperf_zc_slot));
+    zc->latency = iperf_histogram_new();
+    if (zc->ring == NULL || zc->slots == NULL || zc->latency == NULL) {
+	iperf_zc_free(zc);
+	return NULL;
+    }
+    for (i = 0; i < zc->nslots; ++i)
+	memcpy(zc->ring + (size_t) i * size, payload, size);
+    return zc;
+}
+
+void
+iperf_zc_free(struct iperf_zc *zc)
+{
+    if (zc == NULL)
+	return;
+    free(zc->ring);
+    free(zc->slots);
+    iperf_histogram_free(zc->latency);
+    free(zc);
+}
+
+int
+iperf_zc_reap(struct iperf_zc *zc, int fd)
+{
+    struct iperf_zc_slot *slot;
+    struct iperf_time now, elapsed;
+    uint32_t lo, hi, id;
+    int copied, r;
+
+    while ((r = Nread_zerocopy_done(fd, &lo, &hi, &copied)) > 0) {
+	++zc->completions;
+	iperf_time_now(&now);
+	for (id = lo; ; ++id) {
+	    slot = &zc->slots[id % zc->nslots];
+	    if (slot->busy && slot->id == id) {
+		slot->busy = 0;
+		iperf_time_diff(&now, &slot->sent, &elapsed);
+		iperf_histogram_record(zc->latency, iperf_time_in_nsecs(&elapsed));
+		if (copied)
+		    zc->copied_bytes += slot->len;
+		else
+		    zc->zerocopy_bytes += slot->len;
+	    }
+	    if (id == hi)
+		break;
+	}
+    }
+    return r < 0 ? -1 : 0;
+}
+
+int
+iperf_zc_full(const struct iperf_zc *zc)
+{
+    return zc->slots[zc->next_id % zc->nslots].busy;
+}
+
+char *
+iperf_zc_buffer(struct iperf_zc *zc)
+{
+    struct iperf_zc_slot *slot = &zc->slots[zc->next_id % zc->nslots];
+
+    if (slot->busy) {
+	++zc->ring_full;
+	return NULL;
+    }
+    return zc->ring + (size_t) (zc->next_id % zc->nslots) * zc->size;
+}
+
+int
+iperf_zc_send(struct iperf_zc *zc, int fd, int len)
+{
+    struct iperf_zc_slot *slot = &zc->slots[zc->next_id % zc->nslots];
+    int r;
+
+    r = Nwrite_zerocopy(fd, zc->ring + (size_t) (zc->next_id % zc->nslots) * zc->size, len);
+    if (r <= 0)
+	return r;
+    /* Only a send that took some bytes gets a number. */
+    slot->id = zc->next_id++;
+    slot->busy = 1;
+    slot->len = r;
+    iperf_time_now(&slot->sent);
+    ++zc->sends;
+    zc->bytes += r;
+    return r;
+}
@@ -0,0 +1,101 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_ZEROCOPY_H
+#define __IPERF_ZEROCOPY_H
+
+#include <stdint.h>
+
+#include "iperf_time.h"
+
+struct iperf_histogram;
+
+/*
+ * Payload buffers per stream for --msg-zerocopy: enough to cover the
+ * socket's send buffer, a power of two between these bounds, and no
+ * more than IPERF_ZC_MAX_RING bytes unless that is below the minimum.
+ */
+#define IPERF_ZC_MIN_SLOTS 16
+#define IPERF_ZC_MAX_SLOTS 4096
+#define IPERF_ZC_MAX_RING (64 * 1024 * 1024)
+
+/*
+ * Ring of payload buffers for MSG_ZEROCOPY sends (--msg-zerocopy).
+ * The kernel keeps a reference to the pages of a zerocopy send until
+ * it reports the send complete on the socket's error queue, so each
+ * send goes out of its own slot and a slot is only written again
+ * once its completion has been reaped.  Send n (counting from 0, as
+ * the kernel does) always uses slot n % nslots.
+ */
+struct iperf_zc_slot
+{
+    uint32_t  id;		/* kernel's number for the send in flight */
+    int       busy;		/* waiting for its completion */
+    int       len;		/* bytes that send took */
+    struct iperf_time sent;
+};
+
+struct iperf_zc
+{
+    char     *ring;		/* nslots buffers of size bytes */
+    int       size;
+    int       nslots;
+    uint32_t  next_id;		/* the kernel's number for the next send */
+    struct iperf_zc_slot *slots;
+
+    /* Whole-test counts */
+    uint64_t  sends;
+    uint64_t  bytes;		/* sent with MSG_ZEROCOPY */
+    uint64_t  zerocopy_bytes;	/* completed without the kernel copying */
+    uint64_t  copied_bytes;	/* completed, but copied after all */
+    uint64_t  completions;	/* error queue notifications reaped */
+    uint64_t  ring_full;	/* sends held back for want of a free slot */
+    struct iperf_histogram *latency;	/* send to reaped completion, in ns */
+};
+
+/*
+ * A ring for sends of size bytes on fd, sized from fd's send buffer,
+ * whose slots all start out as copies of payload.
+ */
+struct iperf_zc *iperf_zc_new(const char *payload, int size, int fd);
+void iperf_zc_free(struct iperf_zc *zc);
+
+/*
+ * The next slot's buffer, for the caller to fill in and pass to
+ * iperf_zc_send(), or NULL if that slot is still in flight.
+ */
+char *iperf_zc_buffer(struct iperf_zc *zc);
+
+/* Whether the next slot is still in flight, without counting a wait. */
+int iperf_zc_full(const struct iperf_zc *zc);
+
+/* Send len bytes of the buffer from iperf_zc_buffer(); as Nwrite_zerocopy(). */
+int iperf_zc_send(struct iperf_zc *zc, int fd, int len);
+
+/* Take every completion off fd's error queue; -1 on error. */
+int iperf_zc_reap(struct iperf_zc *zc, int fd);
+
+#endif /* __IPERF_ZEROCOPY_H */
@@ -24,6 +24,10 @@
  * This code is distributed under a BSD style license, see the LICENSE
  * file for complete information.
  */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
 #include "iperf_config.h"
 
 #include <stdio.h>
@@ -39,6 +43,8 @@
 #include <string.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stdint.h>
+#include <time.h>
 
 #ifdef HAVE_SENDFILE
 #ifdef linux
@@ -57,6 +63,22 @@
 #endif
 #endif /* HAVE_SENDFILE */
 
+#if defined(HAVE_UDP_SEGMENT) || defined(HAVE_UDP_GRO)
+#include <netinet/udp.h>
+#endif /* HAVE_UDP_SEGMENT || HAVE_UDP_GRO */
+
+#if defined(HAVE_SO_TXTIME)
+#include <linux/net_tstamp.h>
+#endif /* HAVE_SO_TXTIME */
+
+#if defined(HAVE_MSG_ZEROCOPY)
+#include <linux/errqueue.h>
+#endif /* HAVE_MSG_ZEROCOPY */
+
+#if defined(HAVE_TCP_ZEROCOPY_RECEIVE)
+#include <sys/mman.h>
+#endif /* HAVE_TCP_ZEROCOPY_RECEIVE */
+
 #ifdef HAVE_POLL_H
 #include <poll.h>
 #endif /* HAVE_POLL_H */
@@ -484,6 +506,776 @@ Nsendfile(int fromfd, int tofd, const char *buf, size_t count)
 #endif /* HAVE_SENDFILE */
 }
 
+
+int
+has_rx_timestamps(void)
+{
+#if defined(HAVE_SO_TIMESTAMPNS)
+    return 1;
+#else /* HAVE_SO_TIMESTAMPNS */
+    return 0;
+#endif /* HAVE_SO_TIMESTAMPNS */
+}
+
+
+/*
+ * Ask the kernel to timestamp each datagram received on this socket
+ * (SO_TIMESTAMPNS).  Returns 0 on success, -1 on failure.
+ */
+int
+setrxtimestamps(int fd)
+{
+#if defined(HAVE_SO_TIMESTAMPNS)
+    int one = 1;
+
+    return setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+#else /* HAVE_SO_TIMESTAMPNS */
+    errno = ENOPROTOOPT;
+    return -1;
+#endif /* HAVE_SO_TIMESTAMPNS */
+}
+
+
+/*
+ * Pull the SO_TIMESTAMPNS receive time (CLOCK_REALTIME) out of a
+ * received message's control data, or zero it if there is none.
+ */
+static void
+net_rx_stamp(struct msghdr *msg, struct timespec *ts)
+{
+#if defined(HAVE_SO_TIMESTAMPNS)
+    struct cmsghdr *cm;
+
+    for (cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm)) {
+	if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS) {
+	    memcpy(ts, CMSG_DATA(cm), sizeof(*ts));
+	    return;
+	}
+    }
+#endif /* HAVE_SO_TIMESTAMPNS */
+    ts->tv_sec = 0;
+    ts->tv_nsec = 0;
+}
+
+
+/*
+ *                      N R E A D _ S T A M P E D
+ *
+ * Read one datagram into buf without blocking, along with its kernel
+ * receive timestamp (zero if the kernel didn't supply one).  Returns
+ * the number of bytes read, 0 if nothing was waiting.
+ */
+
+int
+Nread_stamped(int fd, char *buf, size_t size, struct timespec *ts)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    union {			/* aligned for struct cmsghdr, see cmsg(3) */
+	char buf[CMSG_SPACE(sizeof(struct timespec))];
+	struct cmsghdr align;
+    } control;
+    ssize_t r;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    r = recvmsg(fd, &msg, MSG_DONTWAIT);
+    if (r < 0) {
+	if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+	    return 0;
+	return NET_HARDERROR;
+    }
+    net_rx_stamp(&msg, ts);
+    return r;
+}
+
+
+int
+has_mmsg(void)
+{
+#if defined(HAVE_SENDMMSG) && defined(HAVE_RECVMMSG)
+    return 1;
+#else /* HAVE_SENDMMSG && HAVE_RECVMMSG */
+    return 0;
+#endif /* HAVE_SENDMMSG && HAVE_RECVMMSG */
+}
+
+
+int
+has_busy_poll(void)
+{
+#if defined(HAVE_SO_BUSY_POLL)
+    return 1;
+#else /* HAVE_SO_BUSY_POLL */
+    return 0;
+#endif /* HAVE_SO_BUSY_POLL */
+}
+
+
+/*
+ * Have the kernel busy-poll the device queue for up to usecs
+ * microseconds when a read or poll on this socket finds no data
+ * (SO_BUSY_POLL), and prefer that to interrupt-driven processing
+ * where supported (SO_PREFER_BUSY_POLL).  Raising SO_BUSY_POLL above
+ * net.core.busy_read needs CAP_NET_ADMIN.  Returns 0 on success, -1 on
+ * failure.
+ */
+int
+setbusypoll(int fd, int usecs)
+{
+#if defined(HAVE_SO_BUSY_POLL)
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) < 0)
+	return -1;
+#if defined(HAVE_SO_PREFER_BUSY_POLL)
+    {
+	int one = 1;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one)) < 0)
+	    return -1;
+    }
+#endif /* HAVE_SO_PREFER_BUSY_POLL */
+    return 0;
+#else /* HAVE_SO_BUSY_POLL */
+    errno = ENOPROTOOPT;
+    return -1;
+#endif /* HAVE_SO_BUSY_POLL */
+}
+
+
+int
+has_msg_zerocopy(void)
+{
+#if defined(HAVE_MSG_ZEROCOPY)
+    return 1;
+#else /* HAVE_MSG_ZEROCOPY */
+    return 0;
+#endif /* HAVE_MSG_ZEROCOPY */
+}
+
+
+/*
+ * Allow MSG_ZEROCOPY sends on a socket (SO_ZEROCOPY).  Returns 0 on
+ * success, -1 on failure.
+ */
+int
+setzerocopy(int fd)
+{
+#if defined(HAVE_MSG_ZEROCOPY)
+    int one = 1;
+
+    return setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one));
+#else /* HAVE_MSG_ZEROCOPY */
+    errno = ENOPROTOOPT;
+    return -1;
+#endif /* HAVE_MSG_ZEROCOPY */
+}
+
+
+/*
+ * One send(2) with MSG_ZEROCOPY.  The kernel pins buf rather than
+ * copying it, so it mustn't be changed until the completion for this
+ * send comes back (see Nread_zerocopy_done()).  Returns the bytes
+ * sent, 0 if the socket is full, NET_SOFTERROR if the kernel is out
+ * of memory for pinned pages or notifications, or NET_HARDERROR.
+ */
+int
+Nwrite_zerocopy(int fd, const char *buf, size_t count)
+{
+#if defined(HAVE_MSG_ZEROCOPY)
+    ssize_t r;
+
+    r = send(fd, buf, count, MSG_ZEROCOPY);
+    if (r < 0) {
+	switch (errno) {
+	    case EINTR:
+	    case EAGAIN:
+#if (EAGAIN != EWOULDBLOCK)
+	    case EWOULDBLOCK:
+#endif
+		return 0;
+
+	    case ENOBUFS:
+		return NET_SOFTERROR;
+
+	    default:
+		return NET_HARDERROR;
+	}
+    }
+    return r;
+#else /* HAVE_MSG_ZEROCOPY */
+    errno = EOPNOTSUPP;
+    return NET_HARDERROR;
+#endif /* HAVE_MSG_ZEROCOPY */
+}
+
+
+/*
+ * Take one MSG_ZEROCOPY completion off the socket's error queue.  The
+ * kernel numbers a socket's zerocopy sends from 0 and reports them
+ * done in ranges; *copied is set if it ended up copying the data
+ * anyway (as it does over loopback).  Returns 1 if there was a
+ * completion, 0 if there was none, or NET_HARDERROR.
+ */
+int
+Nread_zerocopy_done(int fd, uint32_t *lo, uint32_t *hi, int *copied)
+{
+#if defined(HAVE_MSG_ZEROCOPY)
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    struct sock_extended_err serr;
+    union {			/* aligned for struct cmsghdr, see cmsg(3) */
+	char buf[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_storage))];
+	struct cmsghdr align;
+    } control;
+
+    for (;;) {
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+	    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		return 0;
+	    return NET_HARDERROR;
+	}
+	for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+	    if (!(cm->cmsg_level == IPPROTO_IP && cm->cmsg_type == IP_RECVERR) &&
+		!(cm->cmsg_level == IPPROTO_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+		continue;
+	    memcpy(&serr, CMSG_DATA(cm), sizeof(serr));
+	    if (serr.ee_errno != 0 || serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+		continue;
+	    *lo = serr.ee_info;
+	    *hi = serr.ee_data;
+	    *copied = (serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+	    return 1;
+	}
+	/* Something else was queued; skip it. */
+    }
+#else /* HAVE_MSG_ZEROCOPY */
+    return 0;
+#endif /* HAVE_MSG_ZEROCOPY */
+}
+
+
+int
+has_rx_zerocopy(void)
+{
+#if defined(HAVE_TCP_ZEROCOPY_RECEIVE)
+    return 1;
+#else /* HAVE_TCP_ZEROCOPY_RECEIVE */
+    return 0;
+#endif /* HAVE_TCP_ZEROCOPY_RECEIVE */
+}
+
+
+/*
+ * Map len bytes (a multiple of the page size) of a TCP socket for
+ * Nread_zerocopy() to map received pages into.  Returns the mapping,
+ * or NULL on failure.
+ */
+void *
+maprxzerocopy(int fd, size_t len)
+{
+#if defined(HAVE_TCP_ZEROCOPY_RECEIVE)
+    void *map;
+
+    map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    return map == MAP_FAILED ? NULL : map;
+#else /* HAVE_TCP_ZEROCOPY_RECEIVE */
+    errno = EOPNOTSUPP;
+    return NULL;
+#endif /* HAVE_TCP_ZEROCOPY_RECEIVE */
+}
+
+
+/*
+ * Receive from a TCP socket without copying where possible: whole
+ * pages of payload at the head of the receive queue are mapped at map
+ * (from maprxzerocopy(), maplen bytes) with TCP_ZEROCOPY_RECEIVE,
+ * replacing whatever the last call mapped there, and what can't be
+ * mapped (the part of a segment that doesn't fill a page) is read
+ * into buf.  *mapped is set to the bytes mapped.  Returns the total
+ * bytes received, 0 at end of file or if nothing was waiting, or
+ * NET_HARDERROR.
+ */
+int
+Nread_zerocopy(int fd, void *map, size_t maplen, char *buf, size_t buflen, int *mapped)
+{
+#if defined(HAVE_TCP_ZEROCOPY_RECEIVE)
+    struct tcp_zerocopy_receive zc;
+    socklen_t len = sizeof(zc);
+    size_t skip;
+    ssize_t r = 0;
+
+    *mapped = 0;
+    memset(&zc, 0, sizeof(zc));
+    zc.address = (uintptr_t) map;
+    zc.length = maplen;
+    if (getsockopt(fd, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE, &zc, &len) < 0) {
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+	    return 0;
+	/*
+	 * The kernel refuses to map once the peer has shut down (EIO);
+	 * let a plain read return what's left, the EOF or the real error.
+	 */
+	zc.length = 0;
+	zc.recv_skip_hint = 0;
+    }
+    *mapped = zc.length;
+
+    /* Nothing to map and nothing to skip: empty, closed, or just arrived. */
+    skip = zc.length == 0 && zc.recv_skip_hint == 0 ? buflen : zc.recv_skip_hint;
+    if (skip > buflen)
+	skip = buflen;
+    if (skip > 0) {
+	r = read(fd, buf, skip);
+	if (r < 0) {
+	    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		return NET_HARDERROR;
+	    r = 0;
+	}
+    }
+    return zc.length + r;
+#else /* HAVE_TCP_ZEROCOPY_RECEIVE */
+    *mapped = 0;
+    return Nread(fd, buf, buflen, SOCK_STREAM);
+#endif /* HAVE_TCP_ZEROCOPY_RECEIVE */
+}
+
+
+int
+has_splice(void)
+{
+#if defined(HAVE_SPLICE) && defined(F_SETPIPE_SZ)
+    return 1;
+#else /* HAVE_SPLICE && F_SETPIPE_SZ */
+    return 0;
+#endif /* HAVE_SPLICE && F_SETPIPE_SZ */
+}
+
+
+/*
+ * Open a non-blocking pipe for Nsplice() and try to make it hold size
+ * bytes, so that a block moves through it in one go.  Returns 0 on
+ * success, -1 on failure.
+ */
+int
+splicepipe(int fds[2], size_t size)
+{
+#if defined(HAVE_SPLICE) && defined(F_SETPIPE_SZ)
+    if (pipe(fds) < 0)
+	return -1;
+    if (fcntl(fds[0], F_SETFL, O_NONBLOCK) < 0 || fcntl(fds[1], F_SETFL, O_NONBLOCK) < 0) {
+	close(fds[0]);
+	close(fds[1]);
+	return -1;
+    }
+    /* Best effort: the pipe just takes more trips if this fails. */
+    (void) fcntl(fds[1], F_SETPIPE_SZ, (int) size);
+    return 0;
+#else /* HAVE_SPLICE && F_SETPIPE_SZ */
+    errno = EOPNOTSUPP;
+    return -1;
+#endif /* HAVE_SPLICE && F_SETPIPE_SZ */
+}
+
+
+/*
+ *                      N S P L I C E
+ *
+ * Move up to count bytes from socket fd to tofd through the pipe
+ * (from splicepipe()) without copying them to user space, leaving the
+ * pipe empty.  Like Nread(), returns the bytes taken from the socket,
+ * which is 0 at end of file or if nothing was waiting, or
+ * NET_HARDERROR.
+ */
+int
+Nsplice(int fd, int fds[2], int tofd, size_t count)
+{
+#if defined(HAVE_SPLICE) && defined(F_SETPIPE_SZ)
+    ssize_t r, w;
+    size_t nleft = count;
+
+    while (nleft > 0) {
+	r = splice(fd, NULL, fds[1], NULL, nleft, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (r < 0) {
+	    if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+		break;
+	    return NET_HARDERROR;
+	} else if (r == 0)
+	    break;
+	nleft -= r;
+	while (r > 0) {
+	    w = splice(fds[0], NULL, tofd, NULL, r, SPLICE_F_MOVE);
+	    if (w < 0) {
+		if (errno == EINTR || errno == EAGAIN)
+		    continue;
+		return NET_HARDERROR;
+	    }
+	    r -= w;
+	}
+    }
+    return count - nleft;
+#else /* HAVE_SPLICE && F_SETPIPE_SZ */
+    errno = ENOSYS;	/* error if somehow get called without splice */
+    return NET_HARDERROR;
+#endif /* HAVE_SPLICE && F_SETPIPE_SZ */
+}
+
+
+int
+has_txtime(void)
+{
+#if defined(HAVE_SO_TXTIME) && defined(HAVE_SENDMMSG)
+    return 1;
+#else /* HAVE_SO_TXTIME && HAVE_SENDMMSG */
+    return 0;
+#endif /* HAVE_SO_TXTIME && HAVE_SENDMMSG */
+}
+
+
+/*
+ * Let datagrams sent on this socket carry an earliest departure time
+ * (SO_TXTIME).  The fq qdisc takes times on CLOCK_MONOTONIC
+ * (NET_TXTIME_FQ); etf only accepts CLOCK_TAI (NET_TXTIME_ETF).
+ * Returns 0 on success, -1 on failure.
+ */
+int
+settxtime(int fd, int kind)
+{
+#if defined(HAVE_SO_TXTIME)
+    struct sock_txtime txt;
+
+    memset(&txt, 0, sizeof(txt));
+    if (kind == NET_TXTIME_ETF) {
+#if defined(CLOCK_TAI)
+	txt.clockid = CLOCK_TAI;
+#else /* CLOCK_TAI */
+	errno = EINVAL;
+	return -1;
+#endif /* CLOCK_TAI */
+    } else
+	txt.clockid = CLOCK_MONOTONIC;
+    txt.flags = 0;
+    return setsockopt(fd, SOL_SOCKET, SO_TXTIME, &txt, sizeof(txt));
+#else /* HAVE_SO_TXTIME */
+    errno = ENOPROTOOPT;
+    return -1;
+#endif /* HAVE_SO_TXTIME */
+}
+
+
+#if defined(HAVE_SO_TXTIME)
+/* Append an SCM_TXTIME departure time to a message's control data. */
+static void
+net_put_txtime(struct msghdr *msg, struct cmsghdr *cm, uint64_t txtime)
+{
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_TXTIME;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+    memcpy(CMSG_DATA(cm), &txtime, sizeof(txtime));
+    msg->msg_controllen += CMSG_SPACE(sizeof(uint64_t));
+}
+#endif /* HAVE_SO_TXTIME */
+
+
+/*
+ *                      N W R I T E _ B A T C H
+ *
+ * Send count datagrams of size bytes each, laid out back to back in
+ * buf, with one sendmmsg(2).  If txtimes is not NULL, datagram i
+ * leaves no earlier than txtimes[i] (see settxtime).  Returns the
+ * number of datagrams sent, which is 0 if the socket would block.
+ */
+
+int
+Nwrite_batch(int fd, const char *buf, size_t size, int count, const uint64_t *txtimes)
+{
+#if defined(HAVE_SENDMMSG)
+    struct mmsghdr msgs[NET_MAX_BATCH];
+    struct iovec iovs[NET_MAX_BATCH];
+#if defined(HAVE_SO_TXTIME)
+    union {			/* aligned for struct cmsghdr, see cmsg(3) */
+	char buf[CMSG_SPACE(sizeof(uint64_t))];
+	struct cmsghdr align;
+    } control[NET_MAX_BATCH];
+#endif /* HAVE_SO_TXTIME */
+    int i, r;
+
+    if (count > NET_MAX_BATCH)
+	count = NET_MAX_BATCH;
+    memset(msgs, 0, count * sizeof(struct mmsghdr));
+    for (i = 0; i < count; ++i) {
+	iovs[i].iov_base = (char *) buf + i * size;
+	iovs[i].iov_len = size;
+	msgs[i].msg_hdr.msg_iov = &iovs[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+#if defined(HAVE_SO_TXTIME)
+	if (txtimes != NULL) {
+	    memset(control[i].buf, 0, sizeof(control[i].buf));
+	    msgs[i].msg_hdr.msg_control = control[i].buf;
+	    msgs[i].msg_hdr.msg_controllen = 0;
+	    net_put_txtime(&msgs[i].msg_hdr, &control[i].align, txtimes[i]);
+	}
+#endif /* HAVE_SO_TXTIME */
+    }
+
+    r = sendmmsg(fd, msgs, count, 0);
+    if (r < 0) {
+	switch (errno) {
+	    case EINTR:
+	    case EAGAIN:
+#if (EAGAIN != EWOULDBLOCK)
+	    case EWOULDBLOCK:
+#endif
+	    return 0;
+
+	    case ENOBUFS:
+	    return NET_SOFTERROR;
+
+	    default:
+	    return NET_HARDERROR;
+	}
+    }
+    return r;
+#else /* HAVE_SENDMMSG */
+    errno = ENOSYS;
+    return NET_HARDERROR;
+#endif /* HAVE_SENDMMSG */
+}
+
+
+/*
+ *                      N R E A D _ B A T C H
+ *
+ * Receive up to count datagrams with one recvmmsg(2), each into its own
+ * size-byte slot of buf, without blocking.  The length of each is put
+ * in lens[] and, if stamps is not NULL, its kernel receive timestamp
+ * in stamps[] (see Nread_stamped).  Returns the number of datagrams,
+ * 0 if none were waiting.
+ */
+
+int
+Nread_batch(int fd, char *buf, size_t size, int count, int *lens, struct timespec *stamps)
+{
+#if defined(HAVE_RECVMMSG)
+    struct mmsghdr msgs[NET_MAX_BATCH];
+    struct iovec iovs[NET_MAX_BATCH];
+#if defined(HAVE_SO_TIMESTAMPNS)
+    union {			/* aligned for struct cmsghdr, see cmsg(3) */
+	char buf[CMSG_SPACE(sizeof(struct timespec))];
+	struct cmsghdr align;
+    } control[NET_MAX_BATCH];
+#endif /* HAVE_SO_TIMESTAMPNS */
+    int i, r;
+
+    if (count > NET_MAX_BATCH)
+	count = NET_MAX_BATCH;
+    memset(msgs, 0, count * sizeof(struct mmsghdr));
+    for (i = 0; i < count; ++i) {
+	iovs[i].iov_base = buf + i * size;
+	iovs[i].iov_len = size;
+	msgs[i].msg_hdr.msg_iov = &iovs[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+#if defined(HAVE_SO_TIMESTAMPNS)
+	if (stamps != NULL) {
+	    msgs[i].msg_hdr.msg_control = control[i].buf;
+	    msgs[i].msg_hdr.msg_controllen = sizeof(control[i].buf);
+	}
+#endif /* HAVE_SO_TIMESTAMPNS */
+    }
+
+    r = recvmmsg(fd, msgs, count, MSG_DONTWAIT, NULL);
+    if (r < 0) {
+	if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+	    return 0;
+	return NET_HARDERROR;
+    }
+    for (i = 0; i < r; ++i) {
+	lens[i] = msgs[i].msg_len;
+	if (stamps != NULL)
+	    net_rx_stamp(&msgs[i].msg_hdr, &stamps[i]);
+    }
+    return r;
+#else /* HAVE_RECVMMSG */
+    errno = ENOSYS;
+    return NET_HARDERROR;
+#endif /* HAVE_RECVMMSG */
+}
+
+
+int
+has_udp_gso(void)
+{
+#if defined(HAVE_UDP_SEGMENT)
+    return 1;
+#else /* HAVE_UDP_SEGMENT */
+    return 0;
+#endif /* HAVE_UDP_SEGMENT */
+}
+
+
+/*
+ *                      N W R I T E _ G S O
+ *
+ * Send count datagrams of size bytes each, laid out back to back in
+ * buf, as one UDP_SEGMENT (GSO) send that the kernel or NIC splits
+ * into datagrams.  A non-zero txtime is the earliest departure time of
+ * the whole send (see settxtime).  Returns the number of bytes sent, 0
+ * if the socket would block.
+ */
+
+int
+Nwrite_gso(int fd, const char *buf, size_t size, int count, uint64_t txtime)
+{
+#if defined(HAVE_UDP_SEGMENT)
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cm;
+    union {			/* aligned for struct cmsghdr, see cmsg(3) */
+	char buf[CMSG_SPACE(sizeof(uint16_t)) + CMSG_SPACE(sizeof(uint64_t))];
+	struct cmsghdr align;
+    } control;
+    uint16_t gso_size = size;
+    ssize_t r;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(control.buf, 0, sizeof(control.buf));
+    iov.iov_base = (char *) buf;
+    iov.iov_len = size * count;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = IPPROTO_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+    msg.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+#if defined(HAVE_SO_TXTIME)
+    if (txtime != 0)
+	net_put_txtime(&msg, (struct cmsghdr *) (control.buf + CMSG_SPACE(sizeof(uint16_t))), txtime);
+#endif /* HAVE_SO_TXTIME */
+
+    r = sendmsg(fd, &msg, 0);
+    if (r < 0) {
+	switch (errno) {
+	    case EINTR:
+	    case EAGAIN:
+#if (EAGAIN != EWOULDBLOCK)
+	    case EWOULDBLOCK:
+#endif
+	    return 0;
+
+	    case ENOBUFS:
+	    return NET_SOFTERROR;
+
+	    default:
+	    return NET_HARDERROR;
+	}
+    }
+    return r;
+#else /* HAVE_UDP_SEGMENT */
+    errno = ENOSYS;
+    return NET_HARDERROR;
+#endif /* HAVE_UDP_SEGMENT */
+}
+
+
+int
+has_udp_gro(void)
+{
+#if defined(HAVE_UDP_GRO)
+    return 1;
+#else /* HAVE_UDP_GRO */
+    return 0;
+#endif /* HAVE_UDP_GRO */
+}
+
+
+/*
+ * Ask the kernel to hand this UDP socket coalesced (GRO) reads.
+ * Returns 0 on success, -1 on failure.
+ */
+int
+setudpgro(int fd)
+{
+#if defined(HAVE_UDP_GRO)
+    int one = 1;
+
+    return setsockopt(fd, IPPROTO_UDP, UDP_GRO, &one, sizeof(one));
+#else /* HAVE_UDP_GRO */
+    errno = ENOPROTOOPT;
+    return -1;
+#endif /* HAVE_UDP_GRO */
+}
+
+
+/*
+ *                      N R E A D _ G R O
+ *
+ * Read one, possibly coalesced, UDP read into buf without blocking.
+ * If the kernel merged several datagrams, *segsize is set to the size
+ * of each (the last one may be shorter); otherwise it is set to the
+ * length read.  If stamp is not NULL the read's kernel receive
+ * timestamp is put there (see Nread_stamped).  Returns the number of
+ * bytes read, 0 if nothing was waiting.
+ */
+
+int
+Nread_gro(int fd, char *buf, size_t size, int *segsize, struct timespec *stamp)
+{
+#if defined(HAVE_UDP_GRO)
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cm;
+    union {			/* aligned for struct cmsghdr, see cmsg(3) */
+	char buf[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(struct timespec))];
+	struct cmsghdr align;
+    } control;
+    ssize_t r;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    r = recvmsg(fd, &msg, MSG_DONTWAIT);
+    if (r < 0) {
+	if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+	    return 0;
+	return NET_HARDERROR;
+    }
+
+    *segsize = r;
+    for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+	if (cm->cmsg_level == IPPROTO_UDP && cm->cmsg_type == UDP_GRO) {
+	    int gso_size;
+
+	    memcpy(&gso_size, CMSG_DATA(cm), sizeof(gso_size));
+	    if (gso_size > 0)
+		*segsize = gso_size;
+	}
+    }
+    if (stamp != NULL)
+	net_rx_stamp(&msg, stamp);
+    return r;
+#else /* HAVE_UDP_GRO */
+    errno = ENOSYS;
+    return NET_HARDERROR;
+#endif /* HAVE_UDP_GRO */
+}
+
 /*************************************************************************/
 
 int
@@ -27,6 +27,10 @@
 #ifndef __NET_H
 #define __NET_H
 
+#include <stdint.h>
+
+struct timespec;
+
 int timeout_connect(int s, const struct sockaddr *name, socklen_t namelen, int timeout);
 int timeout_read(int s, char *buf, size_t len, int timeout);
 int netdial(int domain, int proto, const char *local, int local_port, const char *server, int port, int timeout);
@@ -35,6 +39,34 @@ int Nread(int fd, char *buf, size_t count, int prot);
 int Nwrite(int fd, const char *buf, size_t count, int prot) /* __attribute__((hot)) */;
 int has_sendfile(void);
 int Nsendfile(int fromfd, int tofd, const char *buf, size_t count) /* __attribute__((hot)) */;
+int has_mmsg(void);
+int has_busy_poll(void);
+int setbusypoll(int fd, int usecs);
+int has_msg_zerocopy(void);
+int setzerocopy(int fd);
+int Nwrite_zerocopy(int fd, const char *buf, size_t count) /* __attribute__((hot)) */;
+int Nread_zerocopy_done(int fd, uint32_t *lo, uint32_t *hi, int *copied);
+int has_rx_zerocopy(void);
+void *maprxzerocopy(int fd, size_t len);
+int Nread_zerocopy(int fd, void *map, size_t maplen, char *buf, size_t buflen, int *mapped) /* __attribute__((hot)) */;
+int has_splice(void);
+int splicepipe(int fds[2], size_t size);
+int Nsplice(int fd, int fds[2], int tofd, size_t count) /* __attribute__((hot)) */;
+int has_txtime(void);
+/* --txtime departure time clocks, by the qdisc that honours them */
+#define NET_TXTIME_FQ	1	/* CLOCK_MONOTONIC, for fq */
+#define NET_TXTIME_ETF	2	/* CLOCK_TAI, for etf */
+int settxtime(int fd, int kind);
+int Nwrite_batch(int fd, const char *buf, size_t size, int count, const uint64_t *txtimes) /* __attribute__((hot)) */;
+int Nread_batch(int fd, char *buf, size_t size, int count, int *lens, struct timespec *stamps) /* __attribute__((hot)) */;
+int has_udp_gso(void);
+int Nwrite_gso(int fd, const char *buf, size_t size, int count, uint64_t txtime) /* __attribute__((hot)) */;
+int has_udp_gro(void);
+int setudpgro(int fd);
+int Nread_gro(int fd, char *buf, size_t size, int *segsize, struct timespec *stamp) /* __attribute__((hot)) */;
+int has_rx_timestamps(void);
+int setrxtimestamps(int fd);
+int Nread_stamped(int fd, char *buf, size_t size, struct timespec *ts) /* __attribute__((hot)) */;
 int setnonblocking(int fd, int nonblocking);
 int getsockdomain(int sock);
 int parse_qos(const char *tos);
@@ -42,4 +74,9 @@ int parse_qos(const char *tos);
 #define NET_SOFTERROR -1
 #define NET_HARDERROR -2
 
+#define NET_MAX_BATCH 256	/* most datagrams per Nwrite_batch / Nread_batch */
+#define NET_MAX_GSO_SEGMENTS 64	/* most segments per Nwrite_gso (kernel limit) */
+#define NET_MAX_GSO_BYTES 65000	/* most bytes per Nwrite_gso, leaving room for headers */
+#define NET_MAX_GRO_BYTES 65536	/* largest coalesced read Nread_gro can return */
+
 #endif /* __NET_H */
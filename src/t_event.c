@@ -0,0 +1,195 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "iperf_event.h"
+
+
+static int
+test_backend(const char *name)
+{
+    struct iperf_event_loop *loop;
+    struct timeval tv;
+    int p1[2], p2[2], sv[2];
+    int tag1, tag2;
+    int n;
+
+    loop = iperf_event_loop_new(name);
+    if (loop == NULL) {
+	printf("%s: unable to create event loop\n", name);
+	return -1;
+    }
+    if (strcmp(iperf_event_backend_name(loop), name) != 0) {
+	printf("%s: wrong backend %s\n", name, iperf_event_backend_name(loop));
+	return -1;
+    }
+    if (pipe(p1) < 0 || pipe(p2) < 0) {
+	perror("pipe");
+	return -1;
+    }
+
+    /* Nothing ready: should time out. */
+    if (iperf_event_add(loop, p1[0], IPERF_EV_READ, &tag1) < 0 ||
+	iperf_event_add(loop, p2[0], IPERF_EV_READ, &tag2) < 0) {
+	printf("%s: unable to add fds\n", name);
+	return -1;
+    }
+    tv.tv_sec = 0;
+    tv.tv_usec = 1000;
+    if ((n = iperf_event_wait(loop, &tv)) != 0) {
+	printf("%s: expected timeout, got %d\n", name, n);
+	return -1;
+    }
+
+    /* One of two ready: ready-list holds just that one, with its data. */
+    if (write(p2[1], "x", 1) != 1) {
+	perror("write");
+	return -1;
+    }
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    if ((n = iperf_event_wait(loop, &tv)) != 1 || loop->nready != 1) {
+	printf("%s: expected one ready fd, got %d\n", name, n);
+	return -1;
+    }
+    if (loop->ready[0].fd != p2[0] || loop->ready[0].data != &tag2 ||
+	loop->ready[0].events != IPERF_EV_READ) {
+	printf("%s: wrong ready entry\n", name);
+	return -1;
+    }
+    if (!iperf_event_is_ready(loop, p2[0], IPERF_EV_READ) ||
+	iperf_event_is_ready(loop, p1[0], IPERF_EV_READ) ||
+	iperf_event_is_ready(loop, p2[0], IPERF_EV_WRITE)) {
+	printf("%s: wrong readiness\n", name);
+	return -1;
+    }
+    iperf_event_clear_ready(loop, p2[0], IPERF_EV_READ);
+    if (iperf_event_is_ready(loop, p2[0], IPERF_EV_READ)) {
+	printf("%s: readiness not cleared\n", name);
+	return -1;
+    }
+
+    /* Removing interest stops reporting. */
+    if (iperf_event_del(loop, p2[0], IPERF_EV_READ) < 0) {
+	printf("%s: unable to delete fd\n", name);
+	return -1;
+    }
+    tv.tv_sec = 0;
+    tv.tv_usec = 1000;
+    if ((n = iperf_event_wait(loop, &tv)) != 0) {
+	printf("%s: expected timeout after delete, got %d\n", name, n);
+	return -1;
+    }
+
+    /* Write interest on an empty pipe is ready at once. */
+    if (iperf_event_add(loop, p1[1], IPERF_EV_WRITE, &tag1) < 0) {
+	printf("%s: unable to add write fd\n", name);
+	return -1;
+    }
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    if ((n = iperf_event_wait(loop, &tv)) != 1 ||
+	!iperf_event_is_ready(loop, p1[1], IPERF_EV_WRITE)) {
+	printf("%s: expected writable fd, got %d\n", name, n);
+	return -1;
+    }
+
+    /* Switching interest keeps the data and reports only the new bits. */
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+	perror("socketpair");
+	return -1;
+    }
+    if (iperf_event_add(loop, sv[0], IPERF_EV_READ, &tag2) < 0 ||
+	write(sv[1], "x", 1) != 1 ||
+	iperf_event_mod(loop, sv[0], IPERF_EV_WRITE, IPERF_EV_READ) < 0 ||
+	iperf_event_del(loop, p1[1], IPERF_EV_WRITE) < 0) {
+	printf("%s: unable to switch interest\n", name);
+	return -1;
+    }
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    if ((n = iperf_event_wait(loop, &tv)) != 1 || loop->ready[0].fd != sv[0] ||
+	loop->ready[0].data != &tag2 || loop->ready[0].events != IPERF_EV_WRITE) {
+	printf("%s: expected only write interest after switching, got %d\n", name, n);
+	return -1;
+    }
+
+    /* After a reset nothing is registered. */
+    if (iperf_event_loop_reset(loop) < 0 || loop->nfds != 0) {
+	printf("%s: reset failed\n", name);
+	return -1;
+    }
+    tv.tv_sec = 0;
+    tv.tv_usec = 1000;
+    if ((n = iperf_event_wait(loop, &tv)) != 0) {
+	printf("%s: expected timeout after reset, got %d\n", name, n);
+	return -1;
+    }
+
+    close(p1[0]);
+    close(p1[1]);
+    close(p2[0]);
+    close(p2[1]);
+    close(sv[0]);
+    close(sv[1]);
+    iperf_event_loop_free(loop);
+    return 0;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    struct iperf_event_loop *loop;
+
+    if (test_backend("select") < 0)
+	exit(-1);
+#if defined(HAVE_EPOLL)
+    if (test_backend("epoll") < 0)
+	exit(-1);
+#endif /* HAVE_EPOLL */
+
+    if (iperf_event_backend_available("nonesuch")) {
+	printf("unknown backend reported as available\n");
+	exit(-1);
+    }
+    loop = iperf_event_loop_new(NULL);
+    if (loop == NULL) {
+	printf("unable to create default event loop\n");
+	exit(-1);
+    }
+    iperf_event_loop_free(loop);
+
+    exit(0);
+}
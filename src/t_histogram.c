@@ -0,0 +1,136 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "iperf_histogram.h"
+
+
+/* Is v within a bucket's width (1/64) above expect? */
+static int
+close_to(uint64_t v, uint64_t expect)
+{
+    return v >= expect && v - expect <= expect / IPERF_HIST_HALF + 1;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct iperf_histogram *h, *mark, *delta;
+    struct iperf_latency_summary s;
+    uint64_t v, hi;
+    int i, idx, last = -1;
+
+    /* Small values are exact, larger ones within 1/64, indexes monotonic. */
+    for (v = 0; v < ((uint64_t) 1 << IPERF_HIST_MAX_BITS); v = v < 4096 ? v + 1 : v + v / 37) {
+	idx = iperf_histogram_index(v);
+	hi = iperf_histogram_highest(idx);
+	if (idx < last || idx >= IPERF_HIST_BUCKETS || !close_to(hi, v) ||
+	    (v < (1 << IPERF_HIST_SUB_BITS) && hi != v)) {
+	    printf("value %" PRIu64 ": index %d highest %" PRIu64 "\n", v, idx, hi);
+	    exit(-1);
+	}
+	last = idx;
+    }
+    if (iperf_histogram_index(UINT64_MAX) != IPERF_HIST_BUCKETS - 1) {
+	printf("huge value not clamped to the top bucket\n");
+	exit(-1);
+    }
+
+    h = iperf_histogram_new();
+    mark = iperf_histogram_new();
+    delta = iperf_histogram_new();
+    if (h == NULL || mark == NULL || delta == NULL) {
+	printf("unable to allocate histograms\n");
+	exit(-1);
+    }
+
+    iperf_histogram_summarize(h, &s);
+    if (s.count != 0 || s.max != 0) {
+	printf("empty histogram not empty\n");
+	exit(-1);
+    }
+
+    for (v = 1; v <= 10000; ++v)
+	iperf_histogram_record(h, v * 1000);
+    iperf_histogram_summarize(h, &s);
+    if (s.count != 10000 || !close_to(s.p50, 5000000) || !close_to(s.p90, 9000000) ||
+	!close_to(s.p99, 9900000) || !close_to(s.p999, 9990000) || !close_to(s.max, 10000000)) {
+	printf("percentiles: count %" PRIu64 " p50 %" PRIu64 " p90 %" PRIu64 " p99 %" PRIu64 " p99.9 %" PRIu64 " max %" PRIu64 "\n",
+	       s.count, s.p50, s.p90, s.p99, s.p999, s.max);
+	exit(-1);
+    }
+
+    /* An interval only sees what was recorded since the last one. */
+    iperf_histogram_interval(h, mark, delta);
+    for (i = 0; i < 100; ++i)
+	iperf_histogram_record(h, 42);
+    iperf_histogram_interval(h, mark, delta);
+    iperf_histogram_summarize(delta, &s);
+    if (s.count != 100 || s.p50 != 42 || s.max != 42) {
+	printf("interval: count %" PRIu64 " p50 %" PRIu64 " max %" PRIu64 "\n", s.count, s.p50, s.max);
+	exit(-1);
+    }
+
+    iperf_histogram_add(delta, h);
+    iperf_histogram_summarize(delta, &s);
+    if (s.count != 10200) {
+	printf("merge: count %" PRIu64 "\n", s.count);
+	exit(-1);
+    }
+
+    /* Negative values are counted apart and follow intervals and merges. */
+    iperf_histogram_record_negative(h);
+    iperf_histogram_record_negative(h);
+    iperf_histogram_interval(h, mark, delta);
+    iperf_histogram_summarize(delta, &s);
+    if (s.count != 0 || s.negative != 2) {
+	printf("negative: count %" PRIu64 " negative %" PRIu64 "\n", s.count, s.negative);
+	exit(-1);
+    }
+    iperf_histogram_add(delta, h);
+    if (delta->negative != 4) {
+	printf("negative merge: %" PRIu64 "\n", delta->negative);
+	exit(-1);
+    }
+
+    iperf_histogram_reset(h);
+    iperf_histogram_summarize(h, &s);
+    if (s.count != 0 || s.negative != 0) {
+	printf("reset histogram not empty\n");
+	exit(-1);
+    }
+
+    iperf_histogram_free(h);
+    iperf_histogram_free(mark);
+    iperf_histogram_free(delta);
+    exit(0);
+}
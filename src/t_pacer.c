@@ -0,0 +1,94 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "iperf_pacer.h"
+
+
+int
+main(int argc, char **argv)
+{
+    struct iperf_pacer p;
+    struct iperf_time now;
+    uint64_t wait;
+
+    /* 8 Mbit/s is 1000 bytes per millisecond; the bucket holds 10 ms */
+    now.secs = 100;
+    now.nsecs = 0;
+    iperf_pacer_init(&p, 8000000, 10000, &now);
+    if (!iperf_pacer_ready(&p, &now)) {
+	printf("bucket does not start full\n");
+	exit(-1);
+    }
+
+    /* Drain it, and one 1500-byte send more */
+    iperf_pacer_consume(&p, 11500);
+    if (iperf_pacer_ready(&p, &now)) {
+	printf("overdrawn bucket still ready\n");
+	exit(-1);
+    }
+    wait = iperf_pacer_wait(&p);
+    if (wait < 1500000 || wait > 1500001) {
+	printf("wait %" PRIu64 " ns, expected 1.5 ms\n", wait);
+	exit(-1);
+    }
+
+    /* 1 ms in: still 500 bytes short; 2 ms in: ready */
+    iperf_time_add_usecs(&now, 1000);
+    if (iperf_pacer_ready(&p, &now)) {
+	printf("ready before the deficit is paid back\n");
+	exit(-1);
+    }
+    iperf_time_add_usecs(&now, 1000);
+    if (!iperf_pacer_ready(&p, &now)) {
+	printf("not ready after the deficit is paid back\n");
+	exit(-1);
+    }
+
+    /* A one-second stall earns no more than one bucket */
+    iperf_time_add_usecs(&now, 1000000);
+    iperf_pacer_ready(&p, &now);
+    if (p.tokens != 10000) {
+	printf("after a stall the bucket holds %.0f bytes, expected 10000\n", p.tokens);
+	exit(-1);
+    }
+
+    /* A clock that goes backwards earns nothing */
+    now.secs -= 1;
+    iperf_pacer_consume(&p, 10000);
+    if (iperf_pacer_ready(&p, &now)) {
+	printf("earned tokens going backwards\n");
+	exit(-1);
+    }
+
+    exit(0);
+}
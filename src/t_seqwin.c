@@ -0,0 +1,110 @@
+/*
+ * iperf, Copyright (c) 2014-2020, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "iperf_seqwin.h"
+
+
+static int
+expect(struct iperf_seqwin *w, uint64_t seq, enum iperf_seq_class want, uint64_t want_distance)
+{
+    uint64_t distance = 0;
+    enum iperf_seq_class got = iperf_seqwin_update(w, seq, &distance);
+
+    if (got != want || (want == IPERF_SEQ_REORDERED && distance != want_distance)) {
+	printf("seq %" PRIu64 ": class %d distance %" PRIu64 ", expected class %d distance %" PRIu64 "\n",
+	       seq, got, distance, want, want_distance);
+	return -1;
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct iperf_seqwin *w;
+    uint64_t s;
+
+    w = iperf_seqwin_new(100);
+    if (w == NULL || w->size != 128) {
+	printf("window not rounded up to a power of two\n");
+	exit(-1);
+    }
+
+    /* 1..10 in order, then a gap of 11..14 */
+    for (s = 1; s <= 10; ++s)
+	if (expect(w, s, IPERF_SEQ_NEW, 0) < 0)
+	    exit(-1);
+    if (expect(w, 15, IPERF_SEQ_NEW, 0) < 0 || iperf_seqwin_lost(w) != 4)
+	exit(-1);
+
+    /* 12 fills part of the gap, a second 12 and a second 15 are duplicates */
+    if (expect(w, 12, IPERF_SEQ_REORDERED, 3) < 0 ||
+	expect(w, 12, IPERF_SEQ_DUPLICATE, 0) < 0 ||
+	expect(w, 15, IPERF_SEQ_DUPLICATE, 0) < 0 ||
+	iperf_seqwin_lost(w) != 3 || iperf_seqwin_highest(w) != 15) {
+	printf("lost %" PRIu64 " highest %" PRIu64 "\n", iperf_seqwin_lost(w), iperf_seqwin_highest(w));
+	exit(-1);
+    }
+
+    /* Move well past the window: 11 is now too late, old bits are gone */
+    for (s = 16; s <= 300; ++s)
+	if (expect(w, s, IPERF_SEQ_NEW, 0) < 0)
+	    exit(-1);
+    if (expect(w, 11, IPERF_SEQ_LATE, 0) < 0 || iperf_seqwin_lost(w) != 3)
+	exit(-1);
+
+    /* Slots reused after the wrap start out clear */
+    if (expect(w, 400, IPERF_SEQ_NEW, 0) < 0 ||
+	expect(w, 350, IPERF_SEQ_REORDERED, 50) < 0 ||
+	expect(w, 299, IPERF_SEQ_DUPLICATE, 0) < 0 ||
+	expect(w, 250, IPERF_SEQ_LATE, 0) < 0 ||
+	iperf_seqwin_lost(w) != 3 + 99 - 1) {
+	printf("lost %" PRIu64 "\n", iperf_seqwin_lost(w));
+	exit(-1);
+    }
+
+    /* A jump larger than the window clears everything */
+    if (expect(w, 100000, IPERF_SEQ_NEW, 0) < 0 ||
+	expect(w, 99999, IPERF_SEQ_REORDERED, 1) < 0 ||
+	expect(w, 400, IPERF_SEQ_LATE, 0) < 0)
+	exit(-1);
+
+    if (iperf_seqwin_dist_bucket(1) != 0 || iperf_seqwin_dist_bucket(3) != 1 ||
+	iperf_seqwin_dist_bucket(4) != 2 || iperf_seqwin_dist_bucket(UINT64_MAX) != IPERF_SEQWIN_DIST_BUCKETS - 1) {
+	printf("bad reorder distance buckets\n");
+	exit(-1);
+    }
+
+    iperf_seqwin_free(w);
+    exit(0);
+}
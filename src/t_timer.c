@@ -39,6 +39,9 @@
 
 
 static int flag;
+static int fired[256];
+static int nfired;
+static int ticks;
 
 
 static void
@@ -48,11 +51,84 @@ timer_proc( TimerClientData client_data, struct iperf_time* nowP )
 }
 
 
+static void
+order_proc( TimerClientData client_data, struct iperf_time* nowP )
+{
+    fired[nfired++] = client_data.i;
+}
+
+
+static void
+tick_proc( TimerClientData client_data, struct iperf_time* nowP )
+{
+    ++ticks;
+}
+
+
+/* Timers must fire in expiry order, creation order breaking ties, and
+** cancelled timers must not fire at all.
+*/
+static int
+check_order( void )
+{
+    struct iperf_time now, start;
+    Timer *timers[256], *periodic;
+    TimerClientData cd;
+    int i, ms;
+
+    start.secs = 1000;
+    start.nsecs = 0;
+    nfired = 0;
+    ticks = 0;
+    for (i = 0; i < 256; ++i) {
+	cd.i = i;
+	/* Scrambled expiry times, 1..64 ms, each shared by four timers */
+	timers[i] = tmr_create(&start, order_proc, cd, ((i * 37) % 64 + 1) * 1000, 0);
+	if (timers[i] == NULL)
+	    return -1;
+    }
+    periodic = tmr_create(&start, tick_proc, JunkClientData, 10000, 1);
+    if (periodic == NULL)
+	return -1;
+    for (i = 0; i < 256; i += 8)
+	tmr_cancel(timers[i]);
+
+    for (ms = 0; ms <= 100; ++ms) {
+	now = start;
+	iperf_time_add_usecs(&now, ms * 1000);
+	tmr_run(&now);
+    }
+    tmr_cancel(periodic);
+
+    if (nfired != 256 - 32 || ticks != 10) {
+	printf("%d timers and %d ticks fired, expected %d and 10\n", nfired, ticks, 256 - 32);
+	return -1;
+    }
+    for (i = 0; i < nfired; ++i) {
+	if (fired[i] % 8 == 0) {
+	    printf("cancelled timer %d fired\n", fired[i]);
+	    return -1;
+	}
+	if (i > 0) {
+	    int a = (fired[i - 1] * 37) % 64, b = (fired[i] * 37) % 64;
+	    if (a > b || (a == b && fired[i - 1] > fired[i])) {
+		printf("timer %d fired before timer %d\n", fired[i - 1], fired[i]);
+		return -1;
+	    }
+	}
+    }
+    return 0;
+}
+
+
 int 
 main(int argc, char **argv)
 {
     Timer *tp;
 
+    if (check_order() < 0)
+	exit(-1);
+
     flag = 0;
     tp = tmr_create(NULL, timer_proc, JunkClientData, 3000000, 0);
     if (!tp)
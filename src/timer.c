@@ -33,7 +33,18 @@
 #include "timer.h"
 #include "iperf_time.h"
 
-static Timer* timers = NULL;
+/* Pending timers live in a 4-ary min-heap ordered by expiry time (and
+** creation order among equal times), so adding, cancelling or
+** rescheduling a timer is O(log n) and finding the next one is O(1).
+** A four-way heap is shallower than a binary one and keeps each node's
+** children in one cache line.
+*/
+#define HEAP_ARITY 4
+
+static Timer** heap = NULL;
+static int heap_len = 0;
+static int heap_size = 0;
+static uint64_t next_seq = 0;
 static Timer* free_timers = NULL;
 
 TimerClientData JunkClientData;
@@ -57,64 +68,107 @@ getnow( struct iperf_time* nowP, struct iperf_time* nowP2 )
 }
 
 
+/* Does timer a expire before timer b? */
+static int
+heap_before( Timer* a, Timer* b )
+{
+    int cmp = iperf_time_compare( &a->time, &b->time );
+
+    return cmp < 0 || ( cmp == 0 && a->seq < b->seq );
+}
+
+
+static void
+heap_set( int i, Timer* t )
+{
+    heap[i] = t;
+    t->index = i;
+}
+
+
 static void
-list_add( Timer* t )
+heap_up( int i )
 {
-    Timer* t2;
-    Timer* t2prev;
+    Timer* t = heap[i];
+    int parent;
 
-    if ( timers == NULL ) {
-	/* The list is empty. */
-	timers = t;
-	t->prev = t->next = NULL;
-    } else {
-	if (iperf_time_compare(&t->time, &timers->time) < 0) {
-	    /* The new timer goes at the head of the list. */
-	    t->prev = NULL;
-	    t->next = timers;
-	    timers->prev = t;
-	    timers = t;
-	} else {
-	    /* Walk the list to find the insertion point. */
-	    for ( t2prev = timers, t2 = timers->next; t2 != NULL;
-		  t2prev = t2, t2 = t2->next ) {
-		if (iperf_time_compare(&t->time, &t2->time) < 0) {
-		    /* Found it. */
-		    t2prev->next = t;
-		    t->prev = t2prev;
-		    t->next = t2;
-		    t2->prev = t;
-		    return;
-		}
-	    }
-	    /* Oops, got to the end of the list.  Add to tail. */
-	    t2prev->next = t;
-	    t->prev = t2prev;
-	    t->next = NULL;
-	}
+    while ( i > 0 ) {
+	parent = ( i - 1 ) / HEAP_ARITY;
+	if ( ! heap_before( t, heap[parent] ) )
+	    break;
+	heap_set( i, heap[parent] );
+	i = parent;
     }
+    heap_set( i, t );
 }
 
 
 static void
-list_remove( Timer* t )
+heap_down( int i )
 {
-    if ( t->prev == NULL )
-	timers = t->next;
-    else
-	t->prev->next = t->next;
-    if ( t->next != NULL )
-	t->next->prev = t->prev;
+    Timer* t = heap[i];
+    int child, c, last, best;
+
+    for (;;) {
+	child = i * HEAP_ARITY + 1;
+	if ( child >= heap_len )
+	    break;
+	last = child + HEAP_ARITY < heap_len ? child + HEAP_ARITY : heap_len;
+	best = child;
+	for ( c = child + 1; c < last; ++c )
+	    if ( heap_before( heap[c], heap[best] ) )
+		best = c;
+	if ( ! heap_before( heap[best], t ) )
+	    break;
+	heap_set( i, heap[best] );
+	i = best;
+    }
+    heap_set( i, t );
+}
+
+
+static int
+heap_add( Timer* t )
+{
+    if ( heap_len == heap_size ) {
+	int size = heap_size ? heap_size * 2 : 64;
+	Timer** h = (Timer**) realloc( heap, size * sizeof(Timer*) );
+	if ( h == NULL )
+	    return -1;
+	heap = h;
+	heap_size = size;
+    }
+    t->seq = next_seq++;
+    heap_set( heap_len, t );
+    ++heap_len;
+    heap_up( t->index );
+    return 0;
 }
 
 
 static void
-list_resort( Timer* t )
+heap_remove( Timer* t )
 {
-    /* Remove the timer from the list. */
-    list_remove( t );
-    /* And add it back in, sorted correctly. */
-    list_add( t );
+    int i = t->index;
+    Timer* last;
+
+    t->index = -1;
+    last = heap[--heap_len];
+    if ( i == heap_len )
+	return;
+    heap_set( i, last );
+    heap_up( i );
+    heap_down( last->index );
+}
+
+
+/* Move a timer whose time has changed to its new place. */
+static void
+heap_resort( Timer* t )
+{
+    t->seq = next_seq++;
+    heap_up( t->index );
+    heap_down( t->index );
 }
 
 
@@ -143,8 +197,12 @@ tmr_create(
     t->periodic = periodic;
     t->time = now;
     iperf_time_add_usecs(&t->time, usecs);
-    /* Add the new timer to the active list. */
-    list_add( t );
+    /* Add the new timer to the active heap. */
+    if ( heap_add( t ) < 0 ) {
+	t->next = free_timers;
+	free_timers = t;
+	return NULL;
+    }
 
     return t;
 }
@@ -159,10 +217,10 @@ tmr_timeout( struct iperf_time* nowP )
     static struct timeval timeout;
 
     getnow( nowP, &now );
-    /* Since the list is sorted, we only need to look at the first timer. */
-    if ( timers == NULL )
+    /* The next timer to expire is at the top of the heap. */
+    if ( heap_len == 0 )
 	return NULL;
-    past = iperf_time_diff(&timers->time, &now, &diff);
+    past = iperf_time_diff(&heap[0]->time, &now, &diff);
     if (past)
         usecs = 0;
     else
@@ -178,21 +236,23 @@ tmr_run( struct iperf_time* nowP )
 {
     struct iperf_time now;
     Timer* t;
-    Timer* next;
+    uint64_t seq;
 
     getnow( nowP, &now );
-    for ( t = timers; t != NULL; t = next ) {
-	next = t->next;
-	/* Since the list is sorted, as soon as we find a timer
-	** that isn't ready yet, we are done.
-	*/
+    while ( heap_len > 0 ) {
+	t = heap[0];
+	/* As soon as the earliest timer isn't ready yet, we are done. */
 	if (iperf_time_compare(&t->time, &now) > 0)
 	    break;
+	seq = t->seq;
 	(t->timer_proc)( t->client_data, &now );
+	/* The callback may have cancelled or reset this timer. */
+	if ( t->index < 0 || t->seq != seq )
+	    continue;
 	if ( t->periodic ) {
 	    /* Reschedule. */
 	    iperf_time_add_usecs(&t->time, t->usecs);
-	    list_resort( t );
+	    heap_resort( t );
 	} else
 	    tmr_cancel( t );
     }
@@ -207,19 +267,19 @@ tmr_reset( struct iperf_time* nowP, Timer* t )
     getnow( nowP, &now );
     t->time = now;
     iperf_time_add_usecs( &t->time, t->usecs );
-    list_resort( t );
+    heap_resort( t );
 }
 
 
 void
 tmr_cancel( Timer* t )
 {
-    /* Remove it from the active list. */
-    list_remove( t );
+    /* Remove it from the active heap. */
+    if ( t->index >= 0 )
+	heap_remove( t );
     /* And put it on the free list. */
     t->next = free_timers;
     free_timers = t;
-    t->prev = NULL;
 }
 
 
@@ -239,7 +299,10 @@ tmr_cleanup( void )
 void
 tmr_destroy( void )
 {
-    while ( timers != NULL )
-	tmr_cancel( timers );
+    while ( heap_len > 0 )
+	tmr_cancel( heap[0] );
     tmr_cleanup();
+    free( heap );
+    heap = NULL;
+    heap_size = 0;
 }
@@ -30,6 +30,7 @@
 #ifndef __TIMER_H
 #define __TIMER_H
 
+#include <stdint.h>
 #include <time.h>
 #include <sys/time.h>
 
@@ -62,9 +63,9 @@ typedef struct TimerStruct
     int64_t usecs;
     int periodic;
     struct iperf_time time;
-    struct TimerStruct* prev;
-    struct TimerStruct* next;
-    int hash;
+    uint64_t seq;		/* orders timers that expire together */
+    int index;			/* position in the heap, or -1 */
+    struct TimerStruct* next;	/* free list */
 } Timer;
 
 /* Set up a timer, either periodic or one-shot. Returns (Timer*) 0 on errors. */